@@ -0,0 +1,833 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Host benchmark - scripted workloads run through libext2 entry points
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/minmax.h>
+#include <sys/stat.h>
+#include <sys/threads.h>
+
+#include "../libext2.h"
+#include "bmpbench.h"
+#include "dev.h"
+
+
+/* Default workloads parameters */
+#define BENCH_FILES   2000       /* Number of files created in a storm */
+#define BENCH_FILESZ  4096       /* Size of a storm file */
+#define BENCH_SIZE    (32 << 20) /* Size of a sequential/random I/O file */
+#define BENCH_IOSZ    (64 << 10) /* Sequential I/O request size */
+#define BENCH_RANDSZ  4096       /* Random I/O request size */
+#define BENCH_RANDN   4096       /* Number of random I/O requests (per thread in multithreaded workloads) */
+#define BENCH_THREADS 4          /* Number of multithreaded workloads threads */
+#define BENCH_TOL     10         /* Default regression tolerance (%) */
+
+
+/* Workload results */
+typedef struct {
+	char name[16];        /* Workload name */
+	uint64_t ops;         /* Number of operations */
+	double opss;          /* Operations per second (including final sync) */
+	double lat[4];        /* Latency 50th, 90th and 99th percentile and max (us) */
+	bench_devstat_t stat; /* Device access counters */
+} bench_result_t;
+
+
+/* Multithreaded workload thread */
+typedef struct {
+	oid_t oid;         /* Read file or searched directory */
+	int lookup;        /* Thread looks up storm files instead of reading */
+	unsigned int seed; /* Random numbers seed */
+	char *buff;        /* I/O buffer */
+	uint64_t *lat;     /* Operations latency (ns) */
+	size_t nlat;       /* Number of measured operations */
+	handle_t tid;      /* Thread ID */
+	int err;           /* Thread result */
+} bench_thread_t;
+
+
+typedef struct {
+	const char *name;  /* Workload name */
+	const char *descr; /* Workload description */
+	int (*run)(void);  /* Runs workload (filesystem is mounted) */
+} bench_workload_t;
+
+
+static struct {
+	bench_dev_t dev;   /* Block device */
+	storage_fs_t fs;   /* Mounted filesystem */
+	oid_t root;        /* Root directory */
+	const char *opts;  /* Mount options */
+	unsigned int seed; /* Random offsets seed */
+
+	/* Workloads parameters */
+	unsigned int files;   /* Number of files created in a storm */
+	size_t filesz;        /* Size of a storm file */
+	size_t size;          /* Size of a sequential/random I/O file */
+	size_t iosz;          /* Sequential I/O request size */
+	unsigned int randn;   /* Number of random I/O requests (per thread in multithreaded workloads) */
+	unsigned int threads; /* Number of multithreaded workloads threads */
+
+	/* Measurement */
+	char *buff;         /* I/O buffer */
+	uint64_t *lat;      /* Operations latency (ns) */
+	size_t nlat;        /* Number of measured operations */
+	size_t szlat;       /* Latency buffer size */
+	uint64_t start;     /* Operation start time */
+} bench;
+
+
+static uint64_t bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static void bench_opStart(void)
+{
+	bench.start = bench_now();
+}
+
+
+static int bench_opEnd(void)
+{
+	uint64_t *lat;
+
+	if (bench.nlat == bench.szlat) {
+		if ((lat = (uint64_t *)realloc(bench.lat, 2 * bench.szlat * sizeof(uint64_t))) == NULL)
+			return -ENOMEM;
+
+		bench.lat = lat;
+		bench.szlat *= 2;
+	}
+	bench.lat[bench.nlat++] = bench_now() - bench.start;
+
+	return EOK;
+}
+
+
+/* Adds latencies measured by a workload thread */
+static int bench_latAdd(const uint64_t *lat, size_t n)
+{
+	uint64_t *tmp;
+	size_t size;
+
+	for (size = bench.szlat; size < bench.nlat + n; size *= 2)
+		;
+
+	if (size != bench.szlat) {
+		if ((tmp = (uint64_t *)realloc(bench.lat, size * sizeof(uint64_t))) == NULL)
+			return -ENOMEM;
+
+		bench.lat = tmp;
+		bench.szlat = size;
+	}
+	memcpy(bench.lat + bench.nlat, lat, n * sizeof(uint64_t));
+	bench.nlat += n;
+
+	return EOK;
+}
+
+
+/* Returns pseudo random number (xorshift) */
+static uint32_t bench_xorshift(unsigned int *seed)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+
+	return *seed;
+}
+
+
+static uint32_t bench_rand(void)
+{
+	return bench_xorshift(&bench.seed);
+}
+
+
+static int bench_lookup(oid_t *dir, const char *name, oid_t *oid)
+{
+	oid_t dev;
+	int err;
+
+	if ((err = bench.fs.ops->lookup(bench.fs.info, dir, name, oid, &dev, NULL, 0)) < 0)
+		return err;
+
+	return EOK;
+}
+
+
+/* Looks up or creates a file */
+static int bench_open(oid_t *dir, const char *name, int type, oid_t *oid)
+{
+	oid_t dev = { 0 };
+	int err;
+
+	if (bench_lookup(dir, name, oid) < 0) {
+		if ((err = bench.fs.ops->create(bench.fs.info, dir, name, oid, (type == otDir) ? (S_IFDIR | 0755) : (S_IFREG | 0644), type, &dev)) < 0)
+			return err;
+	}
+
+	return bench.fs.ops->open(bench.fs.info, oid);
+}
+
+
+static void bench_close(oid_t *oid)
+{
+	bench.fs.ops->close(bench.fs.info, oid);
+}
+
+
+/* Removes a file (its inode is released with the last reference) */
+static int bench_remove(oid_t *dir, const char *name)
+{
+	return bench.fs.ops->unlink(bench.fs.info, dir, name);
+}
+
+
+static int bench_createStorm(void)
+{
+	oid_t dir, oid;
+	char name[16];
+	unsigned int i;
+	ssize_t ret;
+	int err;
+
+	if ((err = bench_open(&bench.root, "storm", otDir, &dir)) < 0)
+		return err;
+
+	for (i = 0; i < bench.files; i++) {
+		snprintf(name, sizeof(name), "f%u", i);
+
+		bench_opStart();
+
+		if ((err = bench_open(&dir, name, otFile, &oid)) < 0)
+			break;
+
+		ret = bench.fs.ops->write(bench.fs.info, &oid, 0, bench.buff, bench.filesz);
+		bench_close(&oid);
+
+		if (ret != bench.filesz) {
+			err = (ret < 0) ? ret : -EIO;
+			break;
+		}
+
+		if ((err = bench_opEnd()) < 0)
+			break;
+	}
+	bench_close(&dir);
+
+	return err;
+}
+
+
+static int bench_readdir(void)
+{
+	libext2_devctl_in_t *in;
+	struct dirent *dent;
+	unsigned int n = 0;
+	msg_t msg;
+	off_t offs = 0;
+	int ret, err, len;
+
+	if ((err = bench_open(&bench.root, "storm", otDir, &msg.oid)) < 0)
+		return err;
+
+	for (;;) {
+		/* Packed listing (see LIBEXT2_DEVCTL_READDIR) */
+		msg.type = mtDevCtl;
+		in = (libext2_devctl_in_t *)msg.i.raw;
+		in->command = LIBEXT2_DEVCTL_READDIR;
+		in->readdir.offs = offs;
+		msg.o.data = bench.buff;
+		msg.o.size = BENCH_RANDSZ;
+
+		bench_opStart();
+
+		libext2_handler(bench.fs.info, &msg);
+		if ((ret = msg.o.err) <= 0) {
+			err = (ret == -ENOENT) ? EOK : ret;
+			break;
+		}
+
+		if ((err = bench_opEnd()) < 0)
+			break;
+
+		for (len = 0, dent = (struct dirent *)bench.buff; len < ret; n++) {
+			len += dent->d_reclen;
+			dent = (struct dirent *)((char *)dent + LIBEXT2_DIRENT_SIZE(dent->d_namlen));
+		}
+		offs += ret;
+	}
+	bench_close(&msg.oid);
+
+	/* Storm files and "." and ".." entries */
+	if ((err == EOK) && (n != bench.files + 2)) {
+		fprintf(stderr, "ext2-bench: listed %u entries, expected %u\n", n, bench.files + 2);
+		return -EIO;
+	}
+
+	return err;
+}
+
+
+static int bench_unlinkStorm(void)
+{
+	oid_t dir;
+	char name[16];
+	unsigned int i;
+	int err;
+
+	if ((err = bench_open(&bench.root, "storm", otDir, &dir)) < 0)
+		return err;
+
+	for (i = 0; i < bench.files; i++) {
+		snprintf(name, sizeof(name), "f%u", i);
+
+		bench_opStart();
+
+		if (((err = bench_remove(&dir, name)) < 0) || ((err = bench_opEnd()) < 0))
+			break;
+	}
+	bench_close(&dir);
+
+	if (err < 0)
+		return err;
+
+	return bench_remove(&bench.root, "storm");
+}
+
+
+/* Reads or writes the I/O file */
+static int bench_io(int write, int rand)
+{
+	size_t len = (rand) ? BENCH_RANDSZ : bench.iosz;
+	uint64_t i, n = (rand) ? bench.randn : bench.size / len;
+	ssize_t ret = 0;
+	oid_t oid;
+	off_t offs;
+	int err;
+
+	if ((err = bench_open(&bench.root, "seq", otFile, &oid)) < 0)
+		return err;
+
+	for (i = 0; i < n; i++) {
+		offs = (rand) ? (off_t)(bench_rand() % (bench.size / len)) * len : (off_t)i * len;
+
+		bench_opStart();
+
+		if (write)
+			ret = bench.fs.ops->write(bench.fs.info, &oid, offs, bench.buff, len);
+		else
+			ret = bench.fs.ops->read(bench.fs.info, &oid, offs, bench.buff, len);
+
+		if (ret != len) {
+			err = (ret < 0) ? ret : -EIO;
+			break;
+		}
+
+		if ((err = bench_opEnd()) < 0)
+			break;
+	}
+	bench_close(&oid);
+
+	return err;
+}
+
+
+static int bench_seqWrite(void)
+{
+	return bench_io(1, 0);
+}
+
+
+static int bench_seqRead(void)
+{
+	return bench_io(0, 0);
+}
+
+
+static int bench_randWrite(void)
+{
+	return bench_io(1, 1);
+}
+
+
+static int bench_randRead(void)
+{
+	return bench_io(0, 1);
+}
+
+
+/* Reads random blocks of the I/O file or looks up random storm files */
+static void bench_thread(void *arg)
+{
+	bench_thread_t *thread = (bench_thread_t *)arg;
+	char name[16];
+	uint64_t start;
+	unsigned int i;
+	ssize_t ret;
+	oid_t oid;
+	int err = EOK;
+
+	for (i = 0; i < bench.randn; i++) {
+		start = bench_now();
+
+		if (thread->lookup) {
+			snprintf(name, sizeof(name), "f%u", bench_xorshift(&thread->seed) % bench.files);
+			err = bench_lookup(&thread->oid, name, &oid);
+		}
+		else {
+			ret = bench.fs.ops->read(bench.fs.info, &thread->oid, (off_t)(bench_xorshift(&thread->seed) % (bench.size / BENCH_RANDSZ)) * BENCH_RANDSZ, thread->buff, BENCH_RANDSZ);
+			if (ret != BENCH_RANDSZ)
+				err = (ret < 0) ? ret : -EIO;
+		}
+
+		if (err < 0)
+			break;
+
+		thread->lat[thread->nlat++] = bench_now() - start;
+	}
+	thread->err = err;
+
+	endthread();
+}
+
+
+/* Runs random reads or lookups in parallel threads */
+static int bench_mt(int lookup)
+{
+	bench_thread_t *threads;
+	unsigned int i, n;
+	oid_t oid;
+	int err;
+
+	/* Lookups need storm files */
+	if (lookup && (bench.files == 0))
+		return EOK;
+
+	if ((err = bench_open(&bench.root, (lookup) ? "storm" : "seq", (lookup) ? otDir : otFile, &oid)) < 0)
+		return err;
+
+	if ((threads = (bench_thread_t *)calloc(bench.threads, sizeof(bench_thread_t))) == NULL) {
+		bench_close(&oid);
+		return -ENOMEM;
+	}
+
+	for (n = 0; n < bench.threads; n++) {
+		threads[n].oid = oid;
+		threads[n].lookup = lookup;
+		threads[n].seed = bench_rand();
+		threads[n].buff = (char *)malloc(BENCH_RANDSZ);
+		threads[n].lat = (uint64_t *)malloc(bench.randn * sizeof(uint64_t));
+
+		if ((threads[n].buff == NULL) || (threads[n].lat == NULL)) {
+			free(threads[n].lat);
+			free(threads[n].buff);
+			err = -ENOMEM;
+			break;
+		}
+
+		if ((err = beginthreadex(bench_thread, 4, NULL, 0, threads + n, &threads[n].tid)) < 0) {
+			free(threads[n].lat);
+			free(threads[n].buff);
+			break;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		threadJoin((int)threads[i].tid, 0);
+
+		if (err == EOK)
+			err = threads[i].err;
+
+		if (err == EOK)
+			err = bench_latAdd(threads[i].lat, threads[i].nlat);
+
+		free(threads[i].lat);
+		free(threads[i].buff);
+	}
+	free(threads);
+	bench_close(&oid);
+
+	return err;
+}
+
+
+static int bench_mtLookup(void)
+{
+	return bench_mt(1);
+}
+
+
+static int bench_mtRead(void)
+{
+	return bench_mt(0);
+}
+
+
+static int bench_truncate(void)
+{
+	size_t size = bench.size;
+	oid_t oid;
+	int err;
+
+	if ((err = bench_open(&bench.root, "seq", otFile, &oid)) < 0)
+		return err;
+
+	/* File is shrunk in 1 MiB steps */
+	while ((err == EOK) && (size > 0)) {
+		size = (size > (1 << 20)) ? size - (1 << 20) : 0;
+
+		bench_opStart();
+
+		if ((err = bench.fs.ops->truncate(bench.fs.info, &oid, size)) == EOK)
+			err = bench_opEnd();
+	}
+	bench_close(&oid);
+
+	if (err < 0)
+		return err;
+
+	return bench_remove(&bench.root, "seq");
+}
+
+
+static const bench_workload_t workloads[] = {
+	{ "create", "create storm files", bench_createStorm },
+	{ "readdir", "list storm directory", bench_readdir },
+	{ "mtlookup", "look up random storm files in parallel threads", bench_mtLookup },
+	{ "unlink", "remove storm files", bench_unlinkStorm },
+	{ "seqwrite", "write I/O file sequentially", bench_seqWrite },
+	{ "seqread", "read I/O file sequentially", bench_seqRead },
+	{ "randwrite", "write I/O file at random offsets", bench_randWrite },
+	{ "randread", "read I/O file at random offsets", bench_randRead },
+	{ "mtread", "read I/O file at random offsets in parallel threads", bench_mtRead },
+	{ "truncate", "shrink and remove I/O file", bench_truncate }
+};
+
+
+static int bench_latcmp(const void *lat1, const void *lat2)
+{
+	uint64_t l1 = *(const uint64_t *)lat1;
+	uint64_t l2 = *(const uint64_t *)lat2;
+
+	return (l1 > l2) - (l1 < l2);
+}
+
+
+static int bench_mount(void)
+{
+	bench.root.port = 0;
+	bench.root.id = 0;
+
+	return libext2_storage_mount(&bench.dev.strg, &bench.fs, bench.opts, 0, &bench.root);
+}
+
+
+/* Runs workload on freshly mounted filesystem, so it starts with cold caches */
+static int bench_run(const bench_workload_t *workload, bench_result_t *res)
+{
+	static const double pcts[] = { 0.5, 0.9, 0.99, 1.0 };
+	bench_devstat_t stat;
+	uint64_t start, end;
+	unsigned int i;
+	int err;
+
+	if ((err = bench_mount()) < 0) {
+		fprintf(stderr, "ext2-bench: failed to mount filesystem (%s)\n", strerror(-err));
+		return err;
+	}
+
+	bench.nlat = 0;
+	stat = bench.dev.stat;
+	start = bench_now();
+
+	/* Written back data is accounted to the workload */
+	if (((err = workload->run()) == EOK) && ((err = bench.fs.ops->sync(bench.fs.info, &bench.root)) < 0))
+		fprintf(stderr, "ext2-bench: %s: failed to sync filesystem (%s)\n", workload->name, strerror(-err));
+	else if (err < 0)
+		fprintf(stderr, "ext2-bench: %s: workload failed (%s)\n", workload->name, strerror(-err));
+
+	end = bench_now();
+	libext2_storage_umount(&bench.fs);
+
+	if (err < 0)
+		return err;
+
+	memset(res, 0, sizeof(*res));
+	snprintf(res->name, sizeof(res->name), "%s", workload->name);
+	res->ops = bench.nlat;
+	res->opss = (end > start) ? bench.nlat * 1e9 / (end - start) : 0;
+	res->stat.reads = bench.dev.stat.reads - stat.reads;
+	res->stat.writes = bench.dev.stat.writes - stat.writes;
+	res->stat.rbytes = bench.dev.stat.rbytes - stat.rbytes;
+	res->stat.wbytes = bench.dev.stat.wbytes - stat.wbytes;
+
+	if (bench.nlat > 0) {
+		qsort(bench.lat, bench.nlat, sizeof(uint64_t), bench_latcmp);
+
+		for (i = 0; i < sizeof(pcts) / sizeof(pcts[0]); i++)
+			res->lat[i] = bench.lat[(size_t)(pcts[i] * (bench.nlat - 1))] / 1e3;
+	}
+
+	return EOK;
+}
+
+
+static void bench_print(FILE *f, const bench_result_t *res)
+{
+	fprintf(f, "%-10s %8llu %11.1f %9.1f %9.1f %9.1f %9.1f %8llu %8llu %10llu %10llu\n", res->name, (unsigned long long)res->ops, res->opss,
+		res->lat[0], res->lat[1], res->lat[2], res->lat[3], (unsigned long long)res->stat.reads, (unsigned long long)res->stat.writes,
+		(unsigned long long)(res->stat.rbytes >> 10), (unsigned long long)(res->stat.wbytes >> 10));
+}
+
+
+/* Compares results with the baseline (previous run output), returns number of regressions */
+static int bench_compare(const char *path, const bench_result_t *results, unsigned int n, unsigned int tol)
+{
+	bench_result_t base;
+	unsigned long long ops, reads, writes, rkib, wkib;
+	char line[256];
+	unsigned int i;
+	int regressions = 0;
+	FILE *f;
+
+	if ((f = fopen(path, "r")) == NULL) {
+		fprintf(stderr, "ext2-bench: failed to open baseline %s\n", path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if ((line[0] == '#') || (sscanf(line, "%15s %llu %lf %lf %lf %lf %lf %llu %llu %llu %llu", base.name, &ops, &base.opss,
+			&base.lat[0], &base.lat[1], &base.lat[2], &base.lat[3], &reads, &writes, &rkib, &wkib) != 11))
+			continue;
+
+		for (i = 0; (i < n) && strcmp(results[i].name, base.name); i++)
+			;
+
+		if (i == n)
+			continue;
+
+		/* Throughput dropped or device traffic grew beyond the tolerance */
+		if (results[i].opss * 100 < base.opss * (100 - tol)) {
+			printf("REGRESSION %s: %.1f ops/s, baseline %.1f ops/s\n", base.name, results[i].opss, base.opss);
+			regressions++;
+		}
+
+		if ((results[i].stat.reads + results[i].stat.writes) * 100 > (reads + writes) * (100 + tol)) {
+			printf("REGRESSION %s: %llu device requests, baseline %llu\n", base.name,
+				(unsigned long long)(results[i].stat.reads + results[i].stat.writes), reads + writes);
+			regressions++;
+		}
+
+		if (((results[i].stat.rbytes + results[i].stat.wbytes) >> 10) * 100 > (rkib + wkib) * (100 + tol)) {
+			printf("REGRESSION %s: %llu KiB device traffic, baseline %llu KiB\n", base.name,
+				(unsigned long long)((results[i].stat.rbytes + results[i].stat.wbytes) >> 10), rkib + wkib);
+			regressions++;
+		}
+	}
+	fclose(f);
+
+	return regressions;
+}
+
+
+static void bench_help(const char *prog)
+{
+	unsigned int i;
+
+	printf("Usage: %s [options] image [workload...]\n", prog);
+	printf("       %s -m\n", prog);
+	printf("Runs workloads on ext2 image (created with mke2fs) and reports throughput, latency and device traffic\n");
+	printf("Options:\n");
+	printf("  -r            keep image in RAM (changes aren't written back to the image file)\n");
+	printf("  -o options    mount options (e.g. \"cache=1024,delalloc=0\")\n");
+	printf("  -d latency    simulated device read/write request latency in us (default 0)\n");
+	printf("  -n files      number of storm files (default %u)\n", BENCH_FILES);
+	printf("  -f size       storm file size in bytes (default %u)\n", BENCH_FILESZ);
+	printf("  -s size       I/O file size in KiB (default %u)\n", BENCH_SIZE >> 10);
+	printf("  -b size       sequential I/O request size in KiB (default %u)\n", BENCH_IOSZ >> 10);
+	printf("  -i requests   number of random I/O requests or lookups, per thread in multithreaded workloads (default %u)\n", BENCH_RANDN);
+	printf("  -t threads    number of multithreaded workloads threads (default %u)\n", BENCH_THREADS);
+	printf("  -c baseline   compare results with baseline (output of a previous run), exit with 2 on regression\n");
+	printf("  -T tolerance  regression tolerance in percent (default %u)\n", BENCH_TOL);
+	printf("  -m            run bitmap operations microbenchmark against bit-by-bit reference instead (no image is used)\n");
+	printf("Workloads (all by default, run in the order given):\n");
+	for (i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++)
+		printf("  %-10s    %s\n", workloads[i].name, workloads[i].descr);
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char *baseline = NULL;
+	bench_result_t *results;
+	unsigned int i, j, n, tol = BENCH_TOL;
+	unsigned int delay = 0;
+	int c, ram = 0, bmp = 0, ret = EXIT_SUCCESS;
+
+	bench.files = BENCH_FILES;
+	bench.filesz = BENCH_FILESZ;
+	bench.size = BENCH_SIZE;
+	bench.iosz = BENCH_IOSZ;
+	bench.randn = BENCH_RANDN;
+	bench.threads = BENCH_THREADS;
+	bench.seed = 2463534242U;
+
+	while ((c = getopt(argc, argv, "ro:d:n:f:s:b:i:t:c:T:mh")) != -1) {
+		switch (c) {
+			case 'r':
+				ram = 1;
+				break;
+
+			case 'o':
+				bench.opts = optarg;
+				break;
+
+			case 'd':
+				delay = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'n':
+				bench.files = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'f':
+				bench.filesz = strtoul(optarg, NULL, 0);
+				break;
+
+			case 's':
+				bench.size = strtoul(optarg, NULL, 0) << 10;
+				break;
+
+			case 'b':
+				bench.iosz = strtoul(optarg, NULL, 0) << 10;
+				break;
+
+			case 'i':
+				bench.randn = strtoul(optarg, NULL, 0);
+				break;
+
+			case 't':
+				bench.threads = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'c':
+				baseline = optarg;
+				break;
+
+			case 'T':
+				tol = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'm':
+				bmp = 1;
+				break;
+
+			case 'h':
+			default:
+				bench_help(argv[0]);
+				return (c == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (bmp)
+		return (bench_bmp() < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+
+	if (optind >= argc) {
+		bench_help(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if ((bench.iosz == 0) || (bench.size < bench.iosz) || (bench.size < BENCH_RANDSZ)) {
+		fprintf(stderr, "ext2-bench: I/O file size has to be at least the request size\n");
+		return EXIT_FAILURE;
+	}
+
+	if (bench.threads == 0) {
+		fprintf(stderr, "ext2-bench: multithreaded workloads need at least one thread\n");
+		return EXIT_FAILURE;
+	}
+
+	n = (optind + 1 < argc) ? argc - optind - 1 : sizeof(workloads) / sizeof(workloads[0]);
+	bench.szlat = 1024;
+	bench.lat = (uint64_t *)malloc(bench.szlat * sizeof(uint64_t));
+	bench.buff = (char *)malloc(max(max(bench.filesz, bench.iosz), BENCH_RANDSZ));
+	results = (bench_result_t *)malloc(n * sizeof(bench_result_t));
+
+	if ((bench.lat == NULL) || (bench.buff == NULL) || (results == NULL)) {
+		fprintf(stderr, "ext2-bench: out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	/* Written data mustn't be all zeros (zero blocks are left as holes) */
+	for (i = 0; i < max(max(bench.filesz, bench.iosz), BENCH_RANDSZ); i++)
+		bench.buff[i] = (char)bench_rand();
+
+	if ((c = bench_devOpen(&bench.dev, argv[optind], ram, delay)) < 0) {
+		fprintf(stderr, "ext2-bench: failed to open %s (%s)\n", argv[optind], strerror(-c));
+		return EXIT_FAILURE;
+	}
+
+	printf("# %-8s %8s %11s %9s %9s %9s %9s %8s %8s %10s %10s\n", "workload", "ops", "ops/s", "p50(us)", "p90(us)", "p99(us)", "max(us)",
+		"dreads", "dwrites", "dread(KiB)", "dwrite(KiB)");
+
+	for (i = 0; i < n; i++) {
+		if (optind + 1 < argc) {
+			for (j = 0; (j < sizeof(workloads) / sizeof(workloads[0])) && strcmp(workloads[j].name, argv[optind + 1 + i]); j++)
+				;
+
+			if (j == sizeof(workloads) / sizeof(workloads[0])) {
+				fprintf(stderr, "ext2-bench: unknown workload %s\n", argv[optind + 1 + i]);
+				ret = EXIT_FAILURE;
+				break;
+			}
+		}
+		else {
+			j = i;
+		}
+
+		if (bench_run(workloads + j, results + i) < 0) {
+			ret = EXIT_FAILURE;
+			break;
+		}
+		bench_print(stdout, results + i);
+	}
+
+	if ((ret == EXIT_SUCCESS) && (baseline != NULL)) {
+		if ((c = bench_compare(baseline, results, n, tol)) < 0)
+			ret = EXIT_FAILURE;
+		else if (c > 0)
+			ret = 2;
+	}
+
+	bench_devClose(&bench.dev);
+	free(results);
+	free(bench.buff);
+	free(bench.lat);
+
+	return ret;
+}
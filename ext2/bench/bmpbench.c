@@ -0,0 +1,261 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Host benchmark - bitmap scans microbenchmark
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../bmp.h"
+#include "bmpbench.h"
+
+
+#define BMP_BITS   (32 << 13) /* Number of bits in a 32 KiB bitmap */
+#define BMP_WORDS  (BMP_BITS / 64)
+#define BMP_REPS   200        /* Number of measured repetitions of each operation */
+#define BMP_FILLSZ 30000      /* Number of bits set and cleared by the fill operation */
+
+
+/* Measured operation */
+typedef struct {
+	const char *name;                /* Operation name */
+	const char *descr;               /* Operation description */
+	uint32_t (*ref)(uint64_t *data); /* Bit-by-bit reference implementation */
+	uint32_t (*run)(uint64_t *data); /* Word scanning implementation (ext2 bitmap functions) */
+	void (*init)(uint64_t *data);    /* Prepares bitmap contents */
+} bench_bmpop_t;
+
+
+static int bench_bmpBit(const uint64_t *data, uint32_t pos)
+{
+	return (data[pos / 64] >> (pos % 64)) & 1;
+}
+
+
+static void bench_bmpSetBit(uint64_t *data, uint32_t pos, int set)
+{
+	if (set)
+		data[pos / 64] |= 1ULL << (pos % 64);
+	else
+		data[pos / 64] &= ~(1ULL << (pos % 64));
+}
+
+
+/* Bit-by-bit search for first run of at least n clear bits, returns its length (0 if there is none) */
+static uint32_t bench_bmpRefRun(const uint64_t *data, uint32_t n, uint32_t *start)
+{
+	uint32_t pos, len = 0;
+
+	for (pos = 0; pos < BMP_BITS; pos++) {
+		if (bench_bmpBit(data, pos)) {
+			if (len >= n)
+				break;
+			len = 0;
+		}
+		else {
+			len++;
+		}
+	}
+
+	if (len < n)
+		return 0;
+
+	*start = pos - len;
+
+	return len;
+}
+
+
+/* Fully allocated bitmap with the last bit clear */
+static void bench_bmpFull(uint64_t *data)
+{
+	memset(data, 0xff, BMP_WORDS * sizeof(uint64_t));
+	bench_bmpSetBit(data, BMP_BITS - 1, 0);
+}
+
+
+/* 70% allocated bitmap with short random free runs, long free runs are only near its end */
+static void bench_bmpFragmented(uint64_t *data)
+{
+	uint32_t pos, len, seed = 2463534242U;
+	int set = 1;
+
+	memset(data, 0, BMP_WORDS * sizeof(uint64_t));
+
+	for (pos = 0; pos < BMP_BITS; pos += len, set = !set) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+
+		/* Used runs average 70 bits, free ones 30 bits */
+		len = 1 + seed % ((set) ? 139 : 59);
+		if (len > BMP_BITS - pos)
+			len = BMP_BITS - pos;
+
+		if (set)
+			ext2_bmp_fill(data, pos, len, 1);
+	}
+
+	ext2_bmp_fill(data, BMP_BITS - 8192, 8192, 1);
+	ext2_bmp_fill(data, BMP_BITS - 7000, 600, 0);
+	ext2_bmp_fill(data, BMP_BITS - 4000, 2100, 0);
+}
+
+
+static void bench_bmpEmpty(uint64_t *data)
+{
+	memset(data, 0, BMP_WORDS * sizeof(uint64_t));
+}
+
+
+static uint32_t bench_bmpRefFindzero(uint64_t *data)
+{
+	uint32_t pos;
+
+	for (pos = 0; (pos < BMP_BITS) && bench_bmpBit(data, pos); pos++)
+		;
+
+	return pos;
+}
+
+
+static uint32_t bench_bmpFindzero(uint64_t *data)
+{
+	return ext2_bmp_findzero(data, BMP_BITS, 0);
+}
+
+
+static uint32_t bench_bmpRefRun512(uint64_t *data)
+{
+	uint32_t start = 0;
+
+	return bench_bmpRefRun(data, 512, &start) + start;
+}
+
+
+static uint32_t bench_bmpRefRun2048(uint64_t *data)
+{
+	uint32_t start = 0;
+
+	return bench_bmpRefRun(data, 2048, &start) + start;
+}
+
+
+static uint32_t bench_bmpRun(uint64_t *data, uint32_t n)
+{
+	ext2_bmp_t bmp = { .data = data, .size = BMP_BITS, .first = 0 };
+	uint32_t start = 0;
+
+	return ext2_bmp_findrun(&bmp, 0, n, &start) + start;
+}
+
+
+static uint32_t bench_bmpRun512(uint64_t *data)
+{
+	return bench_bmpRun(data, 512);
+}
+
+
+static uint32_t bench_bmpRun2048(uint64_t *data)
+{
+	return bench_bmpRun(data, 2048);
+}
+
+
+/* Sets and clears a range of bits, returns number of bits set in between */
+static uint32_t bench_bmpRefFill(uint64_t *data)
+{
+	uint32_t i, n = 0;
+
+	for (i = 0; i < BMP_FILLSZ; i++)
+		bench_bmpSetBit(data, 13 + i, 1);
+	n = bench_bmpBit(data, 13) + bench_bmpBit(data, 12 + BMP_FILLSZ);
+
+	for (i = 0; i < BMP_FILLSZ; i++)
+		bench_bmpSetBit(data, 13 + i, 0);
+
+	return n;
+}
+
+
+static uint32_t bench_bmpFill(uint64_t *data)
+{
+	uint32_t n;
+
+	ext2_bmp_fill(data, 13, BMP_FILLSZ, 1);
+	n = bench_bmpBit(data, 13) + bench_bmpBit(data, 12 + BMP_FILLSZ);
+	ext2_bmp_fill(data, 13, BMP_FILLSZ, 0);
+
+	return n;
+}
+
+
+static const bench_bmpop_t ops[] = {
+	{ "findzero", "first clear bit of a full bitmap", bench_bmpRefFindzero, bench_bmpFindzero, bench_bmpFull },
+	{ "findrun512", "run of 512 clear bits in a 70% used bitmap", bench_bmpRefRun512, bench_bmpRun512, bench_bmpFragmented },
+	{ "findrun2048", "run of 2048 clear bits in a 70% used bitmap", bench_bmpRefRun2048, bench_bmpRun2048, bench_bmpFragmented },
+	{ "fill", "set and clear 30000 bits", bench_bmpRefFill, bench_bmpFill, bench_bmpEmpty }
+};
+
+
+/* Returns average operation time (us) */
+static double bench_bmpTime(uint32_t (*op)(uint64_t *), uint64_t *data, uint32_t *res)
+{
+	/* Called through volatile pointer, so repeated calls of a read only scan aren't optimized out */
+	uint32_t (*volatile fn)(uint64_t *) = op;
+	struct timespec start, end;
+	unsigned int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < BMP_REPS; i++)
+		*res = fn(data);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 1e3 / BMP_REPS;
+}
+
+
+int bench_bmp(void)
+{
+	uint32_t ref, res;
+	double tref, tres;
+	unsigned int i;
+	uint64_t *data;
+	int err = EOK;
+
+	if ((data = (uint64_t *)malloc(BMP_WORDS * sizeof(uint64_t))) == NULL)
+		return -ENOMEM;
+
+	printf("# %-11s %9s %9s %8s  %s\n", "bitmap op", "ref(us)", "word(us)", "speedup", "description");
+
+	for (i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+		ops[i].init(data);
+		tref = bench_bmpTime(ops[i].ref, data, &ref);
+		tres = bench_bmpTime(ops[i].run, data, &res);
+
+		/* Both implementations have to agree */
+		if (ref != res) {
+			fprintf(stderr, "ext2-bench: %s: result %u, reference %u\n", ops[i].name, res, ref);
+			err = -EIO;
+			break;
+		}
+
+		printf("%-13s %9.2f %9.2f %7.1fx  %s\n", ops[i].name, tref, tres, (tres > 0) ? tref / tres : 0, ops[i].descr);
+	}
+	free(data);
+
+	return err;
+}
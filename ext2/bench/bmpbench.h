@@ -0,0 +1,23 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Host benchmark - bitmap scans microbenchmark
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _BENCH_BMPBENCH_H_
+#define _BENCH_BMPBENCH_H_
+
+
+/* Runs bitmap operations on 32 KiB bitmaps and compares them with bit-by-bit reference implementation */
+extern int bench_bmp(void);
+
+
+#endif
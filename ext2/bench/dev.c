@@ -0,0 +1,177 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Host benchmark - file or RAM backed block device
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/threads.h>
+
+#include "dev.h"
+
+
+static ssize_t bench_devRead(storage_t *strg, off_t start, void *data, size_t size)
+{
+	bench_dev_t *dev = (bench_dev_t *)strg;
+	ssize_t ret;
+
+	if ((start < 0) || (start > strg->size) || (size > strg->size - start))
+		return -EINVAL;
+
+	if (dev->data != NULL) {
+		memcpy(data, dev->data + start, size);
+		ret = size;
+	}
+	else if ((ret = pread(dev->fd, data, size, start)) < 0) {
+		return -errno;
+	}
+
+	/* Requests of different threads wait in parallel (like on a device with a command queue) */
+	if (dev->delay)
+		usleep(dev->delay);
+
+	mutexLock(dev->lock);
+	dev->stat.reads++;
+	dev->stat.rbytes += ret;
+	mutexUnlock(dev->lock);
+
+	return ret;
+}
+
+
+static ssize_t bench_devWrite(storage_t *strg, off_t start, const void *data, size_t size)
+{
+	bench_dev_t *dev = (bench_dev_t *)strg;
+	ssize_t ret;
+
+	if ((start < 0) || (start > strg->size) || (size > strg->size - start))
+		return -EINVAL;
+
+	if (dev->data != NULL) {
+		memcpy(dev->data + start, data, size);
+		ret = size;
+	}
+	else if ((ret = pwrite(dev->fd, data, size, start)) < 0) {
+		return -errno;
+	}
+
+	if (dev->delay)
+		usleep(dev->delay);
+
+	mutexLock(dev->lock);
+	dev->stat.writes++;
+	dev->stat.wbytes += ret;
+	mutexUnlock(dev->lock);
+
+	return ret;
+}
+
+
+/* Host cache isn't flushed, device latency is not what's measured */
+static int bench_devSync(storage_t *strg)
+{
+	bench_dev_t *dev = (bench_dev_t *)strg;
+
+	mutexLock(dev->lock);
+	dev->stat.syncs++;
+	mutexUnlock(dev->lock);
+
+	return EOK;
+}
+
+
+/* Discarded blocks content is undefined, so it's left as is */
+static int bench_devErase(storage_t *strg, off_t start, size_t size)
+{
+	bench_dev_t *dev = (bench_dev_t *)strg;
+
+	if ((start < 0) || (start > strg->size) || (size > strg->size - start))
+		return -EINVAL;
+
+	mutexLock(dev->lock);
+	dev->stat.discards++;
+	mutexUnlock(dev->lock);
+
+	return EOK;
+}
+
+
+static const storage_blkops_t bench_devOps = {
+	.read = bench_devRead,
+	.write = bench_devWrite,
+	.sync = bench_devSync,
+	.erase = bench_devErase
+};
+
+
+int bench_devOpen(bench_dev_t *dev, const char *path, int ram, unsigned int delay)
+{
+	struct stat st;
+	ssize_t ret;
+	size_t len;
+	int err;
+
+	memset(dev, 0, sizeof(*dev));
+
+	if ((dev->fd = open(path, O_RDWR)) < 0)
+		return -errno;
+
+	if (fstat(dev->fd, &st) < 0) {
+		err = -errno;
+		close(dev->fd);
+		return err;
+	}
+
+	if (ram) {
+		if ((dev->data = (char *)malloc(st.st_size)) == NULL) {
+			close(dev->fd);
+			return -ENOMEM;
+		}
+
+		for (len = 0; len < st.st_size; len += ret) {
+			if ((ret = pread(dev->fd, dev->data + len, st.st_size - len, len)) <= 0) {
+				err = (ret < 0) ? -errno : -EIO;
+				free(dev->data);
+				close(dev->fd);
+				return err;
+			}
+		}
+	}
+
+	if ((err = mutexCreate(&dev->lock)) < 0) {
+		free(dev->data);
+		close(dev->fd);
+		return err;
+	}
+
+	dev->delay = delay;
+	dev->blk.ops = &bench_devOps;
+	dev->dev.blk = &dev->blk;
+	dev->strg.start = 0;
+	dev->strg.size = st.st_size;
+	dev->strg.dev = &dev->dev;
+
+	return EOK;
+}
+
+
+void bench_devClose(bench_dev_t *dev)
+{
+	resourceDestroy(dev->lock);
+	free(dev->data);
+	close(dev->fd);
+}
@@ -0,0 +1,55 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Host benchmark - file or RAM backed block device
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _BENCH_DEV_H_
+#define _BENCH_DEV_H_
+
+#include <stdint.h>
+
+#include <storage/storage.h>
+#include <sys/types.h>
+
+
+/* Device access counters */
+typedef struct {
+	uint64_t reads;    /* Number of read requests */
+	uint64_t writes;   /* Number of write requests */
+	uint64_t rbytes;   /* Number of bytes read */
+	uint64_t wbytes;   /* Number of bytes written */
+	uint64_t syncs;    /* Number of sync requests */
+	uint64_t discards; /* Number of discard requests */
+} bench_devstat_t;
+
+
+typedef struct {
+	storage_t strg;        /* libstorage device (must be first) */
+	storage_dev_t dev;     /* libstorage device data */
+	storage_blk_t blk;     /* libstorage block device */
+	int fd;                /* Image file descriptor */
+	char *data;            /* Image data (RAM backed device only) */
+	unsigned int delay;    /* Simulated read/write request latency (us) */
+	bench_devstat_t stat;  /* Access counters */
+	handle_t lock;         /* Access counters mutex (device is accessed by workload threads and the flusher) */
+} bench_dev_t;
+
+
+/* Opens device backed by the image file (or by its copy in RAM), each read/write request takes at least delay us */
+extern int bench_devOpen(bench_dev_t *dev, const char *path, int ram, unsigned int delay);
+
+
+/* Closes device (RAM backed device contents are dropped) */
+extern void bench_devClose(bench_dev_t *dev);
+
+
+#endif
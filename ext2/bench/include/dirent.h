@@ -0,0 +1,35 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Host benchmark - Phoenix-RTOS directory entries
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _BENCH_DIRENT_H_
+#define _BENCH_DIRENT_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+
+/* Directory entry types */
+enum { DT_UNKNOWN = 0, DT_FIFO = 1, DT_CHR = 2, DT_DIR = 4, DT_BLK = 6, DT_REG = 8, DT_LNK = 10, DT_SOCK = 12 };
+
+
+struct dirent {
+	uint64_t d_ino;
+	unsigned char d_type;
+	uint16_t d_reclen;
+	uint16_t d_namlen;
+	char d_name[];
+};
+
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Host benchmark - Phoenix-RTOS object attributes
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _BENCH_PHOENIX_ATTRIBUTE_H_
+#define _BENCH_PHOENIX_ATTRIBUTE_H_
+
+#include <sys/msg.h>
+
+
+struct _attrAll_val {
+	long long val;
+	int err;
+};
+
+
+struct _attrAll {
+	struct _attrAll_val mode;
+	struct _attrAll_val uid;
+	struct _attrAll_val gid;
+	struct _attrAll_val size;
+	struct _attrAll_val blocks;
+	struct _attrAll_val ioblock;
+	struct _attrAll_val type;
+	struct _attrAll_val port;
+	struct _attrAll_val pollStatus;
+	struct _attrAll_val eventMask;
+	struct _attrAll_val cTime;
+	struct _attrAll_val mTime;
+	struct _attrAll_val aTime;
+	struct _attrAll_val links;
+	struct _attrAll_val dev;
+};
+
+
+static inline void _phoenix_initAttrsStruct(struct _attrAll *attrs, int err)
+{
+	struct _attrAll_val *vals = (struct _attrAll_val *)attrs;
+	size_t i;
+
+	for (i = 0; i < sizeof(*attrs) / sizeof(*vals); i++) {
+		vals[i].val = 0;
+		vals[i].err = err;
+	}
+}
+
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Host benchmark - libstorage block device and filesystem interface
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _BENCH_STORAGE_H_
+#define _BENCH_STORAGE_H_
+
+#include <sys/msg.h>
+#include <sys/types.h>
+#include <phoenix/attribute.h>
+
+
+struct dirent;
+struct _storage_t;
+
+
+/* Block device operations */
+typedef struct {
+	ssize_t (*read)(struct _storage_t *strg, off_t start, void *data, size_t size);
+	ssize_t (*write)(struct _storage_t *strg, off_t start, const void *data, size_t size);
+	int (*sync)(struct _storage_t *strg);
+	int (*erase)(struct _storage_t *strg, off_t start, size_t size);
+} storage_blkops_t;
+
+
+typedef struct {
+	const storage_blkops_t *ops;
+} storage_blk_t;
+
+
+typedef struct {
+	storage_blk_t *blk;
+} storage_dev_t;
+
+
+typedef struct _storage_t {
+	off_t start;
+	size_t size;
+	storage_dev_t *dev;
+} storage_t;
+
+
+/* Filesystem operations */
+typedef struct {
+	int (*open)(void *info, oid_t *oid);
+	int (*close)(void *info, oid_t *oid);
+	ssize_t (*read)(void *info, oid_t *oid, off_t offs, void *data, size_t len);
+	ssize_t (*write)(void *info, oid_t *oid, off_t offs, const void *data, size_t len);
+	int (*setattr)(void *info, oid_t *oid, int type, long long attr, const void *data, size_t len);
+	int (*getattr)(void *info, oid_t *oid, int type, long long *attr);
+	int (*getattrall)(void *info, oid_t *oid, struct _attrAll *attrs);
+	int (*truncate)(void *info, oid_t *oid, size_t size);
+	int (*devctl)(void *info, oid_t *oid, const void *in, void *out);
+	int (*create)(void *info, oid_t *dir, const char *name, oid_t *oid, unsigned mode, int type, oid_t *dev);
+	int (*destroy)(void *info, oid_t *oid);
+	int (*lookup)(void *info, oid_t *oid, const char *name, oid_t *res, oid_t *dev, char *lnk, int lnksz);
+	int (*link)(void *info, oid_t *dir, const char *name, oid_t *oid);
+	int (*unlink)(void *info, oid_t *dir, const char *name);
+	int (*readdir)(void *info, oid_t *oid, off_t offs, struct dirent *dent, size_t size);
+	int (*statfs)(void *info, void *buf, size_t len);
+	int (*sync)(void *info, oid_t *oid);
+} storage_fsops_t;
+
+
+typedef struct {
+	void *info;
+	const storage_fsops_t *ops;
+} storage_fs_t;
+
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Host benchmark - Phoenix-RTOS circular lists
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _BENCH_SYS_LIST_H_
+#define _BENCH_SYS_LIST_H_
+
+#include <stddef.h>
+
+
+#define LIST_ADD_EX(list, t, next, prev) \
+	do { \
+		if ((t) == NULL) \
+			break; \
+		if (*(list) == NULL) { \
+			(t)->next = (t); \
+			(t)->prev = (t); \
+			(*(list)) = (t); \
+		} \
+		else { \
+			(t)->prev = (*(list))->prev; \
+			(*(list))->prev->next = (t); \
+			(t)->next = (*(list)); \
+			(*(list))->prev = (t); \
+		} \
+	} while (0)
+
+
+#define LIST_REMOVE_EX(list, t, next, prev) \
+	do { \
+		if ((t) == NULL) \
+			break; \
+		if (((t)->next == (t)) && ((t)->prev == (t))) \
+			(*(list)) = NULL; \
+		else { \
+			(t)->prev->next = (t)->next; \
+			(t)->next->prev = (t)->prev; \
+			if ((t) == (*(list))) \
+				(*(list)) = (t)->next; \
+		} \
+		(t)->next = NULL; \
+		(t)->prev = NULL; \
+	} while (0)
+
+
+#define LIST_ADD(list, t)    LIST_ADD_EX(list, t, next, prev)
+#define LIST_REMOVE(list, t) LIST_REMOVE_EX(list, t, next, prev)
+
+
+#endif
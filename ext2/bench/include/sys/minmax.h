@@ -0,0 +1,33 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Host benchmark - Phoenix-RTOS min/max macros
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _BENCH_SYS_MINMAX_H_
+#define _BENCH_SYS_MINMAX_H_
+
+
+#define min(a, b) ({ \
+	__typeof__(a) _a = (a); \
+	__typeof__(b) _b = (b); \
+	(_a > _b) ? _b : _a; \
+})
+
+
+#define max(a, b) ({ \
+	__typeof__(a) _a = (a); \
+	__typeof__(b) _b = (b); \
+	(_a > _b) ? _a : _b; \
+})
+
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Host benchmark - Phoenix-RTOS messages
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _BENCH_SYS_MSG_H_
+#define _BENCH_SYS_MSG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+
+typedef struct {
+	uint32_t port;
+	id_t id;
+} oid_t;
+
+
+/* Message types */
+enum { mtOpen = 0, mtClose, mtRead, mtWrite, mtTruncate, mtDevCtl, mtCreate, mtDestroy, mtSetAttr, mtGetAttr, mtGetAttrAll,
+	mtLookup, mtLink, mtUnlink, mtReaddir, mtStat, mtSync, mtCount };
+
+
+/* Object types */
+enum { otDir = 0, otFile, otDev, otSymlink, otUnknown };
+
+
+/* Attribute types */
+enum { atMode = 0, atUid, atGid, atSize, atBlocks, atIOBlock, atType, atPort, atPollStatus, atEventMask, atCTime, atMTime,
+	atATime, atLinks, atDev };
+
+
+typedef struct {
+	int type;
+	oid_t oid;
+
+	struct {
+		union {
+			struct {
+				off_t offs;
+				size_t len;
+				unsigned mode;
+			} io;
+			struct {
+				int type;
+				oid_t dev;
+				unsigned mode;
+			} create;
+			struct {
+				int type;
+				long long val;
+			} attr;
+			struct {
+				oid_t oid;
+			} ln;
+			struct {
+				off_t offs;
+			} readdir;
+			unsigned char raw[64];
+		};
+		size_t size;
+		const void *data;
+	} i;
+
+	struct {
+		int err;
+		union {
+			struct {
+				oid_t oid;
+			} create;
+			struct {
+				oid_t fil;
+				oid_t dev;
+			} lookup;
+			struct {
+				long long val;
+			} attr;
+			unsigned char raw[64];
+		};
+		size_t size;
+		void *data;
+	} o;
+} msg_t;
+
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Host benchmark - Phoenix-RTOS red-black tree
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _BENCH_SYS_RB_H_
+#define _BENCH_SYS_RB_H_
+
+#include <stddef.h>
+
+
+typedef struct _rbnode_t {
+	struct _rbnode_t *left;
+	struct _rbnode_t *right;
+	struct _rbnode_t *parent;
+	unsigned char color;
+} rbnode_t;
+
+
+typedef int (*rbcomp_t)(rbnode_t *n1, rbnode_t *n2);
+
+
+typedef void (*rbaugment_t)(rbnode_t *node);
+
+
+typedef struct {
+	rbnode_t *root;
+	rbcomp_t compare;
+} rbtree_t;
+
+
+#define lib_treeof(type, node_field, node) ({ \
+	rbnode_t *_node = (node); \
+	(_node == NULL) ? NULL : (type *)((char *)_node - offsetof(type, node_field)); \
+})
+
+
+/* Initializes tree (augmentation isn't supported) */
+extern void lib_rbInit(rbtree_t *tree, rbcomp_t compare, rbaugment_t augment);
+
+
+extern int lib_rbInsert(rbtree_t *tree, rbnode_t *node);
+
+
+extern void lib_rbRemove(rbtree_t *tree, rbnode_t *node);
+
+
+extern rbnode_t *lib_rbFind(rbtree_t *tree, rbnode_t *node);
+
+
+extern rbnode_t *lib_rbMinimum(rbnode_t *node);
+
+
+extern rbnode_t *lib_rbNext(rbnode_t *node);
+
+
+#endif
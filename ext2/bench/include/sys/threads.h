@@ -0,0 +1,66 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Host benchmark - Phoenix-RTOS threads on top of POSIX threads
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _BENCH_SYS_THREADS_H_
+#define _BENCH_SYS_THREADS_H_
+
+#include <time.h>
+#include <sys/types.h>
+
+
+extern int mutexCreate(handle_t *h);
+
+
+extern int mutexLock(handle_t h);
+
+
+extern int mutexTry(handle_t h);
+
+
+extern int mutexUnlock(handle_t h);
+
+
+extern int condCreate(handle_t *h);
+
+
+/* Waits for the condition (timeout in microseconds, 0 waits forever) */
+extern int condWait(handle_t h, handle_t m, time_t timeout);
+
+
+extern int condSignal(handle_t h);
+
+
+extern int condBroadcast(handle_t h);
+
+
+extern int resourceDestroy(handle_t h);
+
+
+/* Starts a thread (priority and stack are ignored) */
+extern int beginthreadex(void (*start)(void *), unsigned int priority, void *stack, unsigned int stacksz, void *arg, handle_t *id);
+
+
+static inline int beginthread(void (*start)(void *), unsigned int priority, void *stack, unsigned int stacksz, void *arg)
+{
+	return beginthreadex(start, priority, stack, stacksz, arg, NULL);
+}
+
+
+extern int threadJoin(int tid, time_t timeout);
+
+
+extern void endthread(void);
+
+
+#endif
@@ -0,0 +1,26 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Host benchmark - Phoenix-RTOS types on the host
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _BENCH_SYS_TYPES_H_
+#define _BENCH_SYS_TYPES_H_
+
+#include_next <sys/types.h>
+
+#include <stdint.h>
+
+
+typedef uintptr_t handle_t;
+
+
+#endif
@@ -0,0 +1,487 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Host benchmark - Phoenix-RTOS API on the host
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <sys/rb.h>
+#include <sys/threads.h>
+
+
+/* Max number of threads started (and not joined) at once */
+#define MAX_THREADS 64
+
+
+/* Synchronization resource */
+typedef struct {
+	enum { RES_MUTEX, RES_COND } type;
+	union {
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+	};
+} res_t;
+
+
+/* Thread start arguments */
+typedef struct {
+	void (*start)(void *);
+	void *arg;
+} thread_t;
+
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_t tids[MAX_THREADS];
+	unsigned char used[MAX_THREADS];
+} threads = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+
+int mutexCreate(handle_t *h)
+{
+	res_t *res;
+
+	if ((res = (res_t *)malloc(sizeof(res_t))) == NULL)
+		return -ENOMEM;
+
+	res->type = RES_MUTEX;
+	pthread_mutex_init(&res->mutex, NULL);
+	*h = (handle_t)res;
+
+	return EOK;
+}
+
+
+int mutexLock(handle_t h)
+{
+	return -pthread_mutex_lock(&((res_t *)h)->mutex);
+}
+
+
+int mutexTry(handle_t h)
+{
+	return (pthread_mutex_trylock(&((res_t *)h)->mutex) != 0) ? -EBUSY : EOK;
+}
+
+
+int mutexUnlock(handle_t h)
+{
+	return -pthread_mutex_unlock(&((res_t *)h)->mutex);
+}
+
+
+int condCreate(handle_t *h)
+{
+	res_t *res;
+
+	if ((res = (res_t *)malloc(sizeof(res_t))) == NULL)
+		return -ENOMEM;
+
+	res->type = RES_COND;
+	pthread_cond_init(&res->cond, NULL);
+	*h = (handle_t)res;
+
+	return EOK;
+}
+
+
+int condWait(handle_t h, handle_t m, time_t timeout)
+{
+	struct timespec ts;
+
+	if (timeout == 0)
+		return -pthread_cond_wait(&((res_t *)h)->cond, &((res_t *)m)->mutex);
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeout / 1000000;
+	ts.tv_nsec += (timeout % 1000000) * 1000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	return (pthread_cond_timedwait(&((res_t *)h)->cond, &((res_t *)m)->mutex, &ts) != 0) ? -ETIME : EOK;
+}
+
+
+int condSignal(handle_t h)
+{
+	return -pthread_cond_signal(&((res_t *)h)->cond);
+}
+
+
+int condBroadcast(handle_t h)
+{
+	return -pthread_cond_broadcast(&((res_t *)h)->cond);
+}
+
+
+int resourceDestroy(handle_t h)
+{
+	res_t *res = (res_t *)h;
+
+	if (res->type == RES_MUTEX)
+		pthread_mutex_destroy(&res->mutex);
+	else
+		pthread_cond_destroy(&res->cond);
+	free(res);
+
+	return EOK;
+}
+
+
+static void *phoenix_thread(void *arg)
+{
+	thread_t thread = *(thread_t *)arg;
+
+	free(arg);
+	thread.start(thread.arg);
+
+	return NULL;
+}
+
+
+int beginthreadex(void (*start)(void *), unsigned int priority, void *stack, unsigned int stacksz, void *arg, handle_t *id)
+{
+	thread_t *thread;
+	int i;
+
+	if ((thread = (thread_t *)malloc(sizeof(thread_t))) == NULL)
+		return -ENOMEM;
+
+	thread->start = start;
+	thread->arg = arg;
+
+	pthread_mutex_lock(&threads.lock);
+
+	for (i = 0; (i < MAX_THREADS) && threads.used[i]; i++)
+		;
+
+	if ((i == MAX_THREADS) || (pthread_create(&threads.tids[i], NULL, phoenix_thread, thread) != 0)) {
+		pthread_mutex_unlock(&threads.lock);
+		free(thread);
+		return -ENOMEM;
+	}
+	threads.used[i] = 1;
+
+	pthread_mutex_unlock(&threads.lock);
+
+	if (id != NULL)
+		*id = i;
+
+	return EOK;
+}
+
+
+int threadJoin(int tid, time_t timeout)
+{
+	pthread_t thread;
+
+	if ((tid < 0) || (tid >= MAX_THREADS))
+		return -EINVAL;
+
+	pthread_mutex_lock(&threads.lock);
+	thread = threads.tids[tid];
+	pthread_mutex_unlock(&threads.lock);
+
+	if (pthread_join(thread, NULL) != 0)
+		return -EINVAL;
+
+	pthread_mutex_lock(&threads.lock);
+	threads.used[tid] = 0;
+	pthread_mutex_unlock(&threads.lock);
+
+	return tid;
+}
+
+
+void endthread(void)
+{
+	pthread_exit(NULL);
+}
+
+
+/* Red-black tree node colors */
+enum { RB_RED, RB_BLACK };
+
+
+static void lib_rbRotateLeft(rbtree_t *tree, rbnode_t *x)
+{
+	rbnode_t *y = x->right;
+
+	if ((x->right = y->left) != NULL)
+		y->left->parent = x;
+
+	if ((y->parent = x->parent) == NULL)
+		tree->root = y;
+	else if (x == x->parent->left)
+		x->parent->left = y;
+	else
+		x->parent->right = y;
+
+	y->left = x;
+	x->parent = y;
+}
+
+
+static void lib_rbRotateRight(rbtree_t *tree, rbnode_t *x)
+{
+	rbnode_t *y = x->left;
+
+	if ((x->left = y->right) != NULL)
+		y->right->parent = x;
+
+	if ((y->parent = x->parent) == NULL)
+		tree->root = y;
+	else if (x == x->parent->right)
+		x->parent->right = y;
+	else
+		x->parent->left = y;
+
+	y->right = x;
+	x->parent = y;
+}
+
+
+static int lib_rbBlack(rbnode_t *node)
+{
+	return (node == NULL) || (node->color == RB_BLACK);
+}
+
+
+void lib_rbInit(rbtree_t *tree, rbcomp_t compare, rbaugment_t augment)
+{
+	tree->root = NULL;
+	tree->compare = compare;
+}
+
+
+int lib_rbInsert(rbtree_t *tree, rbnode_t *node)
+{
+	rbnode_t **link = &tree->root, *parent = NULL, *uncle;
+	int cmp;
+
+	while (*link != NULL) {
+		parent = *link;
+
+		if ((cmp = tree->compare(node, parent)) == 0)
+			return -EEXIST;
+
+		link = (cmp < 0) ? &parent->left : &parent->right;
+	}
+
+	node->left = node->right = NULL;
+	node->parent = parent;
+	node->color = RB_RED;
+	*link = node;
+
+	while (((parent = node->parent) != NULL) && (parent->color == RB_RED)) {
+		if (parent == parent->parent->left) {
+			if (!lib_rbBlack(uncle = parent->parent->right)) {
+				parent->color = uncle->color = RB_BLACK;
+				parent->parent->color = RB_RED;
+				node = parent->parent;
+				continue;
+			}
+
+			if (node == parent->right) {
+				lib_rbRotateLeft(tree, parent);
+				node = parent;
+				parent = node->parent;
+			}
+
+			parent->color = RB_BLACK;
+			parent->parent->color = RB_RED;
+			lib_rbRotateRight(tree, parent->parent);
+		}
+		else {
+			if (!lib_rbBlack(uncle = parent->parent->left)) {
+				parent->color = uncle->color = RB_BLACK;
+				parent->parent->color = RB_RED;
+				node = parent->parent;
+				continue;
+			}
+
+			if (node == parent->left) {
+				lib_rbRotateRight(tree, parent);
+				node = parent;
+				parent = node->parent;
+			}
+
+			parent->color = RB_BLACK;
+			parent->parent->color = RB_RED;
+			lib_rbRotateLeft(tree, parent->parent);
+		}
+	}
+	tree->root->color = RB_BLACK;
+
+	return EOK;
+}
+
+
+/* Replaces subtree rooted at u with subtree rooted at v */
+static void lib_rbTransplant(rbtree_t *tree, rbnode_t *u, rbnode_t *v)
+{
+	if (u->parent == NULL)
+		tree->root = v;
+	else if (u == u->parent->left)
+		u->parent->left = v;
+	else
+		u->parent->right = v;
+
+	if (v != NULL)
+		v->parent = u->parent;
+}
+
+
+void lib_rbRemove(rbtree_t *tree, rbnode_t *node)
+{
+	rbnode_t *y = node, *x, *parent, *w;
+	unsigned char color = node->color;
+
+	if (node->left == NULL) {
+		x = node->right;
+		parent = node->parent;
+		lib_rbTransplant(tree, node, node->right);
+	}
+	else if (node->right == NULL) {
+		x = node->left;
+		parent = node->parent;
+		lib_rbTransplant(tree, node, node->left);
+	}
+	else {
+		y = lib_rbMinimum(node->right);
+		color = y->color;
+		x = y->right;
+
+		if (y->parent == node) {
+			parent = y;
+		}
+		else {
+			parent = y->parent;
+			lib_rbTransplant(tree, y, y->right);
+			y->right = node->right;
+			y->right->parent = y;
+		}
+
+		lib_rbTransplant(tree, node, y);
+		y->left = node->left;
+		y->left->parent = y;
+		y->color = node->color;
+	}
+
+	if (color == RB_RED)
+		return;
+
+	while ((x != tree->root) && lib_rbBlack(x)) {
+		if (x == parent->left) {
+			if ((w = parent->right)->color == RB_RED) {
+				w->color = RB_BLACK;
+				parent->color = RB_RED;
+				lib_rbRotateLeft(tree, parent);
+				w = parent->right;
+			}
+
+			if (lib_rbBlack(w->left) && lib_rbBlack(w->right)) {
+				w->color = RB_RED;
+				x = parent;
+				parent = x->parent;
+				continue;
+			}
+
+			if (lib_rbBlack(w->right)) {
+				w->left->color = RB_BLACK;
+				w->color = RB_RED;
+				lib_rbRotateRight(tree, w);
+				w = parent->right;
+			}
+
+			w->color = parent->color;
+			parent->color = RB_BLACK;
+			w->right->color = RB_BLACK;
+			lib_rbRotateLeft(tree, parent);
+		}
+		else {
+			if ((w = parent->left)->color == RB_RED) {
+				w->color = RB_BLACK;
+				parent->color = RB_RED;
+				lib_rbRotateRight(tree, parent);
+				w = parent->left;
+			}
+
+			if (lib_rbBlack(w->left) && lib_rbBlack(w->right)) {
+				w->color = RB_RED;
+				x = parent;
+				parent = x->parent;
+				continue;
+			}
+
+			if (lib_rbBlack(w->left)) {
+				w->right->color = RB_BLACK;
+				w->color = RB_RED;
+				lib_rbRotateLeft(tree, w);
+				w = parent->left;
+			}
+
+			w->color = parent->color;
+			parent->color = RB_BLACK;
+			w->left->color = RB_BLACK;
+			lib_rbRotateRight(tree, parent);
+		}
+		x = tree->root;
+	}
+
+	if (x != NULL)
+		x->color = RB_BLACK;
+}
+
+
+rbnode_t *lib_rbFind(rbtree_t *tree, rbnode_t *node)
+{
+	rbnode_t *it = tree->root;
+	int cmp;
+
+	while (it != NULL) {
+		if ((cmp = tree->compare(node, it)) == 0)
+			return it;
+
+		it = (cmp < 0) ? it->left : it->right;
+	}
+
+	return NULL;
+}
+
+
+rbnode_t *lib_rbMinimum(rbnode_t *node)
+{
+	if (node == NULL)
+		return NULL;
+
+	while (node->left != NULL)
+		node = node->left;
+
+	return node;
+}
+
+
+rbnode_t *lib_rbNext(rbnode_t *node)
+{
+	if (node->right != NULL)
+		return lib_rbMinimum(node->right);
+
+	while ((node->parent != NULL) && (node == node->parent->right))
+		node = node->parent;
+
+	return node->parent;
+}
@@ -17,11 +17,18 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <sys/minmax.h>
+#include <sys/stat.h>
+#include <sys/threads.h>
+
 #include "block.h"
+#include "bmp.h"
+#include "cache.h"
+#include "extent.h"
 #include "inode.h"
 
 
-int ext2_block_read(ext2_t *fs, uint32_t bno, void *buff, uint32_t n)
+int ext2_dev_read(ext2_t *fs, uint32_t bno, void *buff, uint32_t n)
 {
 	ssize_t size = n * fs->blocksz;
 	if (fs->strg != NULL) {
@@ -42,7 +49,7 @@ int ext2_block_read(ext2_t *fs, uint32_t bno, void *buff, uint32_t n)
 }
 
 
-int ext2_block_write(ext2_t *fs, uint32_t bno, const void *buff, uint32_t n)
+int ext2_dev_write(ext2_t *fs, uint32_t bno, const void *buff, uint32_t n)
 {
 	ssize_t size = n * fs->blocksz;
 	if (fs->strg != NULL) {
@@ -63,236 +70,186 @@ int ext2_block_write(ext2_t *fs, uint32_t bno, const void *buff, uint32_t n)
 }
 
 
-int ext2_block_destroy(ext2_t *fs, uint32_t bno, uint32_t n)
+int ext2_dev_discard(ext2_t *fs, uint32_t bno, uint32_t n)
 {
-	uint32_t group = (bno - 1) / fs->sb->groupBlocks;
-	uint32_t i, j, pgroup = group, offset = 0;
-	void *bmp;
-	int err;
+	if ((fs->strg == NULL) || (fs->strg->dev->blk->ops->erase == NULL))
+		return -ENOSYS;
 
-	if ((bmp = malloc(fs->blocksz)) == NULL)
-		return -ENOMEM;
+	return fs->strg->dev->blk->ops->erase(fs->strg, fs->strg->start + (off_t)bno * fs->blocksz, (size_t)n * fs->blocksz);
+}
 
-	if ((err = ext2_block_read(fs, fs->gdt[group].blockBmp, bmp, 1)) < 0) {
-		free(bmp);
-		return err;
-	}
 
-	for (i = 0, j = 0; i < n; i++, j++) {
-		group = (bno + i - 1) / fs->sb->groupBlocks;
-		offset = (bno + i - 1) % fs->sb->groupBlocks + 1;
+int ext2_block_read(ext2_t *fs, uint32_t bno, void *buff, uint32_t n)
+{
+	return ext2_cache_read(fs, bno, buff, n);
+}
+
+
+int ext2_block_write(ext2_t *fs, uint32_t bno, const void *buff, uint32_t n)
+{
+	return ext2_cache_write(fs, bno, buff, n);
+}
 
-		if (group != pgroup) {
-			if ((err = ext2_block_write(fs, fs->gdt[pgroup].blockBmp, bmp, 1)) < 0) {
-				free(bmp);
-				return err;
-			}
 
-			fs->gdt[pgroup].freeBlocks += j;
+int ext2_block_destroy(ext2_t *fs, uint32_t bno, uint32_t n)
+{
+	return ext2_bmp_bfree(fs, bno, n);
+}
 
-			if ((err = ext2_gdt_syncone(fs, pgroup)) < 0) {
-				for (i = 0; i < j; i++)
-					ext2_togglebit(bmp, --offset);
 
-				if (!ext2_block_write(fs, fs->gdt[pgroup].blockBmp, bmp, 1))
-					fs->gdt[pgroup].freeBlocks -= j;
-				else
-					fs->sb->freeBlocks += j;
+/* Allocates one new block (close to the inode) */
+static int ext2_block_createone(ext2_t *fs, uint32_t ino, uint32_t *res)
+{
+	uint32_t group = (ino - 1) / fs->sb->groupInodes;
+	uint32_t len;
 
-				free(bmp);
-				return err;
-			}
+	return ext2_bmp_balloc(fs, fs->sb->fstBlock + group * fs->sb->groupBlocks, 1, res, &len);
+}
 
-			fs->sb->freeBlocks += j;
-			pgroup = group;
-			j = 0;
 
-			if ((err = ext2_block_read(fs, fs->gdt[group].blockBmp, bmp, 1)) < 0) {
-				free(bmp);
-				return err;
-			}
-		}
+/* Marks block mapping entry as modified, it's held either by the inode or one of the cached indirect blocks */
+static void ext2_block_modified(ext2_t *fs, ext2_obj_t *obj, uint32_t *entry)
+{
+	uint32_t i, addr = fs->blocksz / sizeof(uint32_t);
 
-		ext2_togglebit(bmp, offset);
+	if ((entry >= obj->inode->block) && (entry < obj->inode->block + NBLOCKS)) {
+		obj->flags |= OFLAG_DIRTY;
+		return;
 	}
 
-	if ((err = ext2_block_write(fs, fs->gdt[group].blockBmp, bmp, 1)) < 0) {
-		free(bmp);
-		return err;
+	for (i = 0; i < 3; i++) {
+		if ((obj->ind[i].data != NULL) && (entry >= obj->ind[i].data) && (entry < obj->ind[i].data + addr)) {
+			obj->ind[i].dirty = 1;
+			return;
+		}
 	}
+}
 
-	fs->gdt[group].freeBlocks += j;
-
-	if ((err = ext2_gdt_syncone(fs, group)) < 0) {
-		for (i = 0; i < j; i++)
-			ext2_togglebit(bmp, offset--);
 
-		if (!ext2_block_write(fs, fs->gdt[group].blockBmp, bmp, 1))
-			fs->gdt[group].freeBlocks -= j;
-		else
-			fs->sb->freeBlocks += j;
+/* Finds the allocation goal for the logical block, prefers blocks following the previous logical block or the inode group */
+static int ext2_block_goal(ext2_t *fs, ext2_obj_t *obj, uint32_t block, uint32_t *goal)
+{
+	uint32_t *pbno;
+	int err;
 
-		free(bmp);
+	if (block && ((err = ext2_block_get(fs, obj, block - 1, &pbno)) < 0))
 		return err;
-	}
 
-	fs->sb->freeBlocks += j;
-	free(bmp);
+	if (block && *pbno)
+		*goal = *pbno + 1;
+	else
+		*goal = fs->sb->fstBlock + ((uint32_t)obj->id - 1) / fs->sb->groupInodes * fs->sb->groupBlocks;
 
 	return EOK;
 }
 
 
-/* Allocates one new block */
-static int ext2_block_createone(ext2_t *fs, uint32_t bno, uint32_t *res)
+/* Allocates up to n consecutive blocks starting at the logical block, prefers the preallocation window */
+static int ext2_block_alloc(ext2_t *fs, ext2_obj_t *obj, uint32_t block, uint32_t n, uint32_t *bno, uint32_t *len)
 {
-	uint32_t group = (bno - 1) / fs->sb->groupInodes;
-	uint32_t offset, pgroup = group;
-	void *bmp;
-	int err;
+	uint32_t i, goal, want, maxsz = fs->pasz * 1024 / fs->blocksz;
+	uint32_t *pbno;
+	int append, prealloc, err;
 
-	if ((bmp = malloc(fs->blocksz)) == NULL)
-		return -ENOMEM;
+	/* Preallocate only for regular files growing at the end */
+	append = S_ISREG(obj->inode->mode) && (block + n >= (obj->inode->size + fs->blocksz - 1) / fs->blocksz);
+	prealloc = append && maxsz;
 
-	do {
-		if ((err = ext2_block_read(fs, fs->gdt[group].blockBmp, bmp, 1)) < 0) {
-			free(bmp);
+	/* Window reserved for other blocks => non-sequential access, release it (reserved windows are kept with preallocation disabled) */
+	if (obj->pa.n && (!append || (obj->pa.block != block))) {
+		if ((err = ext2_block_unreserve(fs, obj)) < 0)
 			return err;
-		}
+	}
 
-		if (!(offset = ext2_findzerobit(bmp, fs->sb->groupBlocks, 0))) {
-			group = (group + 1) % fs->groups;
+	if (obj->pa.n) {
+		*bno = obj->pa.bno;
+		*len = min(n, obj->pa.n);
 
-			if (group == pgroup) {
-				free(bmp);
-				return -ENOSPC;
-			}
-		}
-	} while (!offset);
+		obj->pa.block += *len;
+		obj->pa.bno += *len;
+		obj->pa.n -= *len;
+	}
+	else {
+		if ((err = ext2_block_goal(fs, obj, block, &goal)) < 0)
+			return err;
 
-	ext2_togglebit(bmp, offset);
+		want = (prealloc) ? n + obj->pa.size : n;
 
-	if ((err = ext2_block_write(fs, fs->gdt[group].blockBmp, bmp, 1)) < 0) {
-		free(bmp);
-		return err;
+		if ((err = ext2_bmp_balloc(fs, goal, want, bno, len)) < 0)
+			return err;
+
+		/* Keep the rest for the next blocks, grow the window while the file keeps growing */
+		if (*len > n) {
+			obj->pa.block = block + n;
+			obj->pa.bno = *bno + n;
+			obj->pa.n = *len - n;
+			*len = n;
+		}
+
+		if (prealloc)
+			obj->pa.size = min(max(2 * obj->pa.size, n), maxsz);
 	}
 
-	fs->gdt[group].freeBlocks--;
+	for (i = 0; i < *len; i++) {
+		if ((err = ext2_block_get(fs, obj, block + i, &pbno)) < 0) {
+			ext2_bmp_bfree(fs, *bno + i, *len - i);
 
-	if ((err = ext2_gdt_syncone(fs, group)) < 0) {
-		ext2_togglebit(bmp, offset);
+			/* Keep the blocks already linked to the inode */
+			if (!i)
+				return err;
 
-		if (!ext2_block_write(fs, fs->gdt[group].blockBmp, bmp, 1))
-			fs->gdt[group].freeBlocks++;
-		else
-			fs->sb->freeBlocks--;
+			*len = i;
+			break;
+		}
 
-		free(bmp);
-		return err;
+		*pbno = *bno + i;
+		ext2_block_modified(fs, obj, pbno);
 	}
 
-	fs->sb->freeBlocks--;
-	*res = group * fs->sb->groupBlocks + offset;
-	free(bmp);
+	obj->inode->blocks += *len * (fs->blocksz / fs->sectorsz);
+	obj->flags |= OFLAG_DIRTY;
 
 	return EOK;
 }
 
 
-/* Tries to allocate n consecutive blocks */
-static int ext2_block_create(ext2_t *fs, ext2_obj_t *obj, uint32_t block, uint32_t lbno, uint32_t n, uint32_t *res)
+int ext2_block_reserve(ext2_t *fs, ext2_obj_t *obj, uint32_t n, uint32_t *len)
 {
-	uint32_t *bno;
+	uint32_t bno, goal, block = (obj->inode->size + fs->blocksz - 1) / fs->blocksz;
 	int err;
 
-	void *bmp = malloc(fs->blocksz);
-	if (bmp == NULL) {
-		return -ENOMEM;
-	}
-
-	uint32_t group, offset;
-	if (lbno != 0) {
-		group = (lbno - 1) / fs->sb->groupBlocks;
-		offset = (lbno - 1) % fs->sb->groupBlocks + 1;
-	}
-	else {
-		group = ((uint32_t)obj->id - 1) / fs->sb->groupInodes;
-		offset = 0;
-	}
-
-	uint32_t startGroup = group;
-	do {
-		err = ext2_block_read(fs, fs->gdt[group].blockBmp, bmp, 1);
-		if (err < 0) {
-			free(bmp);
-			return err;
-		}
-
-		if ((offset != 0) && (ext2_checkbit(bmp, offset) == 0)) {
-			break;
-		}
-		else {
-			offset = ext2_findzerobit(bmp, fs->sb->groupBlocks, offset);
-		}
-
-		if (offset == 0) {
-			group = (group + 1) % fs->groups;
-			if (group == startGroup) {
-				free(bmp);
-				return -ENOSPC;
-			}
-		}
-	} while (offset == 0);
+	/* Blocks waiting for allocation precede the window */
+	if (obj->da.n && ((err = ext2_block_flush(fs, obj)) < 0))
+		return err;
 
-	uint32_t nFound;
-	for (nFound = 0; (nFound < n) && ((offset + nFound) <= fs->sb->groupBlocks); nFound++) {
-		if (ext2_checkbit(bmp, offset + nFound) != 0) {
-			break;
-		}
+	if ((err = ext2_block_unreserve(fs, obj)) < 0)
+		return err;
 
-		err = ext2_block_get(fs, obj, block + nFound, &bno);
-		if (err < 0) {
-			free(bmp);
-			return err;
-		}
+	if ((err = ext2_block_goal(fs, obj, block, &goal)) < 0)
+		return err;
 
-		ext2_togglebit(bmp, offset + nFound);
-		*bno = (group * fs->sb->groupBlocks) + offset + nFound;
-	}
+	if ((err = ext2_bmp_bfit(fs, goal, n, &bno, len)) < 0)
+		return err;
 
-	if (nFound == 0) {
-		free(bmp);
-		return -ENOSPC;
-	}
+	obj->pa.block = block;
+	obj->pa.bno = bno;
+	obj->pa.n = *len;
 
-	err = ext2_block_write(fs, fs->gdt[group].blockBmp, bmp, 1);
-	if (err < 0) {
-		free(bmp);
-		return err;
-	}
+	return EOK;
+}
 
-	fs->gdt[group].freeBlocks -= nFound;
 
-	err = ext2_gdt_syncone(fs, group);
-	if (err < 0) {
-		for (uint32_t j = 0; j < nFound; j++) {
-			ext2_togglebit(bmp, offset + j);
-		}
+int ext2_block_unreserve(ext2_t *fs, ext2_obj_t *obj)
+{
+	int err;
 
-		if (ext2_block_write(fs, fs->gdt[group].blockBmp, bmp, 1) == 0) {
-			fs->gdt[group].freeBlocks += nFound;
-		}
-		else {
-			fs->sb->freeBlocks -= nFound;
-		}
+	if (obj->pa.n) {
+		if ((err = ext2_bmp_bfree(fs, obj->pa.bno, obj->pa.n)) < 0)
+			return err;
 
-		free(bmp);
-		return err;
+		obj->pa.n = 0;
 	}
-
-	fs->sb->freeBlocks -= nFound;
-	*res = nFound;
-	free(bmp);
+	obj->pa.size = 0;
 
 	return EOK;
 }
@@ -343,9 +300,11 @@ static int ext2_block_readind(ext2_t *fs, ext2_obj_t *obj, uint32_t *bno, int de
 			if ((obj->ind[depth].data = (uint32_t *)malloc(fs->blocksz)) == NULL)
 				return -ENOMEM;
 		}
-		else {
+		else if (obj->ind[depth].dirty) {
 			if ((err = ext2_block_write(fs, obj->ind[depth].bno, obj->ind[depth].data, 1)) < 0)
 				return err;
+
+			obj->ind[depth].dirty = 0;
 		}
 
 		if (!(*bno)) {
@@ -353,9 +312,18 @@ static int ext2_block_readind(ext2_t *fs, ext2_obj_t *obj, uint32_t *bno, int de
 				return err;
 
 			memset(obj->ind[depth].data, 0, fs->blocksz);
+			obj->ind[depth].dirty = 1;
 			*bno = obj->ind[depth].bno;
+			ext2_block_modified(fs, obj, bno);
+
+			/* Indirect blocks are counted as inode blocks too */
+			obj->inode->blocks += fs->blocksz / fs->sectorsz;
+			obj->flags |= OFLAG_DIRTY;
 		}
 		else {
+			/* Invalidate cached block before reading, it may fail */
+			obj->ind[depth].bno = 0;
+
 			if ((err = ext2_block_read(fs, *bno, obj->ind[depth].data, 1)) < 0)
 				return err;
 
@@ -411,6 +379,10 @@ int ext2_block_get(ext2_t *fs, ext2_obj_t *obj, uint32_t block, uint32_t **res)
 	uint32_t offs[4] = { 0 };
 	int err, depth;
 
+	/* Extent trees are read-only */
+	if (ext2_extent_mapped(obj))
+		return -EROFS;
+
 	if ((depth = ext2_block_offs(fs, block, offs)) < 0)
 		return depth;
 
@@ -428,223 +400,587 @@ int ext2_block_get(ext2_t *fs, ext2_obj_t *obj, uint32_t block, uint32_t **res)
 }
 
 
-int ext2_block_syncone(ext2_t *fs, ext2_obj_t *obj, uint32_t block, const void *buff)
+/* Looks up cached block run containing the logical block */
+static int ext2_block_cached(ext2_obj_t *obj, uint32_t block, uint32_t n, uint32_t *bno, uint32_t *len)
+{
+	uint32_t i, rblock, rbno, rlen;
+
+	for (i = 0; i < obj->nmap; i++) {
+		rblock = obj->map[i].block;
+		rbno = obj->map[i].bno;
+		rlen = obj->map[i].len;
+
+		if ((block < rblock) || (block - rblock >= rlen))
+			continue;
+
+		/* Move the run to the front */
+		memmove(obj->map + 1, obj->map, i * sizeof(obj->map[0]));
+		obj->map[0].block = rblock;
+		obj->map[0].bno = rbno;
+		obj->map[0].len = rlen;
+
+		*bno = rbno + (block - rblock);
+		*len = min(n, rlen - (block - rblock));
+
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/* Caches mapped block run, extends the run it continues */
+static void ext2_block_cache(ext2_obj_t *obj, uint32_t block, uint32_t bno, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i < obj->nmap; i++) {
+		if ((obj->map[i].block + obj->map[i].len == block) && (obj->map[i].bno + obj->map[i].len == bno)) {
+			obj->map[i].len += len;
+			return;
+		}
+	}
+
+	/* Drop the least recently used run */
+	if (obj->nmap < MAP_SIZE)
+		obj->nmap++;
+
+	memmove(obj->map + 1, obj->map, (obj->nmap - 1) * sizeof(obj->map[0]));
+	obj->map[0].block = block;
+	obj->map[0].bno = bno;
+	obj->map[0].len = len;
+}
+
+
+/* Maps logical blocks to a physical run (requires object mapping state to be locked) */
+static int _ext2_block_map(ext2_t *fs, ext2_obj_t *obj, uint32_t block, uint32_t n, uint32_t *bno, uint32_t *len)
 {
-	uint32_t *bno;
+	uint32_t addr = 256 << fs->sb->logBlocksz;
+	uint32_t i, pos, size, offs[4] = { 0 };
+	uint32_t *map, *ind;
+	int err, depth;
+
+	if (ext2_block_cached(obj, block, n, bno, len))
+		return EOK;
+
+	if (ext2_extent_mapped(obj)) {
+		if ((err = _ext2_extent_map(fs, obj, block, bno, len)) < 0)
+			return err;
+
+		if (*bno)
+			ext2_block_cache(obj, block, *bno, *len);
+		*len = min(n, *len);
+
+		return EOK;
+	}
+
+	if ((depth = ext2_block_offs(fs, block, offs)) < 0)
+		return depth;
+
+	if (depth > 1) {
+		map = obj->inode->block + offs[depth - 1];
+
+		for (; depth > 1; depth--) {
+			/* Missing indirect block => hole up to the end of the range it maps */
+			if (!(*map)) {
+				for (i = 0, pos = 0, size = 1; i < depth - 1; i++) {
+					pos += offs[i] * size;
+					size *= addr;
+				}
+				*bno = 0;
+				*len = min(n, size - pos);
+				return EOK;
+			}
+
+			if ((err = ext2_block_readind(fs, obj, map, depth, &ind)) < 0)
+				return err;
+
+			map = ind + offs[depth - 2];
+		}
+		size = addr - offs[0];
+	}
+	else {
+		map = obj->inode->block + offs[0];
+		size = DIRECT_BLOCKS - offs[0];
+	}
+
+	*bno = map[0];
+
+	/* Allocated run is mapped (and cached) up to its end */
+	for (*len = 1; (*len < size) && ((*bno) || (*len < n)); (*len)++) {
+		if (map[*len] != ((*bno) ? *bno + *len : 0))
+			break;
+	}
+
+	/* Holes aren't cached, they get filled by allocations */
+	if (*bno) {
+		for (i = 0; (i < offs[0]) && (map[-(int)i - 1] == *bno - i - 1); i++);
+		ext2_block_cache(obj, block - i, *bno - i, *len + i);
+	}
+
+	*len = min(n, *len);
+
+	return EOK;
+}
+
+
+int ext2_block_map(ext2_t *fs, ext2_obj_t *obj, uint32_t block, uint32_t n, uint32_t *bno, uint32_t *len)
+{
+	int err;
+
+	/* Objects locked for reading are mapped concurrently */
+	mutexLock(obj->rlock);
+	err = _ext2_block_map(fs, obj, block, n, bno, len);
+	mutexUnlock(obj->rlock);
+
+	return err;
+}
+
+
+/* Checks if the logical block is waiting for allocation */
+static inline int ext2_block_delayed(ext2_obj_t *obj, uint32_t block)
+{
+	return (obj->da.n != 0) && (block >= obj->da.block) && (block < obj->da.block + obj->da.n);
+}
+
+
+int ext2_block_data(ext2_t *fs, ext2_obj_t *obj, uint32_t block, uint32_t n, uint32_t *len)
+{
+	uint32_t i, bno;
 	int err;
 
-	if ((err = ext2_block_get(fs, obj, block, &bno)) < 0)
+	if ((err = ext2_block_map(fs, obj, block, n, &bno, len)) < 0)
 		return err;
 
-	if (!(*bno)) {
-		if ((err = ext2_block_createone(fs, (uint32_t)obj->id, &block)) < 0)
-			return err;
+	if (bno)
+		return 1;
 
-		*bno = block;
-		obj->inode->blocks += fs->blocksz / fs->sectorsz;
+	/* Blocks waiting for allocation hold data */
+	if (ext2_block_delayed(obj, block)) {
+		*len = min(n, obj->da.block + obj->da.n - block);
+		return 1;
 	}
 
-	return ext2_block_write(fs, *bno, buff, 1);
+	for (i = 1; (i < *len) && !ext2_block_delayed(obj, block + i); i++);
+	*len = i;
+
+	return 0;
 }
 
 
-int ext2_block_sync(ext2_t *fs, ext2_obj_t *obj, uint32_t block, const void *buff, uint32_t n)
+/* Reserves free blocks for n delayed blocks and the indirect blocks they may need, force ignores free blocks shortage */
+static int ext2_block_dares(ext2_t *fs, ext2_obj_t *obj, uint32_t n, int force)
 {
-	uint32_t lbno = 0, i = 0, j = 0, k = 0;
-	uint32_t *bno;
+	uint32_t res = (n) ? n + n / (fs->blocksz / sizeof(uint32_t)) + 3 : 0;
+	int err = EOK;
+
+	mutexLock(fs->mdlock);
+
+	if (!force && (res > obj->da.res) && (fs->sb->freeBlocks < fs->dares - obj->da.res + res)) {
+		err = -ENOSPC;
+	}
+	else {
+		fs->dares = fs->dares - obj->da.res + res;
+		obj->da.res = res;
+	}
+
+	mutexUnlock(fs->mdlock);
+
+	return err;
+}
+
+
+void ext2_block_undelay(ext2_t *fs, ext2_obj_t *obj, uint32_t block)
+{
+	if (obj->da.n && (obj->da.block + obj->da.n > block)) {
+		obj->da.n = (obj->da.block < block) ? block - obj->da.block : 0;
+		ext2_block_dares(fs, obj, obj->da.n, 1);
+	}
+}
+
+
+int ext2_block_flush(ext2_t *fs, ext2_obj_t *obj)
+{
+	uint32_t i, bno, len;
 	int err;
 
-	while (j < n) {
-		if ((err = ext2_block_get(fs, obj, block + j, &bno)) < 0)
+	/* Reserved blocks are taken by the allocation */
+	ext2_block_dares(fs, obj, 0, 1);
+
+	for (i = 0; i < obj->da.n; i += len) {
+		if (((err = ext2_block_alloc(fs, obj, obj->da.block + i, obj->da.n - i, &bno, &len)) < 0) ||
+			((err = ext2_block_write(fs, bno, (char *)obj->da.data + i * fs->blocksz, len)) < 0)) {
+			/* Keep blocks that haven't been allocated yet */
+			memmove(obj->da.data, (char *)obj->da.data + i * fs->blocksz, (obj->da.n - i) * fs->blocksz);
+			obj->da.block += i;
+			obj->da.n -= i;
+			ext2_block_dares(fs, obj, obj->da.n, 1);
 			return err;
+		}
+	}
 
-		if (!(*bno)) {
-			if (i < j) {
-				if ((err = ext2_block_get(fs, obj, i, &bno)) < 0)
-					return err;
+	/* Buffer is kept for the following delayed writes until the object is synchronized */
+	obj->da.n = 0;
+	obj->flags |= OFLAG_DIRTY;
 
-				if ((err = ext2_block_write(fs, *bno, buff + i * fs->blocksz, j - i)) < 0)
-					return err;
-			}
+	return EOK;
+}
 
-			for (i = j++; j < n; j++) {
-				if ((err = ext2_block_get(fs, obj, block + j, &bno)) < 0)
-					return err;
 
-				if (*bno)
-					break;
-			}
+/* Keeps data of not allocated blocks in memory until they are flushed, returns -ENOSPC if free blocks can't be reserved for them */
+static int ext2_block_delay(ext2_t *fs, ext2_obj_t *obj, uint32_t block, const void *buff, uint32_t n)
+{
+	uint32_t i, l, size = fs->dasz * 1024 / fs->blocksz;
+	int err;
 
-			for (; i < j; i += k) {
-				if ((err = ext2_block_create(fs, obj, block + i, lbno, j - i, &k)) < 0)
-					return err;
+	while (n > 0) {
+		/* Blocks can't be appended to the buffer => flush it */
+		if (obj->da.n && ((block < obj->da.block) || (block > obj->da.block + obj->da.n) || (block == obj->da.block + size))) {
+			if ((err = ext2_block_flush(fs, obj)) < 0)
+				return err;
+		}
 
-				if ((err = ext2_block_get(fs, obj, block + i, &bno)) < 0)
-					return err;
+		if (!obj->da.n) {
+			if ((obj->da.data == NULL) && ((obj->da.data = malloc(size * fs->blocksz)) == NULL))
+				return -ENOMEM;
 
-				if ((err = ext2_block_write(fs, *bno, buff + i * fs->blocksz, k)) < 0)
-					return err;
-			}
+			obj->da.block = block;
+		}
+
+		i = block - obj->da.block;
+		l = min(n, size - i);
+
+		if ((err = ext2_block_dares(fs, obj, max(obj->da.n, i + l), 0)) < 0)
+			return err;
+
+		memcpy((char *)obj->da.data + i * fs->blocksz, buff, l * fs->blocksz);
+		obj->da.n = max(obj->da.n, i + l);
+
+		block += l;
+		buff = (const char *)buff + l * fs->blocksz;
+		n -= l;
+	}
+
+	return EOK;
+}
+
+
+/* Checks if zeros are written to the block, they leave regular file holes unallocated unless the block is preallocated */
+static inline int ext2_block_zero(ext2_t *fs, ext2_obj_t *obj, uint32_t block, const void *buff)
+{
+	if (!S_ISREG(obj->inode->mode) || (obj->pa.n && (block >= obj->pa.block) && (block < obj->pa.block + obj->pa.n)))
+		return 0;
+
+	return !*(const char *)buff && !memcmp(buff, (const char *)buff + 1, fs->blocksz - 1);
+}
 
-			lbno = 0;
+
+int ext2_block_syncone(ext2_t *fs, ext2_obj_t *obj, uint32_t block, const void *buff)
+{
+	return ext2_block_sync(fs, obj, block, buff, 1);
+}
+
+
+int ext2_block_sync(ext2_t *fs, ext2_obj_t *obj, uint32_t block, const void *buff, uint32_t n)
+{
+	uint32_t i, j, k, bno, len, size = fs->dasz * 1024 / fs->blocksz;
+	int delay = S_ISREG(obj->inode->mode), err;
+
+	for (i = 0; i < n; i = j) {
+		/* Overwrite delayed blocks */
+		if (ext2_block_delayed(obj, block + i)) {
+			j = min(n, obj->da.block + obj->da.n - block);
+
+			if ((err = ext2_block_delay(fs, obj, block + i, buff + i * fs->blocksz, j - i)) < 0)
+				return err;
+
+			continue;
 		}
-		else if (!lbno || (*bno == lbno + 1)) {
-			lbno = *bno;
-			j++;
+
+		if ((err = ext2_block_map(fs, obj, block + i, n - i, &bno, &len)) < 0)
+			return err;
+
+		/* Write physically contiguous blocks at once */
+		if (bno) {
+			j = i + len;
+
+			if ((err = ext2_block_write(fs, bno, buff + i * fs->blocksz, len)) < 0)
+				return err;
+
+			continue;
 		}
-		else {
-			if ((err = ext2_block_get(fs, obj, block + i, &bno)) < 0)
+
+		/* Zeros written to regular file holes leave them unallocated */
+		if (ext2_block_zero(fs, obj, block + i, buff + i * fs->blocksz)) {
+			j = i + 1;
+			continue;
+		}
+
+		for (j = i + 1; (j < i + len) && !ext2_block_delayed(obj, block + j); j++) {
+			if (ext2_block_zero(fs, obj, block + j, buff + j * fs->blocksz))
+				break;
+		}
+
+		/* Delay allocation of new blocks unless they would fill up the buffer anyway */
+		if (delay && (j - i < size)) {
+			if ((err = ext2_block_delay(fs, obj, block + i, buff + i * fs->blocksz, j - i)) == EOK)
+				continue;
+
+			if (err != -ENOSPC)
 				return err;
 
-			if ((err = ext2_block_write(fs, *bno, buff + i * fs->blocksz, j - i)) < 0)
+			/* Free space is low, allocate the remaining blocks at once (some of them might have been delayed or flushed) */
+			delay = 0;
+			j = i;
+			continue;
+		}
+
+		if (obj->da.n && ((err = ext2_block_flush(fs, obj)) < 0))
+			return err;
+
+		for (k = i; k < j; k += len) {
+			if ((err = ext2_block_alloc(fs, obj, block + k, j - k, &bno, &len)) < 0)
 				return err;
 
-			lbno = 0;
-			i = j++;
+			if ((err = ext2_block_write(fs, bno, buff + k * fs->blocksz, len)) < 0)
+				return err;
 		}
 	}
 
-	if (i < j) {
-		if ((err = ext2_block_get(fs, obj, block + i, &bno)) < 0)
-			return err;
+	return EOK;
+}
+
+
+/* Blocks freed by truncation */
+typedef struct {
+	ext2_run_t *runs; /* Freed runs waiting for release */
+	uint32_t size;    /* Max number of runs */
+	uint32_t n;       /* Number of runs */
+	uint32_t freed;   /* Number of freed blocks (indirect ones included) */
+} ext2_freed_t;
+
+
+/* Adds freed block to the runs waiting for release, releases them once there's no space left */
+static int ext2_block_release(ext2_t *fs, ext2_freed_t *freed, uint32_t bno)
+{
+	int err;
 
-		if ((err = ext2_block_write(fs, *bno, buff + i * fs->blocksz, j - i)) < 0)
+	freed->freed++;
+
+	if (freed->n && (freed->runs[freed->n - 1].bno + freed->runs[freed->n - 1].len == bno)) {
+		freed->runs[freed->n - 1].len++;
+		return EOK;
+	}
+
+	if (freed->n == freed->size) {
+		if ((err = ext2_bmp_bfreev(fs, freed->runs, freed->n)) < 0)
 			return err;
+
+		freed->n = 0;
 	}
 
+	freed->runs[freed->n].bno = bno;
+	freed->runs[freed->n].len = 1;
+	freed->n++;
+
 	return EOK;
 }
 
 
-/* Destroys a block */
-static int ext2_block_destroyone(ext2_t *fs, uint32_t bno)
+/* Frees blocks mapped by an indirect block from the relative logical block on, frees the indirect block too if it maps none afterwards */
+static int ext2_block_truncind(ext2_t *fs, ext2_freed_t *freed, uint32_t *bno, int level, uint64_t from)
 {
-	uint32_t group = (bno - 1) / fs->sb->groupBlocks;
-	uint32_t offset = (bno - 1) % fs->sb->groupBlocks + 1;
-	void *bmp;
-	int err;
+	uint32_t i, addr = fs->blocksz / sizeof(uint32_t), *data;
+	uint64_t span = 1;
+	int modified = 0, err = EOK;
 
-	if (!bno)
+	if (!(*bno))
 		return EOK;
 
-	if ((bmp = malloc(fs->blocksz)) == NULL)
+	/* Number of logical blocks mapped by each entry */
+	for (i = 1; i < level; i++)
+		span *= addr;
+
+	if ((data = (uint32_t *)ext2_pool_get(fs)) == NULL)
 		return -ENOMEM;
 
-	if ((err = ext2_block_read(fs, fs->gdt[group].blockBmp, bmp, 1)) < 0) {
-		free(bmp);
+	if ((err = ext2_block_read(fs, *bno, data, 1)) < 0) {
+		ext2_pool_put(fs, data);
 		return err;
 	}
 
-	ext2_togglebit(bmp, offset);
+	for (i = from / span; (i < addr) && (err == EOK); i++) {
+		if (!data[i])
+			continue;
 
-	if ((err = ext2_block_write(fs, fs->gdt[group].blockBmp, bmp, 1)) < 0) {
-		free(bmp);
-		return err;
+		if (level > 1) {
+			err = ext2_block_truncind(fs, freed, data + i, level - 1, (i == from / span) ? from % span : 0);
+		}
+		else if ((err = ext2_block_release(fs, freed, data[i])) == EOK) {
+			data[i] = 0;
+		}
+		modified = 1;
 	}
 
-	fs->gdt[group].freeBlocks++;
+	if (err == EOK) {
+		/* Partially truncated indirect block is kept */
+		if (from) {
+			if (modified)
+				err = ext2_block_write(fs, *bno, data, 1);
+		}
+		else if ((err = ext2_block_release(fs, freed, *bno)) == EOK) {
+			*bno = 0;
+		}
+	}
 
-	if ((err = ext2_gdt_syncone(fs, group)) < 0) {
-		ext2_togglebit(bmp, offset);
+	ext2_pool_put(fs, data);
 
-		if (!ext2_block_write(fs, fs->gdt[group].blockBmp, bmp, 1))
-			fs->gdt[group].freeBlocks--;
-		else
-			fs->sb->freeBlocks++;
+	return err;
+}
 
-		free(bmp);
-		return err;
+
+int ext2_block_truncate(ext2_t *fs, ext2_obj_t *obj, uint32_t block)
+{
+	uint32_t i, addr = fs->blocksz / sizeof(uint32_t);
+	uint64_t first = DIRECT_BLOCKS, span = 1;
+	ext2_freed_t freed;
+	int err = EOK;
+
+	/* Extent trees are read-only */
+	if (ext2_extent_mapped(obj))
+		return -EROFS;
+
+	/* Cached indirect blocks are written back and dropped, truncation walks the tree on its own */
+	for (i = 0; i < 3; i++) {
+		if (obj->ind[i].dirty && ((err = ext2_block_write(fs, obj->ind[i].bno, obj->ind[i].data, 1)) < 0))
+			return err;
+
+		obj->ind[i].bno = 0;
+		obj->ind[i].dirty = 0;
 	}
 
-	fs->sb->freeBlocks++;
-	free(bmp);
+	/* Cached block runs may refer to destroyed blocks */
+	obj->nmap = 0;
 
-	return EOK;
-}
+	if ((freed.runs = (ext2_run_t *)ext2_pool_get(fs)) == NULL)
+		return -ENOMEM;
 
+	freed.size = fs->blocksz / sizeof(ext2_run_t);
+	freed.n = 0;
+	freed.freed = 0;
 
-int ext2_iblock_destroy(ext2_t *fs, ext2_obj_t *obj, uint32_t block, uint32_t n)
-{
-	uint32_t *ind[3] = { NULL, NULL, NULL };
-	uint32_t i, offs[4] = { 0 };
-	int err, depth;
+	for (i = block; (i < DIRECT_BLOCKS) && (err == EOK); i++) {
+		if (obj->inode->block[i] && ((err = ext2_block_release(fs, &freed, obj->inode->block[i])) == EOK))
+			obj->inode->block[i] = 0;
+	}
 
-	for (i = 0; i < n; i++) {
-		if ((depth = ext2_block_offs(fs, block + i, offs)) < 0)
-			return depth;
+	for (i = 0; (i < INDIRECT_BLOCKS) && (err == EOK); i++) {
+		span *= addr;
 
-		if ((err = ext2_block_ind(fs, obj, depth, offs, ind)) < 0)
-			return err;
+		if (block < first + span)
+			err = ext2_block_truncind(fs, &freed, obj->inode->block + DIRECT_BLOCKS + i, i + 1, (block > first) ? block - first : 0);
 
-		if (ind[0] != NULL)
-			*(ind[0] + offs[0]) = 0;
+		first += span;
+	}
 
-		switch (depth) {
-		case 1:
-			obj->inode->block[offs[0]] = 0;
-			break;
+	/* Blocks are released only if all mapping changes succeeded */
+	if ((err == EOK) && freed.n)
+		err = ext2_bmp_bfreev(fs, freed.runs, freed.n);
 
-		case 2:
-			if (!offs[0]) {
-				if ((err = ext2_block_destroyone(fs, obj->inode->block[offs[1]])) < 0)
-					return err;
+	ext2_pool_put(fs, freed.runs);
 
-				obj->inode->block[offs[1]] = 0;
-			}
-			break;
+	obj->inode->blocks -= min(obj->inode->blocks, freed.freed * (fs->blocksz / fs->sectorsz));
+	obj->flags |= OFLAG_DIRTY;
 
-		case 3:
-			if (!offs[0]) {
-				if ((err = ext2_block_destroyone(fs, *(ind[1] + offs[1]))) < 0)
-					return err;
+	return err;
+}
 
-				*(ind[1] + offs[1]) = 0;
-			}
 
-			if (!offs[1]) {
-				if ((err = ext2_block_destroyone(fs, obj->inode->block[offs[2]])) < 0)
-					return err;
+void ext2_block_readahead(ext2_t *fs, ext2_obj_t *obj, uint32_t block, uint32_t n)
+{
+	uint32_t maxsz = fs->rasz * 1024 / fs->blocksz, last = (obj->inode->size + fs->blocksz - 1) / fs->blocksz;
+	uint32_t start, end, bno, len, pbno = 0, pn = 0;
+	int seq;
 
-				obj->inode->block[offs[2]] = 0;
-			}
-			break;
+	if ((fs->cache == NULL) || !maxsz)
+		return;
 
-		case 4:
-			if (!offs[0]) {
-				if ((err = ext2_block_destroyone(fs, *(ind[1] + offs[1]))) < 0)
-					return err;
+	mutexLock(obj->rlock);
 
-				*(ind[1] + offs[1]) = 0;
-			}
+	/* The same block may be read again by unaligned reads */
+	seq = (block == obj->ra.next) || (block + 1 == obj->ra.next);
+	obj->ra.next = block + n;
 
-			if (!offs[1]) {
-				if ((err = ext2_block_destroyone(fs, *(ind[2] + offs[2]))) < 0)
-					return err;
+	/* Random access => reset the window */
+	if (!seq) {
+		obj->ra.end = 0;
+		obj->ra.size = 0;
+		mutexUnlock(obj->rlock);
+		return;
+	}
 
-				*(ind[2] + offs[2]) = 0;
-			}
+	/* Blocks have already been prefetched or are read in large requests anyway */
+	if ((block + n <= obj->ra.end) || (block >= last) || (n >= maxsz)) {
+		mutexUnlock(obj->rlock);
+		return;
+	}
 
-			if (!offs[2]) {
-				if ((err = ext2_block_destroyone(fs, obj->inode->block[offs[3]])) < 0)
-					return err;
+	/* Grow the window with each sequentially read one, claim it before prefetching */
+	obj->ra.size = (obj->ra.size) ? min(2 * obj->ra.size, maxsz) : min(4, maxsz);
+	start = max(block, obj->ra.end);
+	end = min(block + max(n, obj->ra.size), last);
+	obj->ra.end = max(obj->ra.end, end);
 
-				obj->inode->block[offs[3]] = 0;
-			}
+	mutexUnlock(obj->rlock);
+
+	/* Prefetch physically contiguous runs */
+	for (; start < end; start += len) {
+		if (ext2_block_map(fs, obj, start, end - start, &bno, &len) < 0)
 			break;
+
+		/* Runs may continue across indirect blocks boundaries */
+		if (pn && (bno == pbno + pn)) {
+			pn += len;
+			continue;
 		}
+
+		if (pn && (ext2_cache_prefetch(fs, pbno, pn) < 0))
+			return;
+
+		pbno = bno;
+		pn = (bno) ? len : 0;
 	}
 
-	return EOK;
+	if (pn)
+		(void)ext2_cache_prefetch(fs, pbno, pn);
 }
 
 
-int ext2_block_init(ext2_t *fs, ext2_obj_t *obj, uint32_t block, void *buff)
+int ext2_block_init(ext2_t *fs, ext2_obj_t *obj, uint32_t block, void *buff, uint32_t n)
 {
-	uint32_t *bno;
+	uint32_t i, j, bno, len;
 	int err;
 
-	if ((err = ext2_block_get(fs, obj, block, &bno)) < 0)
-		return err;
+	for (i = 0; i < n; i += len) {
+		if ((err = ext2_block_map(fs, obj, block + i, n - i, &bno, &len)) < 0)
+			return err;
+
+		/* Read physically contiguous blocks at once */
+		if (bno) {
+			if ((err = ext2_block_read(fs, bno, (char *)buff + i * fs->blocksz, len)) < 0)
+				return err;
+
+			continue;
+		}
 
-	return ext2_block_read(fs, *bno, buff, 1);
+		/* Not allocated block reads as zeros unless it's waiting for allocation */
+		for (j = i; j < i + len; j++) {
+			if (ext2_block_delayed(obj, block + j))
+				memcpy((char *)buff + j * fs->blocksz, (char *)obj->da.data + (block + j - obj->da.block) * fs->blocksz, fs->blocksz);
+			else
+				memset((char *)buff + j * fs->blocksz, 0, fs->blocksz);
+		}
+	}
+
+	return EOK;
 }
@@ -21,6 +21,18 @@
 #include "ext2.h"
 
 
+/* Reads blocks directly from the device */
+extern int ext2_dev_read(ext2_t *fs, uint32_t bno, void *buff, uint32_t n);
+
+
+/* Writes blocks directly to the device */
+extern int ext2_dev_write(ext2_t *fs, uint32_t bno, const void *buff, uint32_t n);
+
+
+/* Discards blocks on the device (returns -ENOSYS if the device doesn't support it) */
+extern int ext2_dev_discard(ext2_t *fs, uint32_t bno, uint32_t n);
+
+
 /* Reads blocks */
 extern int ext2_block_read(ext2_t *fs, uint32_t bno, void *buff, uint32_t n);
 
@@ -37,6 +49,14 @@ extern int ext2_block_destroy(ext2_t *fs, uint32_t bno, uint32_t n);
 extern int ext2_block_get(ext2_t *fs, ext2_obj_t *obj, uint32_t block, uint32_t **res);
 
 
+/* Maps logical blocks to a run of physically contiguous (or not allocated) blocks, doesn't allocate any blocks */
+extern int ext2_block_map(ext2_t *fs, ext2_obj_t *obj, uint32_t block, uint32_t n, uint32_t *bno, uint32_t *len);
+
+
+/* Checks if logical blocks hold data (are allocated or wait for allocation), returns 1 for data and 0 for a hole spanning len blocks (requires object to be locked, at least for reading) */
+extern int ext2_block_data(ext2_t *fs, ext2_obj_t *obj, uint32_t block, uint32_t n, uint32_t *len);
+
+
 /* Synchronizes one block (given object inode relative block number) */
 extern int ext2_block_syncone(ext2_t *fs, ext2_obj_t *obj, uint32_t block, const void *buff);
 
@@ -45,12 +65,32 @@ extern int ext2_block_syncone(ext2_t *fs, ext2_obj_t *obj, uint32_t block, const
 extern int ext2_block_sync(ext2_t *fs, ext2_obj_t *obj, uint32_t block, const void *buff, uint32_t n);
 
 
-/* Destroys inode blocks (given object inode relative block number) */
-extern int ext2_iblock_destroy(ext2_t *fs, ext2_obj_t *obj, uint32_t block, uint32_t n);
+/* Allocates and writes back blocks waiting for allocation */
+extern int ext2_block_flush(ext2_t *fs, ext2_obj_t *obj);
+
+
+/* Drops blocks waiting for allocation from the logical block on and releases their reserved free blocks */
+extern void ext2_block_undelay(ext2_t *fs, ext2_obj_t *obj, uint32_t block);
+
+
+/* Reserves up to n consecutive blocks following the end of the object in its preallocation window, so that they are taken by the following writes */
+extern int ext2_block_reserve(ext2_t *fs, ext2_obj_t *obj, uint32_t n, uint32_t *len);
+
+
+/* Releases object preallocation window */
+extern int ext2_block_unreserve(ext2_t *fs, ext2_obj_t *obj);
+
+
+/* Destroys object blocks from the logical block on, freed blocks are released in batches (sorted and merged) */
+extern int ext2_block_truncate(ext2_t *fs, ext2_obj_t *obj, uint32_t block);
+
+
+/* Prefetches blocks into the cache if the object is read sequentially (requires object to be locked for reading) */
+extern void ext2_block_readahead(ext2_t *fs, ext2_obj_t *obj, uint32_t block, uint32_t n);
 
 
-/* Initializes block (given object inode relative block number) */
-extern int ext2_block_init(ext2_t *fs, ext2_obj_t *obj, uint32_t block, void *buff);
+/* Reads blocks (given object inode relative block number) */
+extern int ext2_block_init(ext2_t *fs, ext2_obj_t *obj, uint32_t block, void *buff, uint32_t n);
 
 
 #endif
@@ -0,0 +1,816 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Block and inode bitmaps
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <sys/threads.h>
+
+#include "block.h"
+#include "bmp.h"
+
+
+/* Bitmaps are scanned in 64-bit words (on-disk bit order matches little endian words) */
+#define BITS_IN_WORD (CHAR_BIT * sizeof(uint64_t))
+
+
+/* Max number of freed runs waiting for discard (blocks freed while the queue is full are left for trim) */
+#define DISCARD_RUNS 1024
+
+
+/* Bitmap flags */
+enum {
+	BMP_DIRTY = 0x01, /* Bitmap differs from the device */
+	BMP_STALE = 0x02  /* Free runs summary needs to be recalculated */
+};
+
+
+uint32_t ext2_bmp_findzero(const uint64_t *data, uint32_t size, uint32_t pos)
+{
+	uint32_t i, n = (size + BITS_IN_WORD - 1) / BITS_IN_WORD;
+	uint64_t word;
+
+	if (pos >= size)
+		return size;
+
+	i = pos / BITS_IN_WORD;
+	word = ~data[i] & (~0ULL << (pos % BITS_IN_WORD));
+
+	/* Skip fully allocated words */
+	while (word == 0) {
+		if (++i >= n)
+			return size;
+		word = ~data[i];
+	}
+
+	pos = i * BITS_IN_WORD + __builtin_ctzll(word);
+
+	return (pos < size) ? pos : size;
+}
+
+
+uint32_t ext2_bmp_findset(const uint64_t *data, uint32_t size, uint32_t pos)
+{
+	uint32_t i, n = (size + BITS_IN_WORD - 1) / BITS_IN_WORD;
+	uint64_t word;
+
+	if (pos >= size)
+		return size;
+
+	i = pos / BITS_IN_WORD;
+	word = data[i] & (~0ULL << (pos % BITS_IN_WORD));
+
+	/* Skip fully free words */
+	while (word == 0) {
+		if (++i >= n)
+			return size;
+		word = data[i];
+	}
+
+	pos = i * BITS_IN_WORD + __builtin_ctzll(word);
+
+	return (pos < size) ? pos : size;
+}
+
+
+/* Returns last set bit before end and at or after pos (end if there is none) */
+static uint32_t ext2_bmp_rfindset(const uint64_t *data, uint32_t pos, uint32_t end)
+{
+	uint32_t i, first = pos / BITS_IN_WORD;
+	uint64_t word;
+
+	if (pos >= end)
+		return end;
+
+	i = (end - 1) / BITS_IN_WORD;
+	word = data[i] & (~0ULL >> (BITS_IN_WORD - 1 - (end - 1) % BITS_IN_WORD));
+
+	for (;;) {
+		if (i == first)
+			word &= ~0ULL << (pos % BITS_IN_WORD);
+
+		if (word != 0)
+			return i * BITS_IN_WORD + (BITS_IN_WORD - 1 - __builtin_clzll(word));
+
+		if (i == first)
+			return end;
+
+		word = data[--i];
+	}
+}
+
+
+/* Checks bit at pos */
+static int ext2_bmp_checkbit(const uint64_t *data, uint32_t pos)
+{
+	return !!(data[pos / BITS_IN_WORD] & (1ULL << (pos % BITS_IN_WORD)));
+}
+
+
+void ext2_bmp_fill(uint64_t *data, uint32_t pos, uint32_t n, int set)
+{
+	uint32_t i, end = pos + n;
+	uint64_t mask;
+
+	for (; pos < end; pos = (i + 1) * BITS_IN_WORD) {
+		i = pos / BITS_IN_WORD;
+		mask = ~0ULL << (pos % BITS_IN_WORD);
+
+		if (end - i * BITS_IN_WORD < BITS_IN_WORD)
+			mask &= ~0ULL >> (BITS_IN_WORD - (end - i * BITS_IN_WORD));
+
+		if (set)
+			data[i] |= mask;
+		else
+			data[i] &= ~mask;
+	}
+}
+
+
+uint32_t ext2_bmp_findrun(ext2_bmp_t *bmp, uint32_t pos, uint32_t n, uint32_t *start)
+{
+	uint32_t last;
+
+	if (pos < bmp->first)
+		pos = bmp->first;
+
+	for (pos = ext2_bmp_findzero(bmp->data, bmp->size, pos); (pos < bmp->size) && (bmp->size - pos >= n);) {
+		/* Run can't start before the last allocated bit within the next n bits */
+		if ((last = ext2_bmp_rfindset(bmp->data, pos, pos + n)) == pos + n) {
+			*start = pos;
+			return ext2_bmp_findset(bmp->data, bmp->size, pos + n) - pos;
+		}
+
+		pos = ext2_bmp_findzero(bmp->data, bmp->size, last + 1);
+	}
+
+	return 0;
+}
+
+
+/* Recalculates bitmap free runs summary */
+static void ext2_bmp_summary(ext2_bmp_t *bmp)
+{
+	uint32_t pos, end;
+
+	bmp->first = ext2_bmp_findzero(bmp->data, bmp->size, 0);
+	bmp->maxrun = 0;
+
+	for (pos = bmp->first; pos < bmp->size; pos = ext2_bmp_findzero(bmp->data, bmp->size, end)) {
+		end = ext2_bmp_findset(bmp->data, bmp->size, pos);
+
+		if (end - pos > bmp->maxrun)
+			bmp->maxrun = end - pos;
+	}
+
+	bmp->flags &= ~BMP_STALE;
+}
+
+
+/* Makes bitmap resident (requires group to be locked) */
+static int _ext2_bmp_load(ext2_t *fs, ext2_bmp_t *bmp, uint32_t bno)
+{
+	int err;
+
+	if (bmp->data != NULL)
+		return EOK;
+
+	if ((bmp->data = (uint64_t *)malloc(fs->blocksz)) == NULL)
+		return -ENOMEM;
+
+	if ((err = ext2_block_read(fs, bno, bmp->data, 1)) < 0) {
+		free(bmp->data);
+		bmp->data = NULL;
+		return err;
+	}
+
+	bmp->flags = 0;
+	ext2_bmp_summary(bmp);
+
+	return EOK;
+}
+
+
+/* Allocates n bits starting at pos (requires group to be locked) */
+static void _ext2_bmp_take(ext2_bmp_t *bmp, uint32_t pos, uint32_t n, uint32_t run)
+{
+	ext2_bmp_fill(bmp->data, pos, n, 1);
+
+	if (pos == bmp->first)
+		bmp->first += n;
+
+	/* Longest run might have been shortened */
+	if (run >= bmp->maxrun)
+		bmp->flags |= BMP_STALE;
+
+	bmp->flags |= BMP_DIRTY;
+}
+
+
+/* Updates superblock free blocks and inodes counters */
+static void ext2_bmp_count(ext2_t *fs, int32_t blocks, int32_t inodes)
+{
+	mutexLock(fs->mdlock);
+	fs->sb->freeBlocks += blocks;
+	fs->sb->freeInodes += inodes;
+	fs->sbdirty = 1;
+	mutexUnlock(fs->mdlock);
+}
+
+
+/* Returns index of the first queued run ending after bno (requires discard queue to be locked) */
+static uint32_t _ext2_bmp_dfind(ext2_bmps_t *bmps, uint32_t bno)
+{
+	ext2_run_t *runs = bmps->discard.runs;
+	uint32_t mid, lo = 0, hi = bmps->discard.n;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+
+		if (runs[mid].bno + runs[mid].len <= bno)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+
+/* Queues freed blocks for discard (requires discard queue to be locked) */
+static void _ext2_bmp_dqueue(ext2_bmps_t *bmps, uint32_t bno, uint32_t len)
+{
+	ext2_run_t *runs = bmps->discard.runs;
+	uint32_t i = _ext2_bmp_dfind(bmps, bno);
+
+	if ((i > 0) && (runs[i - 1].bno + runs[i - 1].len == bno)) {
+		runs[i - 1].len += len;
+
+		/* Freed blocks joined two queued runs */
+		if ((i < bmps->discard.n) && (runs[i].bno == bno + len)) {
+			runs[i - 1].len += runs[i].len;
+			memmove(runs + i, runs + i + 1, (--bmps->discard.n - i) * sizeof(ext2_run_t));
+		}
+	}
+	else if ((i < bmps->discard.n) && (runs[i].bno == bno + len)) {
+		runs[i].bno = bno;
+		runs[i].len += len;
+	}
+	else if (bmps->discard.n < DISCARD_RUNS) {
+		memmove(runs + i + 1, runs + i, (bmps->discard.n++ - i) * sizeof(ext2_run_t));
+		runs[i].bno = bno;
+		runs[i].len = len;
+	}
+}
+
+
+/* Removes allocated blocks from the discard queue (requires discard queue to be locked) */
+static void _ext2_bmp_dtake(ext2_bmps_t *bmps, uint32_t bno, uint32_t len)
+{
+	ext2_run_t *runs = bmps->discard.runs;
+	uint32_t j, i = _ext2_bmp_dfind(bmps, bno), end = bno + len;
+
+	if ((i < bmps->discard.n) && (runs[i].bno < bno)) {
+		/* Allocated blocks split the run (its tail is dropped if the queue is full) */
+		if ((runs[i].bno + runs[i].len > end) && (bmps->discard.n < DISCARD_RUNS)) {
+			memmove(runs + i + 1, runs + i, (bmps->discard.n++ - i) * sizeof(ext2_run_t));
+			runs[i + 1].bno = end;
+			runs[i + 1].len = runs[i].bno + runs[i].len - end;
+		}
+		runs[i].len = bno - runs[i].bno;
+		i++;
+	}
+
+	for (j = i; (j < bmps->discard.n) && (runs[j].bno + runs[j].len <= end); j++)
+		;
+
+	if ((j < bmps->discard.n) && (runs[j].bno < end)) {
+		runs[j].len -= end - runs[j].bno;
+		runs[j].bno = end;
+	}
+
+	memmove(runs + i, runs + j, (bmps->discard.n - j) * sizeof(ext2_run_t));
+	bmps->discard.n -= j - i;
+}
+
+
+/* Allocation strategies */
+enum {
+	BALLOC_GOAL,    /* Continue at the goal block */
+	BALLOC_FIT,     /* First free extent big enough */
+	BALLOC_LONGEST  /* Longest free extent */
+};
+
+
+/* Allocates up to n consecutive blocks in the group, returns 1 if any were allocated */
+static int ext2_bmp_galloc(ext2_t *fs, uint32_t group, uint32_t pos, uint32_t n, int mode, uint32_t *bno, uint32_t *len)
+{
+	ext2_bmp_t *bmp = fs->bmps->blocks + group;
+	uint32_t start = 0, run = 0;
+	int err;
+
+	/* Counters are checked without the lock first, so busy groups that can't hold the extent aren't waited for */
+	if (!fs->gdt[group].freeBlocks || ((mode == BALLOC_FIT) && (fs->gdt[group].freeBlocks < n)))
+		return 0;
+
+	mutexLock(fs->bmps->locks[group]);
+
+	if ((err = _ext2_bmp_load(fs, bmp, fs->gdt[group].blockBmp)) < 0) {
+		mutexUnlock(fs->bmps->locks[group]);
+		return err;
+	}
+
+	if ((mode != BALLOC_GOAL) && (bmp->flags & BMP_STALE))
+		ext2_bmp_summary(bmp);
+
+	switch (mode) {
+		case BALLOC_GOAL:
+			if (fs->gdt[group].freeBlocks && (pos < bmp->size) && !ext2_bmp_checkbit(bmp->data, pos)) {
+				start = pos;
+				run = ext2_bmp_findset(bmp->data, bmp->size, pos) - pos;
+			}
+			break;
+
+		case BALLOC_FIT:
+			if ((fs->gdt[group].freeBlocks >= n) && (bmp->maxrun >= n))
+				run = ext2_bmp_findrun(bmp, pos, n, &start);
+			break;
+
+		case BALLOC_LONGEST:
+			if (fs->gdt[group].freeBlocks && bmp->maxrun)
+				run = ext2_bmp_findrun(bmp, 0, bmp->maxrun, &start);
+			break;
+	}
+
+	if (!run) {
+		mutexUnlock(fs->bmps->locks[group]);
+		return 0;
+	}
+
+	if (n > run)
+		n = run;
+
+	/* Run started inside a free extent might be a part of the longest one */
+	if ((start > 0) && !ext2_bmp_checkbit(bmp->data, start - 1))
+		run = bmp->maxrun;
+
+	_ext2_bmp_take(bmp, start, n, run);
+	fs->gdt[group].freeBlocks -= n;
+	ext2_gdt_dirty(fs, group);
+
+	*bno = fs->sb->fstBlock + group * fs->sb->groupBlocks + start;
+	*len = n;
+
+	/* Reallocated blocks mustn't be discarded */
+	if (fs->bmps->discard.runs != NULL) {
+		mutexLock(fs->bmps->discard.lock);
+		_ext2_bmp_dtake(fs->bmps, *bno, n);
+		mutexUnlock(fs->bmps->discard.lock);
+	}
+
+	mutexUnlock(fs->bmps->locks[group]);
+
+	ext2_bmp_count(fs, -(int32_t)n, 0);
+
+	return 1;
+}
+
+
+/* Allocates up to n consecutive blocks close to the goal block, cont continues at the goal block even if fewer blocks are free there */
+static int ext2_bmp_alloc(ext2_t *fs, uint32_t goal, uint32_t n, int cont, uint32_t *bno, uint32_t *len)
+{
+	uint32_t i, group, pos, avail;
+	int ret;
+
+	if (!n)
+		return -EINVAL;
+
+	/* Blocks reserved for delayed allocation aren't available */
+	mutexLock(fs->mdlock);
+	avail = (fs->sb->freeBlocks > fs->dares) ? fs->sb->freeBlocks - fs->dares : 0;
+	mutexUnlock(fs->mdlock);
+
+	if (!avail)
+		return -ENOSPC;
+
+	if (n > avail)
+		n = avail;
+
+	if ((goal < fs->sb->fstBlock) || (goal >= fs->sb->blocks))
+		goal = fs->sb->fstBlock;
+
+	group = (goal - fs->sb->fstBlock) / fs->sb->groupBlocks;
+	pos = (goal - fs->sb->fstBlock) % fs->sb->groupBlocks;
+
+	/* Continue at the goal block if it's free */
+	if (cont && ((ret = ext2_bmp_galloc(fs, group, pos, n, BALLOC_GOAL, bno, len)) != 0))
+		return (ret < 0) ? ret : EOK;
+
+	/* Look for a free extent big enough, skip groups that can't hold one */
+	for (i = 0; i <= fs->groups; i++) {
+		group = (group + !!i) % fs->groups;
+
+		if ((ret = ext2_bmp_galloc(fs, group, (i == 0) ? pos : 0, n, BALLOC_FIT, bno, len)) != 0)
+			return (ret < 0) ? ret : EOK;
+	}
+
+	/* Fall back to the longest free extent of the first group with any free blocks */
+	for (i = 0; i < fs->groups; i++, group = (group + 1) % fs->groups) {
+		if ((ret = ext2_bmp_galloc(fs, group, 0, n, BALLOC_LONGEST, bno, len)) != 0)
+			return (ret < 0) ? ret : EOK;
+	}
+
+	return -ENOSPC;
+}
+
+
+int ext2_bmp_balloc(ext2_t *fs, uint32_t goal, uint32_t n, uint32_t *bno, uint32_t *len)
+{
+	return ext2_bmp_alloc(fs, goal, n, 1, bno, len);
+}
+
+
+int ext2_bmp_bfit(ext2_t *fs, uint32_t goal, uint32_t n, uint32_t *bno, uint32_t *len)
+{
+	return ext2_bmp_alloc(fs, goal, n, 0, bno, len);
+}
+
+
+int ext2_bmp_bfree(ext2_t *fs, uint32_t bno, uint32_t n)
+{
+	ext2_run_t run = { .bno = bno, .len = n };
+
+	return ext2_bmp_bfreev(fs, &run, 1);
+}
+
+
+static int ext2_bmp_runcmp(const void *run1, const void *run2)
+{
+	uint32_t bno1 = ((const ext2_run_t *)run1)->bno;
+	uint32_t bno2 = ((const ext2_run_t *)run2)->bno;
+
+	return (bno1 > bno2) - (bno1 < bno2);
+}
+
+
+int ext2_bmp_bfreev(ext2_t *fs, ext2_run_t *runs, uint32_t n)
+{
+	ext2_bmps_t *bmps = fs->bmps;
+	ext2_bmp_t *bmp;
+	uint32_t i, j, group, pos, len, freed, total = 0;
+	int err = EOK;
+
+	for (i = 0; i < n; i++) {
+		if ((runs[i].bno < fs->sb->fstBlock) || (runs[i].bno + runs[i].len > fs->sb->blocks) || (runs[i].bno + runs[i].len < runs[i].bno))
+			return -EINVAL;
+	}
+
+	if (n > 1) {
+		qsort(runs, n, sizeof(ext2_run_t), ext2_bmp_runcmp);
+
+		for (i = 1, j = 0; i < n; i++) {
+			if (runs[j].bno + runs[j].len == runs[i].bno)
+				runs[j].len += runs[i].len;
+			else
+				runs[++j] = runs[i];
+		}
+		n = j + 1;
+	}
+
+	for (i = 0; (i < n) && (err == EOK);) {
+		group = (runs[i].bno - fs->sb->fstBlock) / fs->sb->groupBlocks;
+		bmp = bmps->blocks + group;
+		freed = 0;
+
+		mutexLock(bmps->locks[group]);
+
+		if ((err = _ext2_bmp_load(fs, bmp, fs->gdt[group].blockBmp)) == EOK) {
+			/* Release all runs (or their parts) within the group at once */
+			while ((i < n) && ((runs[i].bno - fs->sb->fstBlock) / fs->sb->groupBlocks == group)) {
+				pos = (runs[i].bno - fs->sb->fstBlock) % fs->sb->groupBlocks;
+
+				if ((len = bmp->size - pos) > runs[i].len)
+					len = runs[i].len;
+
+				ext2_bmp_fill(bmp->data, pos, len, 0);
+				freed += len;
+
+				if (bmps->discard.runs != NULL) {
+					mutexLock(bmps->discard.lock);
+					_ext2_bmp_dqueue(bmps, runs[i].bno, len);
+					mutexUnlock(bmps->discard.lock);
+				}
+
+				/* Freed blocks might have joined adjacent free runs */
+				if (pos < bmp->first)
+					bmp->first = pos;
+
+				/* Run continues in the next group */
+				if (len < runs[i].len) {
+					runs[i].bno += len;
+					runs[i].len -= len;
+					break;
+				}
+				i++;
+			}
+
+			fs->gdt[group].freeBlocks += freed;
+			ext2_gdt_dirty(fs, group);
+			bmp->flags |= BMP_DIRTY | BMP_STALE;
+		}
+
+		mutexUnlock(bmps->locks[group]);
+
+		total += freed;
+	}
+
+	if (total)
+		ext2_bmp_count(fs, (int32_t)total, 0);
+
+	return err;
+}
+
+
+int ext2_bmp_ialloc(ext2_t *fs, uint32_t group, uint16_t mode, uint32_t *ino)
+{
+	ext2_bmps_t *bmps = fs->bmps;
+	ext2_bmp_t *bmp = bmps->inodes + group;
+	uint32_t pos;
+	int err;
+
+	mutexLock(bmps->locks[group]);
+
+	if ((err = _ext2_bmp_load(fs, bmp, fs->gdt[group].inodeBmp)) < 0) {
+		mutexUnlock(bmps->locks[group]);
+		return err;
+	}
+
+	if ((pos = ext2_bmp_findzero(bmp->data, bmp->size, bmp->first)) == bmp->size) {
+		bmp->first = bmp->size;
+		mutexUnlock(bmps->locks[group]);
+		return -ENOSPC;
+	}
+
+	ext2_bmp_fill(bmp->data, pos, 1, 1);
+
+	if (S_ISDIR(mode))
+		fs->gdt[group].dirs++;
+	fs->gdt[group].freeInodes--;
+	ext2_gdt_dirty(fs, group);
+
+	bmp->first = pos + 1;
+	bmp->flags |= BMP_DIRTY;
+	*ino = group * fs->sb->groupInodes + pos + 1;
+
+	mutexUnlock(bmps->locks[group]);
+
+	ext2_bmp_count(fs, 0, -1);
+
+	return EOK;
+}
+
+
+int ext2_bmp_ifree(ext2_t *fs, uint32_t ino, uint16_t mode)
+{
+	ext2_bmps_t *bmps = fs->bmps;
+	uint32_t group = (ino - 1) / fs->sb->groupInodes;
+	uint32_t pos = (ino - 1) % fs->sb->groupInodes;
+	ext2_bmp_t *bmp = bmps->inodes + group;
+	int err;
+
+	mutexLock(bmps->locks[group]);
+
+	if ((err = _ext2_bmp_load(fs, bmp, fs->gdt[group].inodeBmp)) < 0) {
+		mutexUnlock(bmps->locks[group]);
+		return err;
+	}
+
+	ext2_bmp_fill(bmp->data, pos, 1, 0);
+
+	if (S_ISDIR(mode))
+		fs->gdt[group].dirs--;
+	fs->gdt[group].freeInodes++;
+	ext2_gdt_dirty(fs, group);
+
+	if (pos < bmp->first)
+		bmp->first = pos;
+	bmp->flags |= BMP_DIRTY;
+
+	mutexUnlock(bmps->locks[group]);
+
+	ext2_bmp_count(fs, 0, 1);
+
+	return EOK;
+}
+
+
+void ext2_bmp_discard(ext2_t *fs)
+{
+	ext2_bmps_t *bmps = fs->bmps;
+	uint32_t i;
+
+	if (bmps->discard.runs == NULL)
+		return;
+
+	/* Queue stays locked, so queued blocks can't be reallocated before they are discarded */
+	mutexLock(bmps->discard.lock);
+
+	/* Discard is only a hint, runs that failed to discard are dropped */
+	for (i = 0; i < bmps->discard.n; i++)
+		(void)ext2_dev_discard(fs, bmps->discard.runs[i].bno, bmps->discard.runs[i].len);
+	bmps->discard.n = 0;
+
+	mutexUnlock(bmps->discard.lock);
+}
+
+
+int ext2_bmp_trim(ext2_t *fs, uint32_t minlen, uint64_t *trimmed)
+{
+	ext2_bmps_t *bmps = fs->bmps;
+	ext2_bmp_t *bmp;
+	uint32_t i, pos, end;
+	int err = EOK;
+
+	*trimmed = 0;
+
+	if (!minlen)
+		minlen = 1;
+
+	for (i = 0; (i < fs->groups) && (err == EOK); i++) {
+		bmp = bmps->blocks + i;
+
+		/* Counter is checked without the lock first, so groups that can't hold the extent aren't waited for */
+		if (fs->gdt[i].freeBlocks < minlen)
+			continue;
+
+		/* Group stays locked, so free blocks can't be allocated before they are discarded */
+		mutexLock(bmps->locks[i]);
+
+		if ((err = _ext2_bmp_load(fs, bmp, fs->gdt[i].blockBmp)) == EOK) {
+			for (pos = bmp->first; (pos = ext2_bmp_findzero(bmp->data, bmp->size, pos)) < bmp->size; pos = end) {
+				end = ext2_bmp_findset(bmp->data, bmp->size, pos);
+
+				if (end - pos < minlen)
+					continue;
+
+				if ((err = ext2_dev_discard(fs, fs->sb->fstBlock + i * fs->sb->groupBlocks + pos, end - pos)) < 0)
+					break;
+
+				*trimmed += end - pos;
+			}
+		}
+
+		mutexUnlock(bmps->locks[i]);
+	}
+
+	return err;
+}
+
+
+/* Writes back bitmap (requires group to be locked) */
+static int _ext2_bmp_sync(ext2_t *fs, ext2_bmp_t *bmp, uint32_t bno)
+{
+	int err;
+
+	if ((bmp->data == NULL) || !(bmp->flags & BMP_DIRTY))
+		return EOK;
+
+	if ((err = ext2_block_write(fs, bno, bmp->data, 1)) < 0)
+		return err;
+
+	bmp->flags &= ~BMP_DIRTY;
+
+	return EOK;
+}
+
+
+int ext2_bmp_sync(ext2_t *fs)
+{
+	ext2_bmps_t *bmps = fs->bmps;
+	uint32_t i;
+	int err, ret = EOK;
+
+	for (i = 0; i < fs->groups; i++) {
+		mutexLock(bmps->locks[i]);
+
+		if ((err = _ext2_bmp_sync(fs, bmps->blocks + i, fs->gdt[i].blockBmp)) < 0)
+			ret = err;
+
+		if ((err = _ext2_bmp_sync(fs, bmps->inodes + i, fs->gdt[i].inodeBmp)) < 0)
+			ret = err;
+
+		mutexUnlock(bmps->locks[i]);
+	}
+
+	return ret;
+}
+
+
+void ext2_bmp_destroy(ext2_t *fs)
+{
+	ext2_bmps_t *bmps = fs->bmps;
+	uint32_t i;
+
+	ext2_bmp_sync(fs);
+
+	if (bmps->discard.runs != NULL) {
+		/* Freed blocks are discarded once bitmaps get written back */
+		if (bmps->discard.n && (ext2_cache_sync(fs) == EOK))
+			ext2_bmp_discard(fs);
+
+		free(bmps->discard.runs);
+		resourceDestroy(bmps->discard.lock);
+	}
+
+	for (i = 0; i < fs->groups; i++) {
+		free(bmps->blocks[i].data);
+		free(bmps->inodes[i].data);
+		resourceDestroy(bmps->locks[i]);
+	}
+
+	free(bmps->locks);
+	free(bmps->blocks);
+	free(bmps->inodes);
+	free(bmps);
+}
+
+
+int ext2_bmp_init(ext2_t *fs)
+{
+	ext2_bmps_t *bmps;
+	uint32_t i;
+	int err;
+
+	if ((bmps = (ext2_bmps_t *)malloc(sizeof(ext2_bmps_t))) == NULL)
+		return -ENOMEM;
+
+	bmps->blocks = (ext2_bmp_t *)calloc(fs->groups, sizeof(ext2_bmp_t));
+	bmps->inodes = (ext2_bmp_t *)calloc(fs->groups, sizeof(ext2_bmp_t));
+	bmps->locks = (handle_t *)malloc(fs->groups * sizeof(handle_t));
+
+	if ((bmps->blocks == NULL) || (bmps->inodes == NULL) || (bmps->locks == NULL)) {
+		free(bmps->locks);
+		free(bmps->blocks);
+		free(bmps->inodes);
+		free(bmps);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < fs->groups; i++) {
+		if ((err = mutexCreate(&bmps->locks[i])) < 0) {
+			while (i--)
+				resourceDestroy(bmps->locks[i]);
+			free(bmps->locks);
+			free(bmps->blocks);
+			free(bmps->inodes);
+			free(bmps);
+			return err;
+		}
+	}
+
+	bmps->discard.runs = NULL;
+	bmps->discard.n = 0;
+
+	/* Discard is enabled only if the device supports it */
+	if (fs->discard && (fs->strg != NULL) && (fs->strg->dev->blk->ops->erase != NULL)) {
+		if ((bmps->discard.runs = (ext2_run_t *)malloc(DISCARD_RUNS * sizeof(ext2_run_t))) == NULL)
+			err = -ENOMEM;
+		else if ((err = mutexCreate(&bmps->discard.lock)) < 0)
+			free(bmps->discard.runs);
+
+		if (err < 0) {
+			for (i = 0; i < fs->groups; i++)
+				resourceDestroy(bmps->locks[i]);
+			free(bmps->locks);
+			free(bmps->blocks);
+			free(bmps->inodes);
+			free(bmps);
+			return err;
+		}
+	}
+
+	/* Bitmaps are loaded on first use */
+	for (i = 0; i < fs->groups; i++) {
+		bmps->blocks[i].size = fs->sb->groupBlocks;
+		bmps->inodes[i].size = fs->sb->groupInodes;
+	}
+	bmps->blocks[fs->groups - 1].size = fs->sb->blocks - fs->sb->fstBlock - (fs->groups - 1) * fs->sb->groupBlocks;
+
+	fs->bmps = bmps;
+
+	return EOK;
+}
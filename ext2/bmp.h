@@ -0,0 +1,113 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Block and inode bitmaps
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _BMP_H_
+#define _BMP_H_
+
+#include <stdint.h>
+
+#include <sys/types.h>
+
+#include "ext2.h"
+
+
+typedef struct {
+	uint64_t *data;  /* Bitmap data (NULL if not loaded yet) */
+	uint32_t size;   /* Number of bits in use */
+	uint32_t first;  /* First possibly free bit (all bits below are set) */
+	uint32_t maxrun; /* Longest run of free bits */
+	uint8_t flags;   /* Bitmap flags */
+} ext2_bmp_t;
+
+
+/* Run of blocks */
+typedef struct {
+	uint32_t bno;    /* First block */
+	uint32_t len;    /* Number of blocks */
+} ext2_run_t;
+
+
+struct _ext2_bmps_t {
+	ext2_bmp_t *blocks; /* Groups block bitmaps */
+	ext2_bmp_t *inodes; /* Groups inode bitmaps */
+	handle_t *locks;    /* Groups access mutexes (bitmaps and group descriptor counters) */
+	struct {
+		handle_t lock;    /* Discard queue mutex (taken after group mutexes) */
+		ext2_run_t *runs; /* Freed runs waiting for discard, sorted and merged (NULL if discard is disabled) */
+		uint32_t n;       /* Number of queued runs */
+	} discard;          /* Freed blocks discard queue */
+};
+
+
+/* Returns first clear bit at or after pos (size if there is none), bitmap is scanned in 64-bit words */
+extern uint32_t ext2_bmp_findzero(const uint64_t *data, uint32_t size, uint32_t pos);
+
+
+/* Returns first set bit at or after pos (size if there is none) */
+extern uint32_t ext2_bmp_findset(const uint64_t *data, uint32_t size, uint32_t pos);
+
+
+/* Sets (or clears) n bits starting at pos, whole words are filled at once */
+extern void ext2_bmp_fill(uint64_t *data, uint32_t pos, uint32_t n, int set);
+
+
+/* Finds first run of at least n free bits at or after pos, returns its length (0 if there is none) */
+extern uint32_t ext2_bmp_findrun(ext2_bmp_t *bmp, uint32_t pos, uint32_t n, uint32_t *start);
+
+
+/* Allocates up to n consecutive blocks close to the goal block */
+extern int ext2_bmp_balloc(ext2_t *fs, uint32_t goal, uint32_t n, uint32_t *bno, uint32_t *len);
+
+
+/* Allocates n consecutive blocks from the first free extent big enough at or after the goal block (up to n blocks of the longest one if there's none) */
+extern int ext2_bmp_bfit(ext2_t *fs, uint32_t goal, uint32_t n, uint32_t *bno, uint32_t *len);
+
+
+/* Releases blocks */
+extern int ext2_bmp_bfree(ext2_t *fs, uint32_t bno, uint32_t n);
+
+
+/* Releases runs of blocks, runs are sorted and merged in place so each group is updated once */
+extern int ext2_bmp_bfreev(ext2_t *fs, ext2_run_t *runs, uint32_t n);
+
+
+/* Allocates an inode in the group */
+extern int ext2_bmp_ialloc(ext2_t *fs, uint32_t group, uint16_t mode, uint32_t *ino);
+
+
+/* Releases an inode */
+extern int ext2_bmp_ifree(ext2_t *fs, uint32_t ino, uint16_t mode);
+
+
+/* Discards queued freed blocks (bitmaps releasing them should be written back first) */
+extern void ext2_bmp_discard(ext2_t *fs);
+
+
+/* Discards free extents of at least minlen blocks, returns number of discarded blocks in trimmed */
+extern int ext2_bmp_trim(ext2_t *fs, uint32_t minlen, uint64_t *trimmed);
+
+
+/* Writes back dirty bitmaps */
+extern int ext2_bmp_sync(ext2_t *fs);
+
+
+/* Destroys bitmaps */
+extern void ext2_bmp_destroy(ext2_t *fs);
+
+
+/* Initializes bitmaps */
+extern int ext2_bmp_init(ext2_t *fs);
+
+
+#endif
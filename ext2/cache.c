@@ -0,0 +1,490 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Block cache
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/list.h>
+#include <sys/minmax.h>
+#include <sys/threads.h>
+
+#include "block.h"
+#include "cache.h"
+
+
+/* Buffer flags */
+enum {
+	BFLAG_VALID = 0x01, /* Buffer holds block data */
+	BFLAG_DIRTY = 0x02, /* Buffer data differs from the device */
+	BFLAG_BUSY  = 0x04  /* Block is being read into the buffer (without holding cache lock) */
+};
+
+
+/* Finds hashed buffer, including the busy one (requires cache to be locked) */
+static ext2_buf_t *_ext2_cache_lookup(ext2_cache_t *cache, uint32_t bno)
+{
+	ext2_buf_t *buf;
+
+	for (buf = cache->hash[bno & (cache->hashsz - 1)]; buf != NULL; buf = buf->hnext) {
+		if (buf->bno == bno) {
+			return buf;
+		}
+	}
+
+	return NULL;
+}
+
+
+/* Finds cached block, waits for the block being read (requires cache to be locked) */
+static ext2_buf_t *_ext2_cache_find(ext2_cache_t *cache, uint32_t bno)
+{
+	ext2_buf_t *buf;
+
+	while (((buf = _ext2_cache_lookup(cache, bno)) != NULL) && (buf->flags & BFLAG_BUSY))
+		condWait(cache->cond, cache->lock, 0);
+
+	return buf;
+}
+
+
+/* Removes buffer from the hash table (requires cache to be locked) */
+static void _ext2_cache_unhash(ext2_cache_t *cache, ext2_buf_t *buf)
+{
+	ext2_buf_t **prev = &cache->hash[buf->bno & (cache->hashsz - 1)];
+
+	while (*prev != buf) {
+		prev = &(*prev)->hnext;
+	}
+	*prev = buf->hnext;
+	buf->hnext = NULL;
+}
+
+
+/* Marks buffer as the most recently used one (requires cache to be locked) */
+static void _ext2_cache_touch(ext2_cache_t *cache, ext2_buf_t *buf)
+{
+	LIST_REMOVE(&cache->lru, buf);
+	LIST_ADD(&cache->lru, buf);
+}
+
+
+/* Drops buffer data and makes it the first one to reuse (requires cache to be locked) */
+static void _ext2_cache_drop(ext2_cache_t *cache, ext2_buf_t *buf)
+{
+	_ext2_cache_unhash(cache, buf);
+	buf->flags = 0;
+
+	LIST_REMOVE(&cache->lru, buf);
+	LIST_ADD(&cache->lru, buf);
+	cache->lru = buf;
+}
+
+
+/* Writes buffer back to the device (requires cache to be locked) */
+static int _ext2_cache_flush(ext2_t *fs, ext2_buf_t *buf)
+{
+	int err;
+
+	if (buf->flags & BFLAG_DIRTY) {
+		if ((err = ext2_dev_write(fs, buf->bno, buf->data, 1)) < 0)
+			return err;
+
+		buf->flags &= ~BFLAG_DIRTY;
+	}
+
+	return EOK;
+}
+
+
+/* Assigns a buffer to the block, reuses the least recently used one (requires cache to be locked) */
+static int _ext2_cache_alloc(ext2_t *fs, uint32_t bno, ext2_buf_t **res)
+{
+	ext2_cache_t *cache = fs->cache;
+	ext2_buf_t *buf = cache->lru;
+	uint32_t i;
+	int err;
+
+	/* Skip buffers being read */
+	for (i = 0; (i < cache->size) && (buf->flags & BFLAG_BUSY); i++, buf = buf->next);
+
+	if (i == cache->size)
+		return -EBUSY;
+
+	if ((err = _ext2_cache_flush(fs, buf)) < 0)
+		return err;
+
+	if (buf->flags & BFLAG_VALID)
+		_ext2_cache_unhash(cache, buf);
+
+	buf->bno = bno;
+	buf->flags = 0;
+	buf->hnext = cache->hash[bno & (cache->hashsz - 1)];
+	cache->hash[bno & (cache->hashsz - 1)] = buf;
+	_ext2_cache_touch(cache, buf);
+	*res = buf;
+
+	return EOK;
+}
+
+
+int ext2_cache_read(ext2_t *fs, uint32_t bno, void *buff, uint32_t n)
+{
+	ext2_cache_t *cache = fs->cache;
+	ext2_buf_t *buf;
+	uint32_t i, l;
+	int err = EOK;
+
+	if (cache == NULL)
+		return ext2_dev_read(fs, bno, buff, n);
+
+	mutexLock(cache->lock);
+
+	/* Multiple blocks read => read not cached runs directly from the device */
+	if (n != 1) {
+		for (i = 0; i < n; i += l) {
+			if ((buf = _ext2_cache_find(cache, bno + i)) != NULL) {
+				memcpy((char *)buff + i * fs->blocksz, buf->data, fs->blocksz);
+				l = 1;
+				continue;
+			}
+
+			for (l = 1; (i + l < n) && (_ext2_cache_lookup(cache, bno + i + l) == NULL); l++);
+
+			/* Other blocks can be accessed in the meantime */
+			mutexUnlock(cache->lock);
+			err = ext2_dev_read(fs, bno + i, (char *)buff + i * fs->blocksz, l);
+			mutexLock(cache->lock);
+
+			if (err < 0)
+				break;
+		}
+		mutexUnlock(cache->lock);
+
+		return err;
+	}
+
+	if ((buf = _ext2_cache_find(cache, bno)) != NULL) {
+		cache->hits++;
+		_ext2_cache_touch(cache, buf);
+		memcpy(buff, buf->data, fs->blocksz);
+		mutexUnlock(cache->lock);
+
+		return EOK;
+	}
+
+	cache->misses++;
+
+	/* All buffers are being read => bypass the cache */
+	if ((err = _ext2_cache_alloc(fs, bno, &buf)) < 0) {
+		mutexUnlock(cache->lock);
+		return (err == -EBUSY) ? ext2_dev_read(fs, bno, buff, 1) : err;
+	}
+
+	/* Other threads reading the block wait for the buffer, other blocks can be accessed in the meantime */
+	buf->flags = BFLAG_BUSY;
+	mutexUnlock(cache->lock);
+
+	err = ext2_dev_read(fs, bno, buf->data, 1);
+
+	mutexLock(cache->lock);
+
+	if (err < 0) {
+		_ext2_cache_drop(cache, buf);
+	}
+	else {
+		buf->flags = BFLAG_VALID;
+		memcpy(buff, buf->data, fs->blocksz);
+	}
+	condBroadcast(cache->cond);
+
+	mutexUnlock(cache->lock);
+
+	return err;
+}
+
+
+int ext2_cache_write(ext2_t *fs, uint32_t bno, const void *buff, uint32_t n)
+{
+	ext2_cache_t *cache = fs->cache;
+	ext2_buf_t *buf;
+	uint32_t i;
+	int err = EOK;
+
+	if (cache == NULL)
+		return ext2_dev_write(fs, bno, buff, n);
+
+	mutexLock(cache->lock);
+
+	/* Multiple blocks write => write through, keep cached copies up to date */
+	if (n != 1) {
+		if ((err = ext2_dev_write(fs, bno, buff, n)) == EOK) {
+			for (i = 0; i < n; i++) {
+				if ((buf = _ext2_cache_find(cache, bno + i)) != NULL) {
+					memcpy(buf->data, (const char *)buff + i * fs->blocksz, fs->blocksz);
+					buf->flags &= ~BFLAG_DIRTY;
+				}
+			}
+		}
+		mutexUnlock(cache->lock);
+
+		return err;
+	}
+
+	if ((buf = _ext2_cache_find(cache, bno)) != NULL) {
+		_ext2_cache_touch(cache, buf);
+	}
+	else if ((err = _ext2_cache_alloc(fs, bno, &buf)) < 0) {
+		/* All buffers are being read => bypass the cache */
+		if (err == -EBUSY)
+			err = ext2_dev_write(fs, bno, buff, 1);
+		mutexUnlock(cache->lock);
+		return err;
+	}
+
+	/* Synchronous mount => write through */
+	if (fs->sync && ((err = ext2_dev_write(fs, bno, buff, 1)) < 0)) {
+		_ext2_cache_drop(cache, buf);
+		mutexUnlock(cache->lock);
+		return err;
+	}
+
+	memcpy(buf->data, buff, fs->blocksz);
+	buf->flags = (fs->sync) ? BFLAG_VALID : BFLAG_VALID | BFLAG_DIRTY;
+
+	mutexUnlock(cache->lock);
+
+	return EOK;
+}
+
+
+int ext2_cache_prefetch(ext2_t *fs, uint32_t bno, uint32_t n)
+{
+	ext2_cache_t *cache = fs->cache;
+	ext2_buf_t *buf;
+	uint32_t i, l;
+	int err = EOK;
+
+	if ((cache == NULL) || (cache->ra == NULL))
+		return EOK;
+
+	/* Read-ahead buffer is in use by another thread => skip prefetching, it's only a hint */
+	if (mutexTry(cache->ralock) < 0)
+		return EOK;
+
+	mutexLock(cache->lock);
+
+	while (n > 0) {
+		/* Skip already cached blocks (and blocks being read) */
+		if (_ext2_cache_lookup(cache, bno) != NULL) {
+			bno++;
+			n--;
+			continue;
+		}
+
+		for (l = 1; (l < n) && (l < cache->rasz) && (_ext2_cache_lookup(cache, bno + l) == NULL); l++);
+
+		/* Reserve buffers, so the blocks aren't read by other threads in the meantime */
+		for (i = 0; i < l; i++) {
+			if ((err = _ext2_cache_alloc(fs, bno + i, &buf)) < 0)
+				break;
+
+			buf->flags = BFLAG_BUSY;
+		}
+
+		if ((l = i) == 0)
+			break;
+
+		mutexUnlock(cache->lock);
+		err = ext2_dev_read(fs, bno, cache->ra, l);
+		mutexLock(cache->lock);
+
+		for (i = 0; i < l; i++) {
+			buf = _ext2_cache_lookup(cache, bno + i);
+
+			if (err < 0) {
+				_ext2_cache_drop(cache, buf);
+			}
+			else {
+				memcpy(buf->data, (char *)cache->ra + i * fs->blocksz, fs->blocksz);
+				buf->flags = BFLAG_VALID;
+			}
+		}
+		condBroadcast(cache->cond);
+
+		if (err < 0)
+			break;
+
+		cache->prefetched += l;
+		bno += l;
+		n -= l;
+	}
+
+	mutexUnlock(cache->lock);
+	mutexUnlock(cache->ralock);
+
+	/* Running out of buffers isn't an error */
+	return (err == -EBUSY) ? EOK : err;
+}
+
+
+static int ext2_cache_cmp(const void *b1, const void *b2)
+{
+	const ext2_buf_t *buf1 = *(const ext2_buf_t **)b1;
+	const ext2_buf_t *buf2 = *(const ext2_buf_t **)b2;
+
+	if (buf1->bno > buf2->bno)
+		return 1;
+	else if (buf1->bno < buf2->bno)
+		return -1;
+
+	return 0;
+}
+
+
+int ext2_cache_sync(ext2_t *fs)
+{
+	ext2_cache_t *cache = fs->cache;
+	uint32_t i, n = 0;
+	int err, ret = EOK;
+
+	if (cache == NULL)
+		return EOK;
+
+	mutexLock(cache->lock);
+
+	for (i = 0; i < cache->size; i++) {
+		if (cache->bufs[i].flags & BFLAG_DIRTY)
+			cache->dirty[n++] = cache->bufs + i;
+	}
+
+	/* Write back in device order */
+	qsort(cache->dirty, n, sizeof(ext2_buf_t *), ext2_cache_cmp);
+
+	for (i = 0; i < n; i++) {
+		if ((err = _ext2_cache_flush(fs, cache->dirty[i])) < 0)
+			ret = err;
+	}
+
+	mutexUnlock(cache->lock);
+
+	return ret;
+}
+
+
+void ext2_cache_destroy(ext2_t *fs)
+{
+	ext2_cache_t *cache = fs->cache;
+
+	if (cache == NULL)
+		return;
+
+	ext2_cache_sync(fs);
+	resourceDestroy(cache->ralock);
+	resourceDestroy(cache->cond);
+	resourceDestroy(cache->lock);
+	free(cache->ra);
+	free(cache->data);
+	free(cache->bufs);
+	free(cache->dirty);
+	free(cache->hash);
+	free(cache);
+	fs->cache = NULL;
+}
+
+
+int ext2_cache_init(ext2_t *fs)
+{
+	uint32_t i, size = fs->cachesz * 1024 / fs->blocksz;
+	ext2_cache_t *cache;
+	int err;
+
+	fs->cache = NULL;
+
+	/* Cache disabled */
+	if (!size)
+		return EOK;
+
+	if ((cache = (ext2_cache_t *)malloc(sizeof(ext2_cache_t))) == NULL)
+		return -ENOMEM;
+
+	for (cache->hashsz = 1; cache->hashsz < size; cache->hashsz <<= 1);
+
+	cache->size = size;
+	cache->hash = (ext2_buf_t **)calloc(cache->hashsz, sizeof(ext2_buf_t *));
+	cache->dirty = (ext2_buf_t **)malloc(size * sizeof(ext2_buf_t *));
+	cache->bufs = (ext2_buf_t *)calloc(size, sizeof(ext2_buf_t));
+	cache->data = malloc(size * fs->blocksz);
+
+	/* Prefetched blocks shouldn't evict each other */
+	cache->rasz = min(fs->rasz * 1024 / fs->blocksz, size / 4);
+	cache->ra = (cache->rasz) ? malloc(cache->rasz * fs->blocksz) : NULL;
+
+	if ((cache->hash == NULL) || (cache->dirty == NULL) || (cache->bufs == NULL) || (cache->data == NULL) || (cache->rasz && (cache->ra == NULL))) {
+		free(cache->ra);
+		free(cache->data);
+		free(cache->bufs);
+		free(cache->dirty);
+		free(cache->hash);
+		free(cache);
+		return -ENOMEM;
+	}
+
+	if ((err = mutexCreate(&cache->lock)) < 0) {
+		free(cache->ra);
+		free(cache->data);
+		free(cache->bufs);
+		free(cache->dirty);
+		free(cache->hash);
+		free(cache);
+		return err;
+	}
+
+	if ((err = condCreate(&cache->cond)) < 0) {
+		resourceDestroy(cache->lock);
+		free(cache->ra);
+		free(cache->data);
+		free(cache->bufs);
+		free(cache->dirty);
+		free(cache->hash);
+		free(cache);
+		return err;
+	}
+
+	if ((err = mutexCreate(&cache->ralock)) < 0) {
+		resourceDestroy(cache->cond);
+		resourceDestroy(cache->lock);
+		free(cache->ra);
+		free(cache->data);
+		free(cache->bufs);
+		free(cache->dirty);
+		free(cache->hash);
+		free(cache);
+		return err;
+	}
+
+	cache->lru = NULL;
+	cache->hits = 0;
+	cache->misses = 0;
+	cache->prefetched = 0;
+
+	for (i = 0; i < size; i++) {
+		cache->bufs[i].data = (char *)cache->data + i * fs->blocksz;
+		LIST_ADD(&cache->lru, cache->bufs + i);
+	}
+
+	fs->cache = cache;
+
+	return EOK;
+}
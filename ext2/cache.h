@@ -0,0 +1,84 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Block cache
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include <stdint.h>
+
+#include <sys/types.h>
+
+#include "ext2.h"
+
+
+typedef struct _ext2_buf_t ext2_buf_t;
+
+
+struct _ext2_buf_t {
+	uint32_t bno;            /* Block number */
+	uint8_t flags;           /* Buffer flags */
+	void *data;              /* Block data */
+	ext2_buf_t *hnext;       /* Hash chain */
+	ext2_buf_t *prev, *next; /* LRU list */
+};
+
+
+struct _ext2_cache_t {
+	uint32_t size;           /* Number of buffers */
+	uint32_t hashsz;         /* Hash table size (power of 2) */
+	ext2_buf_t **hash;       /* Buffers hash table */
+	ext2_buf_t **dirty;      /* Dirty buffers (used during synchronization) */
+	ext2_buf_t *lru;         /* Buffers LRU list (head is the least recently used one) */
+	ext2_buf_t *bufs;        /* Buffers */
+	void *data;              /* Buffers data */
+	uint32_t rasz;           /* Max number of blocks prefetched at once */
+	void *ra;                /* Read-ahead buffer */
+
+	/* Statistics */
+	uint32_t hits;           /* Number of cache hits */
+	uint32_t misses;         /* Number of cache misses */
+	uint32_t prefetched;     /* Number of prefetched blocks */
+
+	/* Synchronization */
+	handle_t lock;           /* Access mutex */
+	handle_t cond;           /* Buffer read completion condition */
+	handle_t ralock;         /* Read-ahead buffer mutex */
+};
+
+
+/* Reads blocks through the cache */
+extern int ext2_cache_read(ext2_t *fs, uint32_t bno, void *buff, uint32_t n);
+
+
+/* Writes blocks through the cache */
+extern int ext2_cache_write(ext2_t *fs, uint32_t bno, const void *buff, uint32_t n);
+
+
+/* Reads not cached blocks ahead into the cache with as few device requests as possible */
+extern int ext2_cache_prefetch(ext2_t *fs, uint32_t bno, uint32_t n);
+
+
+/* Writes back dirty blocks */
+extern int ext2_cache_sync(ext2_t *fs);
+
+
+/* Destroys block cache */
+extern void ext2_cache_destroy(ext2_t *fs);
+
+
+/* Initializes block cache */
+extern int ext2_cache_init(ext2_t *fs);
+
+
+#endif
@@ -0,0 +1,207 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Directory entries cache
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/list.h>
+#include <sys/threads.h>
+
+#include "dcache.h"
+
+
+/* Calculates entry hash (FNV-1a) */
+static uint32_t ext2_dcache_hash(uint32_t pino, const char *name, size_t len)
+{
+	uint32_t hash = 2166136261u ^ pino;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+
+	return hash;
+}
+
+
+/* Finds cached entry (requires cache to be locked) */
+static ext2_dentry_t *_ext2_dcache_find(ext2_dcache_t *dcache, uint32_t hash, uint32_t pino, const char *name, size_t len)
+{
+	ext2_dentry_t *entry;
+
+	for (entry = dcache->hash[hash & (dcache->hashsz - 1)]; entry != NULL; entry = entry->hnext) {
+		if ((entry->pino == pino) && (entry->len == len) && !memcmp(entry->name, name, len))
+			return entry;
+	}
+
+	return NULL;
+}
+
+
+/* Removes entry from the hash table and makes it the first one to reuse (requires cache to be locked) */
+static void _ext2_dcache_drop(ext2_dcache_t *dcache, ext2_dentry_t *entry)
+{
+	ext2_dentry_t **prev = &dcache->hash[ext2_dcache_hash(entry->pino, entry->name, entry->len) & (dcache->hashsz - 1)];
+
+	while (*prev != entry)
+		prev = &(*prev)->hnext;
+	*prev = entry->hnext;
+	entry->hnext = NULL;
+	entry->len = 0;
+
+	LIST_REMOVE(&dcache->lru, entry);
+	LIST_ADD(&dcache->lru, entry);
+	dcache->lru = entry;
+}
+
+
+int ext2_dcache_lookup(ext2_t *fs, uint32_t pino, const char *name, size_t len, uint32_t *ino)
+{
+	ext2_dcache_t *dcache = fs->dcache;
+	ext2_dentry_t *entry;
+
+	if ((dcache == NULL) || (len > DCACHE_NAMELEN))
+		return 0;
+
+	mutexLock(dcache->lock);
+
+	if ((entry = _ext2_dcache_find(dcache, ext2_dcache_hash(pino, name, len), pino, name, len)) == NULL) {
+		dcache->misses++;
+		mutexUnlock(dcache->lock);
+		return 0;
+	}
+
+	dcache->hits++;
+	*ino = entry->ino;
+	LIST_REMOVE(&dcache->lru, entry);
+	LIST_ADD(&dcache->lru, entry);
+
+	mutexUnlock(dcache->lock);
+
+	return 1;
+}
+
+
+void ext2_dcache_add(ext2_t *fs, uint32_t pino, const char *name, size_t len, uint32_t ino)
+{
+	ext2_dcache_t *dcache = fs->dcache;
+	ext2_dentry_t *entry;
+	uint32_t hash;
+
+	if ((dcache == NULL) || (len > DCACHE_NAMELEN))
+		return;
+
+	hash = ext2_dcache_hash(pino, name, len);
+
+	mutexLock(dcache->lock);
+
+	/* Reuse the least recently used entry */
+	if ((entry = _ext2_dcache_find(dcache, hash, pino, name, len)) == NULL) {
+		entry = dcache->lru;
+		if (entry->len)
+			_ext2_dcache_drop(dcache, entry);
+
+		entry->pino = pino;
+		entry->len = len;
+		memcpy(entry->name, name, len);
+		entry->hnext = dcache->hash[hash & (dcache->hashsz - 1)];
+		dcache->hash[hash & (dcache->hashsz - 1)] = entry;
+	}
+
+	entry->ino = ino;
+	LIST_REMOVE(&dcache->lru, entry);
+	LIST_ADD(&dcache->lru, entry);
+
+	mutexUnlock(dcache->lock);
+}
+
+
+void ext2_dcache_remove(ext2_t *fs, uint32_t pino, const char *name, size_t len)
+{
+	ext2_dcache_t *dcache = fs->dcache;
+	ext2_dentry_t *entry;
+
+	if ((dcache == NULL) || (len > DCACHE_NAMELEN))
+		return;
+
+	mutexLock(dcache->lock);
+
+	if ((entry = _ext2_dcache_find(dcache, ext2_dcache_hash(pino, name, len), pino, name, len)) != NULL)
+		_ext2_dcache_drop(dcache, entry);
+
+	mutexUnlock(dcache->lock);
+}
+
+
+void ext2_dcache_destroy(ext2_t *fs)
+{
+	ext2_dcache_t *dcache = fs->dcache;
+
+	if (dcache == NULL)
+		return;
+
+	resourceDestroy(dcache->lock);
+	free(dcache->entries);
+	free(dcache->hash);
+	free(dcache);
+	fs->dcache = NULL;
+}
+
+
+int ext2_dcache_init(ext2_t *fs)
+{
+	ext2_dcache_t *dcache;
+	uint32_t i;
+	int err;
+
+	fs->dcache = NULL;
+
+	/* Cache disabled */
+	if (!fs->dcachesz)
+		return EOK;
+
+	if ((dcache = (ext2_dcache_t *)malloc(sizeof(ext2_dcache_t))) == NULL)
+		return -ENOMEM;
+
+	for (dcache->hashsz = 1; dcache->hashsz < fs->dcachesz; dcache->hashsz <<= 1);
+
+	dcache->size = fs->dcachesz;
+	dcache->hash = (ext2_dentry_t **)calloc(dcache->hashsz, sizeof(ext2_dentry_t *));
+	dcache->entries = (ext2_dentry_t *)calloc(dcache->size, sizeof(ext2_dentry_t));
+
+	if ((dcache->hash == NULL) || (dcache->entries == NULL)) {
+		free(dcache->entries);
+		free(dcache->hash);
+		free(dcache);
+		return -ENOMEM;
+	}
+
+	if ((err = mutexCreate(&dcache->lock)) < 0) {
+		free(dcache->entries);
+		free(dcache->hash);
+		free(dcache);
+		return err;
+	}
+
+	dcache->lru = NULL;
+	dcache->hits = 0;
+	dcache->misses = 0;
+
+	for (i = 0; i < dcache->size; i++)
+		LIST_ADD(&dcache->lru, dcache->entries + i);
+
+	fs->dcache = dcache;
+
+	return EOK;
+}
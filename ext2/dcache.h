@@ -0,0 +1,78 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Directory entries cache
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _DCACHE_H_
+#define _DCACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sys/types.h>
+
+#include "ext2.h"
+
+
+#define DCACHE_NAMELEN 40 /* Max cached name length (longer names aren't cached) */
+
+
+typedef struct _ext2_dentry_t ext2_dentry_t;
+
+
+struct _ext2_dentry_t {
+	uint32_t pino;                 /* Parent directory inode number */
+	uint32_t ino;                  /* Entry inode number (0 for negative entry) */
+	uint8_t len;                   /* Entry name length (0 for unused entry) */
+	char name[DCACHE_NAMELEN];     /* Entry name */
+	ext2_dentry_t *hnext;          /* Hash chain */
+	ext2_dentry_t *prev, *next;    /* LRU list */
+};
+
+
+struct _ext2_dcache_t {
+	uint32_t size;                 /* Number of entries */
+	uint32_t hashsz;               /* Hash table size (power of 2) */
+	ext2_dentry_t **hash;          /* Entries hash table */
+	ext2_dentry_t *lru;            /* Entries LRU list (head is the least recently used one) */
+	ext2_dentry_t *entries;        /* Entries */
+
+	/* Statistics */
+	uint32_t hits;                 /* Number of cache hits */
+	uint32_t misses;               /* Number of cache misses */
+
+	/* Synchronization */
+	handle_t lock;                 /* Access mutex */
+};
+
+
+/* Looks up cached directory entry, returns 1 and inode number (0 for negative entry) if found */
+extern int ext2_dcache_lookup(ext2_t *fs, uint32_t pino, const char *name, size_t len, uint32_t *ino);
+
+
+/* Caches directory entry (0 inode number caches negative entry) */
+extern void ext2_dcache_add(ext2_t *fs, uint32_t pino, const char *name, size_t len, uint32_t ino);
+
+
+/* Invalidates cached directory entry */
+extern void ext2_dcache_remove(ext2_t *fs, uint32_t pino, const char *name, size_t len);
+
+
+/* Destroys directory entries cache */
+extern void ext2_dcache_destroy(ext2_t *fs);
+
+
+/* Initializes directory entries cache */
+extern int ext2_dcache_init(ext2_t *fs);
+
+
+#endif
@@ -19,52 +19,53 @@
 #include <time.h>
 
 #include <sys/stat.h>
+#include <sys/threads.h>
 
 #include "block.h"
+#include "dcache.h"
 #include "dir.h"
 #include "file.h"
+#include "htree.h"
+#include "libext2.h"
 
 
 int _ext2_dir_empty(ext2_t *fs, ext2_obj_t *dir)
 {
 	ext2_dirent_t *entry;
-	uint32_t offs = 0;
+	uint32_t boffs, offs;
 	ssize_t ret;
 	char *buff;
+	int err = 1;
 
-	if (!dir->inode->size)
-		return EOK;
-
-	if (dir->inode->size > fs->blocksz)
-		return -EBUSY;
-
-	if ((buff = (char *)malloc(fs->blocksz)) == NULL)
+	if ((buff = (char *)ext2_pool_get(fs)) == NULL)
 		return -ENOMEM;
 
-	if ((ret = _ext2_file_read(fs, dir, offs, buff, fs->blocksz)) != fs->blocksz) {
-		free(buff);
-		return (ret < 0) ? (int)ret : -EINVAL;
-	}
+	for (boffs = 0; (err > 0) && (boffs < dir->inode->size); boffs += fs->blocksz) {
+		if ((ret = _ext2_file_read(fs, dir, boffs, buff, fs->blocksz)) != fs->blocksz) {
+			err = (ret < 0) ? (int)ret : -EINVAL;
+			break;
+		}
+
+		for (offs = 0; offs < fs->blocksz; offs += entry->size) {
+			entry = (ext2_dirent_t *)(buff + offs);
 
-	entry = (ext2_dirent_t *)buff;
+			if (!entry->size)
+				break;
 
-	if ((entry->len != 1) || strncmp(entry->name, ".", 1)) {
-		free(buff);
-		return -EINVAL;
-	}
+			if (!entry->ino)
+				continue;
 
-	offs += entry->size;
-	entry = (ext2_dirent_t *)(buff + offs);
+			if (((entry->len == 1) && !strncmp(entry->name, ".", 1)) || ((entry->len == 2) && !strncmp(entry->name, "..", 2)))
+				continue;
 
-	if ((entry->len != 2) || strncmp(entry->name, "..", 2)) {
-		free(buff);
-		return -EINVAL;
+			err = 0;
+			break;
+		}
 	}
 
-	offs += entry->size;
-	free(buff);
+	ext2_pool_put(fs, buff);
 
-	return (offs == fs->blocksz);
+	return err;
 }
 
 
@@ -73,6 +74,10 @@ static int _ext2_dir_find(ext2_t *fs, ext2_obj_t *dir, const char *name, size_t
 	ext2_dirent_t *entry;
 	uint32_t boffs;
 	ssize_t ret;
+	int err;
+
+	if (ext2_htree_indexed(fs, dir) && ((err = _ext2_htree_find(fs, dir, name, len, buff, offs)) != -EAGAIN))
+		return err;
 
 	for (boffs = *offs; boffs < dir->inode->size; boffs += fs->blocksz) {
 		if ((ret = _ext2_file_read(fs, dir, boffs, buff, fs->blocksz)) != fs->blocksz)
@@ -84,7 +89,7 @@ static int _ext2_dir_find(ext2_t *fs, ext2_obj_t *dir, const char *name, size_t
 			if (!entry->size)
 				break;
 
-			if (((size_t)entry->len == len) && !strncmp(entry->name, name, len))
+			if (entry->ino && ((size_t)entry->len == len) && !strncmp(entry->name, name, len))
 				return boffs;
 		}
 	}
@@ -95,105 +100,229 @@ static int _ext2_dir_find(ext2_t *fs, ext2_obj_t *dir, const char *name, size_t
 
 int _ext2_dir_search(ext2_t *fs, ext2_obj_t *dir, const char *name, size_t len, id_t *res)
 {
-	uint32_t offs = 0;
+	uint32_t ino, offs = 0;
 	char *buff;
 	int err;
 
-	if ((buff = (char *)malloc(fs->blocksz)) == NULL)
+	if (ext2_dcache_lookup(fs, dir->id, name, len, &ino)) {
+		if (!ino)
+			return -ENOENT;
+
+		*res = ino;
+		return EOK;
+	}
+
+	if ((buff = (char *)ext2_pool_get(fs)) == NULL)
 		return -ENOMEM;
 
 	do {
-		if ((err = _ext2_dir_find(fs, dir, name, len, buff, &offs)) < 0)
+		if ((err = _ext2_dir_find(fs, dir, name, len, buff, &offs)) < 0) {
+			/* Remember the name doesn't exist */
+			if (err == -ENOENT)
+				ext2_dcache_add(fs, dir->id, name, len, 0);
 			break;
+		}
 
 		*res = ((ext2_dirent_t *)(buff + offs))->ino;
+		ext2_dcache_add(fs, dir->id, name, len, *res);
+		err = EOK;
 	} while (0);
 
-	free(buff);
+	ext2_pool_put(fs, buff);
 
 	return err;
 }
 
 
-int _ext2_dir_read(ext2_t *fs, ext2_obj_t *dir, off_t offs, struct dirent *res, size_t len)
+/* Returns dirent type of directory entry type */
+static unsigned char ext2_dir_dtype(uint8_t type)
+{
+	switch (type) {
+		case DIRENT_DIR:
+			return DT_DIR;
+
+		case DIRENT_CHRDEV:
+			return DT_CHR;
+
+		case DIRENT_BLKDEV:
+			return DT_BLK;
+
+		default:
+			return DT_REG;
+	}
+}
+
+
+/* Returns directory block kept cached between reads, the directory rlock is held on success (requires object to be locked, at least for reading) */
+static int _ext2_dir_block(ext2_t *fs, ext2_obj_t *dir, uint32_t block, char **data)
 {
-	ext2_dirent_t *entry;
 	ssize_t ret;
+	char *buff;
 
-	if (!dir->inode->size || !dir->inode->links)
-		return -ENOENT;
+	mutexLock(dir->rlock);
 
-	if (len < sizeof(ext2_dirent_t))
-		return -EINVAL;
+	if (!dir->dir.cached || (dir->dir.block != block)) {
+		mutexUnlock(dir->rlock);
 
-	if ((entry = (ext2_dirent_t *)malloc(len)) == NULL)
-		return -ENOMEM;
+		if ((buff = (char *)ext2_pool_get(fs)) == NULL)
+			return -ENOMEM;
+
+		if ((ret = _ext2_file_read(fs, dir, (off_t)block * fs->blocksz, buff, fs->blocksz)) != fs->blocksz) {
+			ext2_pool_put(fs, buff);
+			return (ret < 0) ? (int)ret : -ENOENT;
+		}
 
-	ret = _ext2_file_read(fs, dir, offs, (char *)entry, len);
+		mutexLock(dir->rlock);
 
-	if (ret < (ssize_t)sizeof(ext2_dirent_t)) {
-		free(entry);
-		return (ret < 0) ? (int)ret : -ENOENT;
-	}
+		if ((dir->dir.data == NULL) && ((dir->dir.data = malloc(fs->blocksz)) == NULL)) {
+			mutexUnlock(dir->rlock);
+			ext2_pool_put(fs, buff);
+			return -ENOMEM;
+		}
 
-	if (ret < (ssize_t)(sizeof(ext2_dirent_t) + entry->len)) {
-		free(entry);
-		return -ENOENT;
+		memcpy(dir->dir.data, buff, fs->blocksz);
+		dir->dir.block = block;
+		dir->dir.cached = 1;
+		ext2_pool_put(fs, buff);
 	}
 
-	if (!entry->len) {
-		free(entry);
+	*data = dir->dir.data;
+
+	return EOK;
+}
+
+
+int _ext2_dir_read(ext2_t *fs, ext2_obj_t *dir, off_t offs, struct dirent *res, size_t len, int packed)
+{
+	int done = 0, err = EOK;
+	struct dirent *dent = res;
+	ext2_dirent_t *entry;
+	off_t prev = offs, start = offs;
+	char *data = NULL;
+	uint32_t boffs;
+	size_t n = 0;
+
+	if (!dir->inode->size || !dir->inode->links)
 		return -ENOENT;
-	}
 
-	if (len <= entry->len + sizeof(struct dirent)) {
-		free(entry);
+	if (len < sizeof(ext2_dirent_t))
 		return -EINVAL;
-	}
 
-	switch (entry->type) {
-		case DIRENT_DIR:
-			res->d_type = DT_DIR;
+	while (!done && (offs < dir->inode->size)) {
+		if ((err = _ext2_dir_block(fs, dir, offs / fs->blocksz, &data)) < 0)
 			break;
 
-		case DIRENT_CHRDEV:
-			res->d_type = DT_CHR;
-			break;
+		for (boffs = offs % fs->blocksz; boffs < fs->blocksz; boffs += entry->size, offs += entry->size) {
+			entry = (ext2_dirent_t *)(data + boffs);
 
-		case DIRENT_BLKDEV:
-			res->d_type = DT_BLK;
-			break;
+			if ((boffs + sizeof(ext2_dirent_t) > fs->blocksz) || !entry->size ||
+				(boffs + entry->size > fs->blocksz) || (entry->size < sizeof(ext2_dirent_t) + entry->len)) {
+				err = -ENOENT;
+				break;
+			}
 
-		default:
-			res->d_type = DT_REG;
+			/* Skip unused entries (removed entries and index nodes) */
+			if (!entry->ino)
+				continue;
+
+			if (!entry->len) {
+				err = -ENOENT;
+				break;
+			}
+
+			if (!n) {
+				if (len <= entry->len + sizeof(struct dirent)) {
+					err = -EINVAL;
+					break;
+				}
+			}
+			else if (!packed || (n + LIBEXT2_DIRENT_SIZE(entry->len) > len)) {
+				done = 1;
+				break;
+			}
+
+			/* Entry record length spans the skipped unused entries preceding it */
+			dent = (struct dirent *)((char *)res + n);
+			dent->d_type = ext2_dir_dtype(entry->type);
+			dent->d_ino = entry->ino;
+			dent->d_reclen = offs + entry->size - prev;
+			dent->d_namlen = entry->len;
+			memcpy(dent->d_name, entry->name, entry->len);
+			dent->d_name[entry->len] = '\0';
+
+			n += LIBEXT2_DIRENT_SIZE(entry->len);
+			prev = offs + entry->size;
+
+			if (!packed) {
+				done = 1;
+				break;
+			}
+		}
+
+		mutexUnlock(dir->rlock);
+
+		if (err < 0)
 			break;
 	}
 
-	res->d_ino = entry->ino;
-	res->d_reclen = entry->size;
-	res->d_namlen = entry->len;
-	memcpy(res->d_name, entry->name, entry->len);
-	res->d_name[entry->len] = '\0';
-	free(entry);
+	if (!n) {
+		/* Listing is complete, release the cached block */
+		if (err == EOK) {
+			mutexLock(dir->rlock);
+			free(dir->dir.data);
+			dir->dir.data = NULL;
+			dir->dir.cached = 0;
+			mutexUnlock(dir->rlock);
+		}
 
-	dir->inode->atime = time(NULL);
+		return (err < 0) ? err : -ENOENT;
+	}
 
-	return res->d_reclen;
+	/* Errors past the returned entries are reported by the next read */
+
+	ext2_obj_atime(fs, dir);
+
+	return (int)(prev - start);
 }
 
 
-int _ext2_dir_add(ext2_t *fs, ext2_obj_t *dir, const char *name, size_t len, uint16_t mode, uint32_t ino)
+/* Returns directory entry type */
+static uint8_t ext2_dir_type(uint16_t mode)
+{
+	if (S_ISDIR(mode))
+		return DIRENT_DIR;
+	else if (S_ISCHR(mode))
+		return DIRENT_CHRDEV;
+	else if (S_ISBLK(mode))
+		return DIRENT_BLKDEV;
+	else if (S_ISFIFO(mode))
+		return DIRENT_FIFO;
+	else if (S_ISSOCK(mode))
+		return DIRENT_SOCK;
+	else if (S_ISREG(mode))
+		return DIRENT_FILE;
+
+	return DIRENT_UNKNOWN;
+}
+
+
+/* Adds directory entry to the directory blocks */
+static int _ext2_dir_insert(ext2_t *fs, ext2_obj_t *dir, const char *name, size_t len, uint16_t mode, uint32_t ino)
 {
 	uint32_t offs, size = 0;
 	ext2_dirent_t *entry;
 	char *buff;
 	ssize_t ret;
+	int err;
 
 	if (len > MAX_NAMELEN) {
 		return -ENAMETOOLONG;
 	}
 
-	if ((buff = (char *)malloc(fs->blocksz)) == NULL)
+	if (ext2_htree_indexed(fs, dir) && ((err = _ext2_htree_add(fs, dir, name, len, ext2_dir_type(mode), ino)) != -EAGAIN))
+		return err;
+
+	if ((buff = (char *)ext2_pool_get(fs)) == NULL)
 		return -ENOMEM;
 
 	if (!dir->inode->size) {
@@ -201,7 +330,7 @@ int _ext2_dir_add(ext2_t *fs, ext2_obj_t *dir, const char *name, size_t len, uin
 	}
 	else {
 		if ((ret = _ext2_file_read(fs, dir, dir->inode->size - fs->blocksz, buff, fs->blocksz)) != fs->blocksz) {
-			free(buff);
+			ext2_pool_put(fs, buff);
 			return (ret < 0) ? (int)ret : -EINVAL;
 		}
 
@@ -230,6 +359,12 @@ int _ext2_dir_add(ext2_t *fs, ext2_obj_t *dir, const char *name, size_t len, uin
 
 	/* No space in this block => alloc new one */
 	if (offs >= fs->blocksz) {
+		/* Directory grows past the threshold => index it instead (stays linear on failure) */
+		if (ext2_htree_indexable(fs, dir) && (_ext2_htree_build(fs, dir) == EOK)) {
+			ext2_pool_put(fs, buff);
+			return _ext2_htree_add(fs, dir, name, len, ext2_dir_type(mode), ino);
+		}
+
 		dir->inode->size += fs->blocksz;
 		memset(buff, 0, fs->blocksz);
 		size = fs->blocksz;
@@ -242,29 +377,31 @@ int _ext2_dir_add(ext2_t *fs, ext2_obj_t *dir, const char *name, size_t len, uin
 	entry->len = len;
 	memcpy(entry->name, name, len);
 
-	if (S_ISDIR(mode))
-		entry->type = DIRENT_DIR;
-	else if (S_ISCHR(mode))
-		entry->type = DIRENT_CHRDEV;
-	else if (S_ISBLK(mode))
-		entry->type = DIRENT_BLKDEV;
-	else if (S_ISFIFO(mode))
-		entry->type = DIRENT_FIFO;
-	else if (S_ISSOCK(mode))
-		entry->type = DIRENT_SOCK;
-	else if (S_ISREG(mode))
-		entry->type = DIRENT_FILE;
-	else
-		entry->type = DIRENT_UNKNOWN;
+	entry->type = ext2_dir_type(mode);
 
 	offs = (dir->inode->size > fs->blocksz) ? dir->inode->size - fs->blocksz : 0;
 
 	if ((ret = _ext2_file_write(fs, dir, offs, buff, fs->blocksz)) != fs->blocksz) {
-		free(buff);
+		ext2_pool_put(fs, buff);
 		return (ret < 0) ? (int)ret : -EINVAL;
 	}
 
-	free(buff);
+	ext2_pool_put(fs, buff);
+
+	return EOK;
+}
+
+
+int _ext2_dir_add(ext2_t *fs, ext2_obj_t *dir, const char *name, size_t len, uint16_t mode, uint32_t ino)
+{
+	int err;
+
+	if ((err = _ext2_dir_insert(fs, dir, name, len, mode, ino)) < 0) {
+		ext2_dcache_remove(fs, dir->id, name, len);
+		return err;
+	}
+
+	ext2_dcache_add(fs, dir->id, name, len, ino);
 
 	return EOK;
 }
@@ -278,19 +415,28 @@ int _ext2_dir_remove(ext2_t *fs, ext2_obj_t *dir, const char *name, size_t len)
 	char *buff;
 	int err;
 
-	if ((buff = (char *)malloc(fs->blocksz)) == NULL)
+	if ((buff = (char *)ext2_pool_get(fs)) == NULL)
 		return -ENOMEM;
 
 	if ((err = _ext2_dir_find(fs, dir, name, len, buff, &offs)) < 0) {
-		free(buff);
+		ext2_pool_put(fs, buff);
 		return err;
 	}
 
 	entry = (ext2_dirent_t *)(buff + offs);
 	boffs = err;
 
+	/* Indexed directory entry at the start of the block => mark it unused, index blocks can't be moved */
+	if (!offs && (dir->inode->flags & IFLAG_INDEX)) {
+		entry->ino = 0;
+
+		if ((ret = _ext2_file_write(fs, dir, boffs, buff, fs->blocksz)) != fs->blocksz)
+			err = (ret < 0) ? (int)ret : -EINVAL;
+		else
+			err = EOK;
+	}
 	/* Entry in the middle of the block => expand previous entry size */
-	if (offs) {
+	else if (offs) {
 		for (prev = 0, tmp = (ext2_dirent_t *)buff; prev + tmp->size < offs;) {
 			prev += tmp->size;
 			tmp = (ext2_dirent_t *)(buff + prev);
@@ -311,7 +457,7 @@ int _ext2_dir_remove(ext2_t *fs, ext2_obj_t *dir, const char *name, size_t len)
 		/* Middle block => copy last block and truncate */
 		else {
 			do {
-				if ((err = ext2_block_init(fs, dir, dir->inode->size / fs->blocksz - 1, buff)) < 0)
+				if ((err = ext2_block_init(fs, dir, dir->inode->size / fs->blocksz - 1, buff, 1)) < 0)
 					break;
 
 				if ((err = ext2_block_syncone(fs, dir, boffs / fs->blocksz, buff)) < 0)
@@ -336,7 +482,12 @@ int _ext2_dir_remove(ext2_t *fs, ext2_obj_t *dir, const char *name, size_t len)
 			err = EOK;
 	}
 
-	free(buff);
+	ext2_pool_put(fs, buff);
+
+	if (err < 0)
+		ext2_dcache_remove(fs, dir->id, name, len);
+	else
+		ext2_dcache_add(fs, dir->id, name, len, 0);
 
 	return err;
 }
@@ -47,16 +47,16 @@ typedef struct {
 } ext2_dirent_t;
 
 
-/* Checks if directory is empty (requires object to be locked) */
+/* Checks if directory is empty, returns 1 if it is (requires object to be locked) */
 extern int _ext2_dir_empty(ext2_t *fs, ext2_obj_t *dir);
 
 
-/* Searches directory for a given file name (requires object to be locked) */
+/* Searches directory for a given file name (requires object to be locked, at least for reading) */
 extern int _ext2_dir_search(ext2_t *fs, ext2_obj_t *dir, const char *name, size_t len, id_t *res);
 
 
-/* Reads directory entry (requires object to be locked) */
-extern int _ext2_dir_read(ext2_t *fs, ext2_obj_t *dir, off_t offs, struct dirent *res, size_t len);
+/* Reads directory entry, packed read returns as many entries as fit (requires object to be locked, at least for reading) */
+extern int _ext2_dir_read(ext2_t *fs, ext2_obj_t *dir, off_t offs, struct dirent *res, size_t len, int packed);
 
 
 /* Adds directory entry (requires object to be locked) */
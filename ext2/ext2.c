@@ -24,8 +24,10 @@
 #include <sys/statvfs.h>
 #include <sys/threads.h>
 
+#include "block.h"
 #include "dir.h"
 #include "ext2.h"
+#include "extent.h"
 #include "file.h"
 
 
@@ -34,11 +36,21 @@ int ext2_create(ext2_t *fs, id_t id, const char *name, size_t len, oid_t *dev, u
 	ext2_obj_t *obj;
 	int err;
 
-	if ((err = ext2_obj_create(fs, (uint32_t)id, NULL, mode, &obj)) < 0)
+	if (fs->rdonly)
+		return -EROFS;
+
+	if ((err = ext2_obj_create(fs, (uint32_t)id, mode, &obj)) < 0)
 		return err;
 
+	/* Release blocks of partially created object before destroying its inode */
 	if ((err = ext2_link(fs, id, name, len, obj->id)) < 0) {
-		(void)ext2_obj_destroy(fs, obj);
+		if (!obj->inode->links) {
+			(void)ext2_obj_truncate(fs, obj, 0);
+			(void)ext2_obj_destroy(fs, obj);
+		}
+		else {
+			ext2_obj_put(fs, obj);
+		}
 		return err;
 	}
 
@@ -59,8 +71,11 @@ int ext2_destroy(ext2_t *fs, id_t id)
 	ext2_obj_t *obj;
 	int err;
 
-	if ((obj = ext2_obj_get(fs, id)) == NULL)
-		return -EINVAL;
+	if (fs->rdonly)
+		return -EROFS;
+
+	if ((err = ext2_obj_get(fs, id, &obj)) < 0)
+		return err;
 
 	do {
 		if ((err = ext2_obj_sync(fs, obj)) < 0)
@@ -82,18 +97,18 @@ int ext2_lookup(ext2_t *fs, id_t id, const char *name, size_t len, oid_t *res, o
 {
 	ext2_obj_t *dir, *obj = NULL;
 	size_t i, j;
-	int err;
+	int err, stale;
 
 	res->port = fs->port;
 	if ((len == 0) || (name == NULL)) {
 		return -EINVAL;
 	}
 
-	if ((dir = ext2_obj_get(fs, id)) == NULL) {
-		return -ENOENT;
+	if ((err = ext2_obj_get(fs, id, &dir)) < 0) {
+		return err;
 	}
 
-	mutexLock(dir->lock);
+	ext2_obj_rdlock(dir);
 	for (i = 0, j = 0; i < len; i = j + 1, dir = obj) {
 		while ((i < len) && (name[i] == '/')) {
 			i++;
@@ -105,6 +120,8 @@ int ext2_lookup(ext2_t *fs, id_t id, const char *name, size_t len, oid_t *res, o
 			j++;
 		}
 
+		stale = 0;
+
 		do {
 			if (i >= len) {
 				err = -ENOENT;
@@ -121,22 +138,38 @@ int ext2_lookup(ext2_t *fs, id_t id, const char *name, size_t len, oid_t *res, o
 				break;
 			}
 
-			obj = ext2_obj_get(fs, res->id);
-			if (obj == NULL) {
-				_ext2_dir_remove(fs, dir, name + i, j - i);
-				err = -ENOENT;
+			err = ext2_obj_get(fs, res->id, &obj);
+			if (err < 0) {
+				/* Entry of invalid inode is dangling, other errors (e.g. all objects in use) are passed on */
+				if (err == -EINVAL) {
+					stale = 1;
+					err = -ENOENT;
+				}
 				break;
 			}
 		} while (0);
 
-		mutexUnlock(dir->lock);
+		ext2_obj_unlock(dir);
+
+		/* Remove dangling entry, it requires the directory to be locked for writing */
+		if (stale) {
+			obj = NULL;
+			ext2_obj_lock(dir);
+			if ((_ext2_dir_search(fs, dir, name + i, j - i, &res->id) == EOK) && (ext2_obj_get(fs, res->id, &obj) == -EINVAL))
+				_ext2_dir_remove(fs, dir, name + i, j - i);
+			ext2_obj_unlock(dir);
+
+			if (obj != NULL)
+				ext2_obj_put(fs, obj);
+		}
+
 		ext2_obj_put(fs, dir);
 
 		if (err < 0) {
 			return err;
 		}
 
-		mutexLock(obj->lock);
+		ext2_obj_rdlock(obj);
 		if (EXT2_IS_MOUNTPOINT(obj) && S_ISDIR(obj->inode->mode)) {
 			break;
 		}
@@ -144,7 +177,7 @@ int ext2_lookup(ext2_t *fs, id_t id, const char *name, size_t len, oid_t *res, o
 
 	*dev = EXT2_IS_MOUNTPOINT(obj) ? obj->dev : *res;
 
-	mutexUnlock(obj->lock);
+	ext2_obj_unlock(obj);
 	ext2_obj_put(fs, obj);
 
 	return j;
@@ -155,10 +188,7 @@ int ext2_open(ext2_t *fs, id_t id)
 {
 	ext2_obj_t *obj;
 
-	if ((obj = ext2_obj_get(fs, id)) == NULL)
-		return -EINVAL;
-
-	return EOK;
+	return ext2_obj_get(fs, id, &obj);
 }
 
 
@@ -167,16 +197,16 @@ int ext2_close(ext2_t *fs, id_t id)
 	ext2_obj_t *obj;
 	int err;
 
-	if ((obj = ext2_obj_get(fs, id)) == NULL)
-		return -EINVAL;
-
-	if ((err = ext2_obj_sync(fs, obj)) < 0)
+	if ((err = ext2_obj_get(fs, id, &obj)) < 0)
 		return err;
 
+	/* File is closed even if it fails to synchronize, it's written back again once evicted */
+	err = ext2_obj_sync(fs, obj);
+
 	ext2_obj_put(fs, obj);
 	ext2_obj_put(fs, obj);
 
-	return EOK;
+	return err;
 }
 
 
@@ -185,17 +215,17 @@ ssize_t ext2_read(ext2_t *fs, id_t id, off_t offs, char *buff, size_t len)
 	ext2_obj_t *obj;
 	ssize_t ret;
 
-	if ((obj = ext2_obj_get(fs, id)) == NULL)
-		return -EINVAL;
+	if ((ret = ext2_obj_get(fs, id, &obj)) < 0)
+		return ret;
 
-	mutexLock(obj->lock);
+	ext2_obj_rdlock(obj);
 
 	if (S_ISDIR(obj->inode->mode)) {
 		if (EXT2_IS_MOUNTPOINT(obj)) {
 			ret = -EINVAL;
 		}
 		else {
-			ret = _ext2_dir_read(fs, obj, offs, (struct dirent *)buff, len);
+			ret = _ext2_dir_read(fs, obj, offs, (struct dirent *)buff, len, 0);
 		}
 	}
 	else if (EXT2_ISDEV(obj->inode->mode)) {
@@ -205,22 +235,49 @@ ssize_t ext2_read(ext2_t *fs, id_t id, off_t offs, char *buff, size_t len)
 		ret = _ext2_file_read(fs, obj, offs, buff, len);
 	}
 
-	mutexUnlock(obj->lock);
+	ext2_obj_unlock(obj);
 	ext2_obj_put(fs, obj);
 
 	return ret;
 }
 
 
+int ext2_readdir(ext2_t *fs, id_t id, off_t offs, struct dirent *res, size_t len)
+{
+	ext2_obj_t *obj;
+	int err;
+
+	if ((err = ext2_obj_get(fs, id, &obj)) < 0)
+		return err;
+
+	ext2_obj_rdlock(obj);
+
+	if (!S_ISDIR(obj->inode->mode))
+		err = -ENOTDIR;
+	else if (EXT2_IS_MOUNTPOINT(obj))
+		err = -EINVAL;
+	else
+		err = _ext2_dir_read(fs, obj, offs, res, len, 1);
+
+	ext2_obj_unlock(obj);
+	ext2_obj_put(fs, obj);
+
+	return err;
+}
+
+
 ssize_t ext2_write(ext2_t *fs, id_t id, off_t offs, const char *buff, size_t len)
 {
 	ext2_obj_t *obj;
 	ssize_t ret;
 
-	if ((obj = ext2_obj_get(fs, id)) == NULL)
-		return -EINVAL;
+	if (fs->rdonly)
+		return -EROFS;
+
+	if ((ret = ext2_obj_get(fs, id, &obj)) < 0)
+		return ret;
 
-	mutexLock(obj->lock);
+	ext2_obj_lock(obj);
 
 	if (S_ISDIR(obj->inode->mode) || EXT2_ISDEV(obj->inode->mode)) {
 		ret = -EINVAL;
@@ -229,7 +286,7 @@ ssize_t ext2_write(ext2_t *fs, id_t id, off_t offs, const char *buff, size_t len
 		ret = _ext2_file_write(fs, obj, offs, buff, len);
 	}
 
-	mutexUnlock(obj->lock);
+	ext2_obj_unlock(obj);
 	ext2_obj_put(fs, obj);
 
 	return ret;
@@ -241,12 +298,15 @@ int ext2_truncate(ext2_t *fs, id_t id, size_t size)
 	ext2_obj_t *obj;
 	int err;
 
-	if ((obj = ext2_obj_get(fs, id)) == NULL) {
-		return -EINVAL;
+	if (fs->rdonly)
+		return -EROFS;
+
+	if ((err = ext2_obj_get(fs, id, &obj)) < 0) {
+		return err;
 	}
 
 	do {
-		mutexLock(obj->lock);
+		ext2_obj_rdlock(obj);
 
 		if (!S_ISREG(obj->inode->mode)) {
 			if (S_ISDIR(obj->inode->mode)) {
@@ -255,19 +315,83 @@ int ext2_truncate(ext2_t *fs, id_t id, size_t size)
 			else {
 				err = -EINVAL;
 			}
-			mutexUnlock(obj->lock);
+			ext2_obj_unlock(obj);
 			break;
 		}
 
-		mutexUnlock(obj->lock);
+		ext2_obj_unlock(obj);
 
 		if ((err = ext2_obj_truncate(fs, obj, size)) < 0)
 			break;
 
-		if ((err = ext2_sb_sync(fs)) < 0)
+		if ((err = ext2_commit(fs)) < 0)
+			break;
+	} while (0);
+
+	ext2_obj_put(fs, obj);
+
+	return err;
+}
+
+
+int ext2_reserve(ext2_t *fs, id_t id, uint32_t n, uint32_t *len)
+{
+	ext2_obj_t *obj;
+	int err;
+
+	if (fs->rdonly)
+		return -EROFS;
+
+	if ((err = ext2_obj_get(fs, id, &obj)) < 0)
+		return err;
+
+	ext2_obj_lock(obj);
+
+	do {
+		if (!S_ISREG(obj->inode->mode)) {
+			err = (S_ISDIR(obj->inode->mode)) ? -EISDIR : -EINVAL;
+			break;
+		}
+
+		/* Extent mapped files are read-only */
+		if (ext2_extent_mapped(obj)) {
+			err = -EROFS;
+			break;
+		}
+
+		if ((err = ext2_block_reserve(fs, obj, n, len)) < 0)
+			break;
+
+		/* Blocks waiting for allocation might have been allocated */
+		if (ext2_obj_modified(obj) && ((err = _ext2_obj_sync(fs, obj)) < 0))
 			break;
+
+		err = ext2_commit(fs);
 	} while (0);
 
+	ext2_obj_unlock(obj);
+	ext2_obj_put(fs, obj);
+
+	return err;
+}
+
+
+int ext2_seek(ext2_t *fs, id_t id, off_t offs, int hole, off_t *res)
+{
+	ext2_obj_t *obj;
+	int err;
+
+	if ((err = ext2_obj_get(fs, id, &obj)) < 0)
+		return err;
+
+	ext2_obj_rdlock(obj);
+
+	if (EXT2_IS_MOUNTPOINT(obj))
+		err = -EINVAL;
+	else
+		err = _ext2_file_seek(fs, obj, offs, hole, res);
+
+	ext2_obj_unlock(obj);
 	ext2_obj_put(fs, obj);
 
 	return err;
@@ -276,14 +400,14 @@ int ext2_truncate(ext2_t *fs, id_t id, size_t size)
 
 int ext2_getattr(ext2_t *fs, id_t id, int type, long long *attr)
 {
-	int ret = EOK;
-	ext2_obj_t *obj = ext2_obj_get(fs, id);
+	ext2_obj_t *obj;
+	int ret;
 
-	if (obj == NULL) {
-		return -EINVAL;
+	if ((ret = ext2_obj_get(fs, id, &obj)) < 0) {
+		return ret;
 	}
 
-	mutexLock(obj->lock);
+	ext2_obj_rdlock(obj);
 
 	switch(type) {
 		case atMode:
@@ -355,7 +479,7 @@ int ext2_getattr(ext2_t *fs, id_t id, int type, long long *attr)
 			break;
 	}
 
-	mutexUnlock(obj->lock);
+	ext2_obj_unlock(obj);
 	ext2_obj_put(fs, obj);
 
 	return ret;
@@ -364,15 +488,16 @@ int ext2_getattr(ext2_t *fs, id_t id, int type, long long *attr)
 
 int ext2_getattrAll(ext2_t *fs, id_t id, struct _attrAll *attrs)
 {
-	ext2_obj_t *obj = ext2_obj_get(fs, id);
+	ext2_obj_t *obj;
+	int err;
 
-	if (obj == NULL) {
-		return -EINVAL;
+	if ((err = ext2_obj_get(fs, id, &obj)) < 0) {
+		return err;
 	}
 
 	_phoenix_initAttrsStruct(attrs, -ENOSYS);
 
-	mutexLock(obj->lock);
+	ext2_obj_rdlock(obj);
 
 	attrs->mode.val = obj->inode->mode;
 	attrs->mode.err = EOK;
@@ -415,7 +540,7 @@ int ext2_getattrAll(ext2_t *fs, id_t id, struct _attrAll *attrs)
 	attrs->pollStatus.val = POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM;
 	attrs->pollStatus.err = EOK;
 
-	mutexUnlock(obj->lock);
+	ext2_obj_unlock(obj);
 	ext2_obj_put(fs, obj);
 
 	return EOK;
@@ -427,10 +552,13 @@ int ext2_setattr(ext2_t *fs, id_t id, int type, long long attr, const void *data
 	ext2_obj_t *obj;
 	int err = EOK;
 
-	if ((obj = ext2_obj_get(fs, id)) == NULL)
-		return -EINVAL;
+	if (fs->rdonly)
+		return -EROFS;
+
+	if ((err = ext2_obj_get(fs, id, &obj)) < 0)
+		return err;
 
-	mutexLock(obj->lock);
+	ext2_obj_lock(obj);
 
 	switch (type) {
 		case atMode:
@@ -452,7 +580,7 @@ int ext2_setattr(ext2_t *fs, id_t id, int type, long long attr, const void *data
 			if ((err = _ext2_obj_sync(fs, obj)) < 0)
 				break;
 
-			if ((err = ext2_sb_sync(fs)) < 0)
+			if ((err = ext2_commit(fs)) < 0)
 				break;
 			break;
 
@@ -494,7 +622,7 @@ int ext2_setattr(ext2_t *fs, id_t id, int type, long long attr, const void *data
 		err = _ext2_obj_sync(fs, obj);
 	}
 
-	mutexUnlock(obj->lock);
+	ext2_obj_unlock(obj);
 	ext2_obj_put(fs, obj);
 
 	return err;
@@ -507,19 +635,22 @@ int ext2_link(ext2_t *fs, id_t id, const char *name, size_t len, id_t lid)
 	id_t res;
 	int err;
 
+	if (fs->rdonly)
+		return -EROFS;
+
 	if (!len || (name == NULL) || (id == lid))
 		return -EINVAL;
 
-	if ((dir = ext2_obj_get(fs, id)) == NULL)
-		return -EINVAL;
+	if ((err = ext2_obj_get(fs, id, &dir)) < 0)
+		return err;
 
-	if ((obj = ext2_obj_get(fs, lid)) == NULL) {
+	if ((err = ext2_obj_get(fs, lid, &obj)) < 0) {
 		ext2_obj_put(fs, dir);
-		return -EINVAL;
+		return err;
 	}
 
-	mutexLock(dir->lock);
-	mutexLock(obj->lock);
+	ext2_obj_lock(dir);
+	ext2_obj_lock(obj);
 
 	do {
 		if (!S_ISDIR(dir->inode->mode)) {
@@ -537,6 +668,12 @@ int ext2_link(ext2_t *fs, id_t id, const char *name, size_t len, id_t lid)
 			break;
 		}
 
+		/* Extent mapped files are read-only (rename links them first) */
+		if (ext2_extent_mapped(obj)) {
+			err = -EROFS;
+			break;
+		}
+
 		if ((err = _ext2_dir_add(fs, dir, name, len, obj->inode->mode, (uint32_t)lid)) < 0)
 			break;
 
@@ -547,13 +684,18 @@ int ext2_link(ext2_t *fs, id_t id, const char *name, size_t len, id_t lid)
 		obj->flags |= OFLAG_DIRTY;
 
 		if (S_ISDIR(obj->inode->mode)) {
-			if ((err = _ext2_dir_add(fs, obj, ".", 1, S_IFDIR, (uint32_t)lid)) < 0)
-				break;
-
-			obj->inode->links++;
+			if ((err = _ext2_dir_add(fs, obj, ".", 1, S_IFDIR, (uint32_t)lid)) == EOK) {
+				obj->inode->links++;
+				err = _ext2_dir_add(fs, obj, "..", 2, S_IFDIR, (uint32_t)id);
+			}
+			obj->flags |= OFLAG_DIRTY;
 
-			if ((err = _ext2_dir_add(fs, obj, "..", 2, S_IFDIR, (uint32_t)id)) < 0)
+			/* Unlink incomplete directory, so it can be destroyed */
+			if (err < 0) {
+				if (_ext2_dir_remove(fs, dir, name, len) == EOK)
+					obj->inode->links = 0;
 				break;
+			}
 
 			dir->inode->links++;
 			dir->flags |= OFLAG_DIRTY;
@@ -566,8 +708,8 @@ int ext2_link(ext2_t *fs, id_t id, const char *name, size_t len, id_t lid)
 			break;
 	} while (0);
 
-	mutexUnlock(obj->lock);
-	mutexUnlock(dir->lock);
+	ext2_obj_unlock(obj);
+	ext2_obj_unlock(dir);
 	ext2_obj_put(fs, obj);
 	ext2_obj_put(fs, dir);
 
@@ -581,13 +723,16 @@ int ext2_unlink(ext2_t *fs, id_t id, const char *name, size_t len)
 	id_t res;
 	int err;
 
+	if (fs->rdonly)
+		return -EROFS;
+
 	if (!len || (name == NULL))
 		return -EINVAL;
 
-	if ((dir = ext2_obj_get(fs, id)) == NULL)
-		return -EINVAL;
+	if ((err = ext2_obj_get(fs, id, &dir)) < 0)
+		return err;
 
-	mutexLock(dir->lock);
+	ext2_obj_lock(dir);
 
 	do {
 		if (!S_ISDIR(dir->inode->mode)) {
@@ -598,16 +743,23 @@ int ext2_unlink(ext2_t *fs, id_t id, const char *name, size_t len)
 		if ((err = _ext2_dir_search(fs, dir, name, len, &res)) < 0)
 			break;
 
-		if ((obj = ext2_obj_get(fs, res)) == NULL) {
-			if (!(err = _ext2_dir_remove(fs, dir, name, len)))
+		if ((err = ext2_obj_get(fs, res, &obj)) < 0) {
+			/* Remove dangling entry of invalid inode */
+			if ((err == -EINVAL) && !(err = _ext2_dir_remove(fs, dir, name, len)))
 				err = -ENOENT;
 			break;
 		}
 
-		mutexLock(obj->lock);
+		ext2_obj_lock(obj);
 
 		do {
-			if (S_ISDIR(obj->inode->mode) && (EXT2_IS_MOUNTPOINT(obj) || !_ext2_dir_empty(fs, obj))) {
+			/* Extent mapped files are read-only, their blocks can't be freed */
+			if (ext2_extent_mapped(obj)) {
+				err = -EROFS;
+				break;
+			}
+
+			if (S_ISDIR(obj->inode->mode) && (EXT2_IS_MOUNTPOINT(obj) || (_ext2_dir_empty(fs, obj) <= 0))) {
 				err = -ENOTEMPTY;
 				break;
 			}
@@ -618,18 +770,21 @@ int ext2_unlink(ext2_t *fs, id_t id, const char *name, size_t len)
 			obj->inode->links--;
 			if (S_ISDIR(obj->inode->mode)) {
 				dir->inode->links--;
+				dir->flags |= OFLAG_DIRTY;
 				obj->inode->links--;
+				err = _ext2_obj_sync(fs, dir);
 				break;
 			}
 
 			obj->inode->mtime = obj->inode->atime = time(NULL);
+			obj->flags |= OFLAG_DIRTY;
 		} while (0);
 
-		mutexUnlock(obj->lock);
+		ext2_obj_unlock(obj);
 		ext2_obj_put(fs, obj);
 	} while (0);
 
-	mutexUnlock(dir->lock);
+	ext2_obj_unlock(dir);
 	ext2_obj_put(fs, dir);
 
 	return err;
@@ -645,16 +800,98 @@ int ext2_statfs(ext2_t *fs, void *buf, size_t len)
 		return -EINVAL;
 	}
 
-	/* TODO: superblock access should be protected with a lock */
+	mutexLock(fs->mdlock);
 	st->f_bsize = st->f_frsize = fs->blocksz;
 	st->f_blocks = sb->blocks;
 	st->f_bfree = sb->freeBlocks;
 	st->f_bavail = (sb->freeBlocks > sb->resBlocks) ? sb->freeBlocks - sb->resBlocks : 0;
 	st->f_files = sb->inodes;
 	st->f_favail = st->f_ffree = sb->freeInodes;
+	mutexUnlock(fs->mdlock);
 	st->f_fsid = (unsigned long)fs; /* TODO: filesystem ID should be generated at mount time */
 	st->f_flag = 0;                 /* TODO: mount options should be saved at mount time */
 	st->f_namemax = MAX_NAMELEN;
 
 	return EOK;
 }
+
+
+int ext2_commit(ext2_t *fs)
+{
+	int err;
+
+	if (!fs->sync)
+		return EOK;
+
+	if ((err = ext2_bmp_sync(fs)) < 0)
+		return err;
+
+	if ((err = ext2_gdt_sync(fs)) < 0)
+		return err;
+
+	if ((err = ext2_sb_sync(fs)) < 0)
+		return err;
+
+	ext2_bmp_discard(fs);
+
+	return EOK;
+}
+
+
+/* Writes back modified filesystem data (lazy keeps unexpired timestamps only inode updates) */
+static int ext2_syncfs(ext2_t *fs, int lazy)
+{
+	int err, ret = EOK;
+
+	if ((err = ext2_objs_sync(fs, lazy)) < 0)
+		ret = err;
+
+	if ((err = ext2_bmp_sync(fs)) < 0)
+		ret = err;
+
+	if ((err = ext2_gdt_sync(fs)) < 0)
+		ret = err;
+
+	if ((err = ext2_sb_sync(fs)) < 0)
+		ret = err;
+
+	if ((err = ext2_cache_sync(fs)) < 0)
+		ret = err;
+
+	/* Flush device write cache */
+	if ((fs->strg != NULL) && (fs->strg->dev->blk->ops->sync != NULL) && ((err = fs->strg->dev->blk->ops->sync(fs->strg)) < 0))
+		ret = err;
+
+	/* Freed blocks are discarded once bitmaps releasing them are written back */
+	if (ret == EOK)
+		ext2_bmp_discard(fs);
+
+	return ret;
+}
+
+
+int ext2_sync(ext2_t *fs)
+{
+	return ext2_syncfs(fs, 0);
+}
+
+
+int ext2_flush(ext2_t *fs)
+{
+	return ext2_syncfs(fs, 1);
+}
+
+
+int ext2_trim(ext2_t *fs, uint32_t minlen, uint64_t *trimmed)
+{
+	int err;
+
+	if (fs->rdonly)
+		return -EROFS;
+
+	/* Write back freed blocks bitmaps first */
+	if ((err = ext2_sync(fs)) < 0)
+		return err;
+
+	return ext2_bmp_trim(fs, minlen, trimmed);
+}
@@ -16,6 +16,7 @@
 #ifndef _EXT2_H_
 #define _EXT2_H_
 
+#include <dirent.h>
 #include <limits.h>
 #include <stdint.h>
 
@@ -27,18 +28,38 @@
 /* Misc definitions */
 #define ROOT_INO                 2   /* Root inode number */
 #define MAX_NAMELEN              255 /* Max filename length */
-#define MAX_OBJECTS              512 /* Max number of filesystem objects in use */
+#define MAX_OBJECTS              512 /* Default max number of filesystem objects (in use and cached) */
 #define MAX_SYMLINK_LEN_IN_INODE 60  /* Maximum length of symlink that will be stored in inode instead of the file. */
+#define CACHE_SIZE               256 /* Default block cache size (KiB) */
+#define DCACHE_SIZE              512 /* Default directory entries cache size (entries) */
+#define DELALLOC_SIZE            32  /* Default delayed allocation buffer size (KiB) */
+#define PREALLOC_SIZE            512 /* Default max preallocation window size (KiB) */
+#define READAHEAD_SIZE           64  /* Default max read-ahead window size (KiB) */
+#define COMMIT_INTERVAL          5   /* Default write-back interval (s) */
+#define LAZYTIME_EXPIRE          43200 /* Max time timestamps only inode updates are kept in memory on lazytime mount (s) */
+#define FLUSHER_STACKSZ          0x2000 /* Write-back thread stack size */
+
+
+/* Access time update modes */
+enum {
+	ATIME_STRICT,   /* Update on every access */
+	ATIME_RELATIVE, /* Update if older than modification or change time, or a day old */
+	ATIME_NONE      /* Don't update */
+};
 
 
 #define EXT2_ISDEV(x) (S_ISCHR(x) || S_ISBLK(x) || S_ISFIFO(x) || S_ISSOCK(x))
 
 
 /* Filesystem common data types forward declaration */
-typedef struct _ext2_sb_t ext2_sb_t;     /* SuperBlock */
-typedef struct _ext2_gd_t ext2_gd_t;     /* Group Descriptor*/
-typedef struct _ext2_obj_t ext2_obj_t;   /* Filesystem object */
-typedef struct _ext2_objs_t ext2_objs_t; /* Filesystem objects */
+typedef struct _ext2_sb_t ext2_sb_t;         /* SuperBlock */
+typedef struct _ext2_gd_t ext2_gd_t;         /* Group Descriptor*/
+typedef struct _ext2_obj_t ext2_obj_t;       /* Filesystem object */
+typedef struct _ext2_objs_t ext2_objs_t;     /* Filesystem objects */
+typedef struct _ext2_cache_t ext2_cache_t;   /* Block cache */
+typedef struct _ext2_dcache_t ext2_dcache_t; /* Directory entries cache */
+typedef struct _ext2_bmps_t ext2_bmps_t;     /* Block and inode bitmaps */
+typedef struct _ext2_pool_t ext2_pool_t;     /* Block buffers pool */
 
 
 /* Device access callbacks */
@@ -60,18 +81,56 @@ typedef struct {
 	unsigned int port; /* Filesystem port */
 	ext2_sb_t *sb;     /* SuperBlock */
 	ext2_gd_t *gdt;    /* Group Descriptors Table */
+	ext2_bmps_t *bmps; /* Block and inode bitmaps */
 	uint32_t blocksz;  /* Block size */
 	uint32_t groups;   /* Number of groups */
+	uint8_t rdonly;    /* Read-only filesystem (has unsupported read-only compatible features) */
 
 	/* Filesystem objects */
 	ext2_obj_t *root;  /* Root object */
 	ext2_objs_t *objs; /* Filesystem objects */
+	handle_t ilock;    /* Inode tables update mutex */
+
+	/* Filesystem cache */
+	ext2_cache_t *cache;   /* Block cache */
+	ext2_dcache_t *dcache; /* Directory entries cache */
+	ext2_pool_t *pool;     /* Block buffers pool */
+
+	/* Metadata write-back */
+	handle_t mdlock;       /* Superblock and GDT write-back mutex */
+	uint8_t sbdirty;       /* Superblock needs to be written back */
+	uint8_t *gdtdirty;     /* GDT blocks that need to be written back */
+	uint32_t dares;        /* Free blocks reserved for delayed allocation (guarded by mdlock) */
+	struct {
+		handle_t lock;     /* Flusher mutex */
+		handle_t cond;     /* Flusher wake up condition */
+		handle_t tid;      /* Flusher thread ID */
+		uint8_t stop;      /* Flusher stop request */
+		void *stack;       /* Flusher stack (NULL if flusher isn't running) */
+	} flusher;             /* Periodic write-back thread */
+
+	/* Mount options */
+	uint32_t objsz;    /* Max number of filesystem objects (in use and cached) */
+	uint32_t cachesz;  /* Block cache size (KiB) */
+	uint32_t dcachesz; /* Directory entries cache size (entries), 0 disables the cache */
+	uint32_t dasz;     /* Delayed allocation buffer size (KiB), 0 disables delayed allocation */
+	uint32_t pasz;     /* Max preallocation window size (KiB), 0 disables preallocation */
+	uint32_t rasz;     /* Max read-ahead window size (KiB), 0 disables read-ahead */
+	uint32_t commit;   /* Write-back interval (s), 0 disables periodic write-back */
+	uint8_t sync;      /* Synchronous writes (no write-back) */
+	uint8_t discard;   /* Discard freed blocks (in batches, after freeing them is written back) */
+	uint8_t atime;     /* Access time update mode */
+	uint8_t lazytime;  /* Keep timestamps only inode updates in memory */
 } ext2_t;
 
 
 /* Include filesystem common data types definitions */
+#include "bmp.h"
+#include "cache.h"
+#include "dcache.h"
 #include "gdt.h"
 #include "obj.h"
+#include "pool.h"
 #include "sb.h"
 
 
@@ -99,6 +158,10 @@ extern int ext2_close(ext2_t *fs, id_t id);
 extern ssize_t ext2_read(ext2_t *fs, id_t id, off_t offs, char *buff, size_t len);
 
 
+/* Reads as many directory entries as fit in the buffer (see LIBEXT2_DEVCTL_READDIR) */
+extern int ext2_readdir(ext2_t *fs, id_t id, off_t offs, struct dirent *res, size_t len);
+
+
 /* Writes to a file */
 extern ssize_t ext2_write(ext2_t *fs, id_t id, off_t offs, const char *buff, size_t len);
 
@@ -107,6 +170,14 @@ extern ssize_t ext2_write(ext2_t *fs, id_t id, off_t offs, const char *buff, siz
 extern int ext2_truncate(ext2_t *fs, id_t id, size_t size);
 
 
+/* Reserves up to n consecutive blocks for the following writes past the end of a file (kept until the file is closed) */
+extern int ext2_reserve(ext2_t *fs, id_t id, uint32_t n, uint32_t *len);
+
+
+/* Finds the first data (or hole) offset at or after offs */
+extern int ext2_seek(ext2_t *fs, id_t id, off_t offs, int hole, off_t *res);
+
+
 /* Retrives file attributes */
 extern int ext2_getattr(ext2_t *fs, id_t id, int type, long long *attr);
 
@@ -126,43 +197,24 @@ extern int ext2_link(ext2_t *fs, id_t id, const char *name, size_t len, id_t lid
 extern int ext2_unlink(ext2_t *fs, id_t id, const char *name, size_t len);
 
 
-/* Retrieves filesystem statistics */
-extern int ext2_statfs(ext2_t *fs, void *buf, size_t len);
+/* Discards free extents of at least minlen blocks */
+extern int ext2_trim(ext2_t *fs, uint32_t minlen, uint64_t *trimmed);
 
 
-/* Bitmap bit operations */
-static inline uint32_t ext2_findzerobit(uint32_t *bmp, uint32_t size, uint32_t offs)
-{
-	static const uint32_t bitsInElem = CHAR_BIT * sizeof(uint32_t);
-	uint32_t len = ((size - 1) / bitsInElem) + 1;
-
-	for (uint32_t i = offs / bitsInElem; i < len; i++) {
-		uint32_t bit = __builtin_ffsl(~bmp[i]);
-		if (bit != 0) {
-			offs = (i * bitsInElem) + bit;
-			return (offs > size) ? 0 : offs;
-		}
-	}
+/* Retrieves filesystem statistics */
+extern int ext2_statfs(ext2_t *fs, void *buf, size_t len);
 
-	return 0;
-}
 
+/* Writes back modified metadata on synchronous mount */
+extern int ext2_commit(ext2_t *fs);
 
-static inline uint8_t ext2_checkbit(uint32_t *bmp, uint32_t offs)
-{
-	uint32_t woffs = (offs - 1) % (CHAR_BIT * sizeof(uint32_t));
-	uint32_t aoffs = (offs - 1) / (CHAR_BIT * sizeof(uint32_t));
 
-	return !!(bmp[aoffs] & (1UL << woffs));
-}
+/* Writes back all modified filesystem data */
+extern int ext2_sync(ext2_t *fs);
 
 
-static inline void ext2_togglebit(uint32_t *bmp, uint32_t offs)
-{
-	uint32_t woffs = (offs - 1) % (CHAR_BIT * sizeof(uint32_t));
-	uint32_t aoffs = (offs - 1) / (CHAR_BIT * sizeof(uint32_t));
-	bmp[aoffs] ^= 1UL << woffs;
-}
+/* Writes back modified filesystem data periodically, timestamps only inode updates are kept until they expire */
+extern int ext2_flush(ext2_t *fs);
 
 
 #endif
@@ -0,0 +1,196 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Extent tree (read-only)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <sys/minmax.h>
+
+#include "block.h"
+#include "extent.h"
+
+
+#define EXTENT_MAGIC  0xf30a /* Extent tree node magic */
+#define EXTENT_MAXLEN 32768  /* Max initialized extent length (longer ones are uninitialized) */
+#define EXTENT_LEVELS 5      /* Max tree depth */
+
+
+/* Tree node header */
+typedef struct {
+	uint16_t magic;      /* Node magic */
+	uint16_t entries;    /* Number of entries */
+	uint16_t max;        /* Max number of entries */
+	uint16_t depth;      /* Node depth (0: leaf node) */
+	uint32_t generation; /* Tree generation */
+} ext2_extent_hdr_t;
+
+
+/* Index node entry */
+typedef struct {
+	uint32_t block;  /* First logical block covered by the child node */
+	uint32_t leafLo; /* Child node block (low 32 bits) */
+	uint16_t leafHi; /* Child node block (high 16 bits) */
+	uint16_t unused; /* Unused */
+} ext2_extent_idx_t;
+
+
+/* Leaf node entry */
+typedef struct {
+	uint32_t block;   /* First logical block */
+	uint16_t len;     /* Number of blocks */
+	uint16_t startHi; /* First physical block (high 16 bits) */
+	uint32_t startLo; /* First physical block (low 32 bits) */
+} ext2_extent_t;
+
+
+int ext2_extent_mapped(ext2_obj_t *obj)
+{
+	return (obj->inode->flags & IFLAG_EXTENTS) != 0;
+}
+
+
+/* Validates tree node */
+static int ext2_extent_check(ext2_extent_hdr_t *hdr, uint32_t size, uint16_t depth)
+{
+	if ((hdr->magic != EXTENT_MAGIC) || (hdr->depth != depth) || (hdr->entries > hdr->max))
+		return -EINVAL;
+
+	if (sizeof(ext2_extent_hdr_t) + hdr->max * sizeof(ext2_extent_t) > size)
+		return -EINVAL;
+
+	return EOK;
+}
+
+
+/* Returns last node entry starting at or before the logical block, -1 if there's none (index and leaf entries have the same size) */
+static int ext2_extent_search(ext2_extent_hdr_t *hdr, uint32_t block)
+{
+	ext2_extent_t *entries = (ext2_extent_t *)(hdr + 1);
+	int lo = 0, hi = hdr->entries, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+
+		if (entries[mid].block <= block)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo - 1;
+}
+
+
+/* Finds leaf node mapping the logical block, the leaf is cached until another one is needed */
+static int ext2_extent_leaf(ext2_t *fs, ext2_obj_t *obj, uint32_t block, ext2_extent_hdr_t **leaf, uint32_t *end)
+{
+	void *root = obj->inode->block;
+	ext2_extent_hdr_t *hdr = root;
+	ext2_extent_idx_t *idx;
+	uint32_t bno = 0, start = 0;
+	uint16_t depth;
+	int i, err;
+
+	*end = UINT32_MAX;
+
+	if ((hdr->depth > EXTENT_LEVELS) || (ext2_extent_check(hdr, sizeof(obj->inode->block), hdr->depth) < 0))
+		return -EINVAL;
+
+	/* Tree root is the only leaf */
+	if (!hdr->depth) {
+		*leaf = hdr;
+		return EOK;
+	}
+
+	if (obj->ext.bno && (block >= obj->ext.start) && (block < obj->ext.end)) {
+		*leaf = (ext2_extent_hdr_t *)obj->ext.data;
+		*end = obj->ext.end;
+		return EOK;
+	}
+
+	if ((obj->ext.data == NULL) && ((obj->ext.data = malloc(fs->blocksz)) == NULL))
+		return -ENOMEM;
+
+	/* Child node replaces its parent in the leaf buffer */
+	obj->ext.bno = 0;
+
+	for (depth = hdr->depth; depth > 0; depth--) {
+		if (!hdr->entries)
+			return -EINVAL;
+
+		/* Blocks preceding the first child are a hole in it */
+		i = ext2_extent_search(hdr, block);
+		idx = (ext2_extent_idx_t *)(hdr + 1) + max(i, 0);
+
+		if (idx->leafHi)
+			return -EINVAL;
+
+		if (i >= 0)
+			start = max(start, idx->block);
+
+		if (max(i, 0) + 1 < hdr->entries)
+			*end = min(*end, idx[1].block);
+		bno = idx->leafLo;
+
+		hdr = (ext2_extent_hdr_t *)obj->ext.data;
+		if ((err = ext2_block_read(fs, bno, hdr, 1)) < 0)
+			return err;
+
+		if ((err = ext2_extent_check(hdr, fs->blocksz, depth - 1)) < 0)
+			return err;
+	}
+
+	obj->ext.bno = bno;
+	obj->ext.start = start;
+	obj->ext.end = *end;
+	*leaf = hdr;
+
+	return EOK;
+}
+
+
+int _ext2_extent_map(ext2_t *fs, ext2_obj_t *obj, uint32_t block, uint32_t *bno, uint32_t *len)
+{
+	ext2_extent_hdr_t *leaf;
+	ext2_extent_t *ext;
+	uint32_t elen, end;
+	int i, err;
+
+	if ((err = ext2_extent_leaf(fs, obj, block, &leaf, &end)) < 0)
+		return err;
+
+	ext = (ext2_extent_t *)(leaf + 1);
+
+	if ((i = ext2_extent_search(leaf, block)) >= 0) {
+		elen = (ext[i].len > EXTENT_MAXLEN) ? ext[i].len - EXTENT_MAXLEN : ext[i].len;
+
+		if (block - ext[i].block < elen) {
+			if (ext[i].startHi)
+				return -EINVAL;
+
+			/* Uninitialized extent reads as zeros */
+			*bno = (ext[i].len > EXTENT_MAXLEN) ? 0 : ext[i].startLo + (block - ext[i].block);
+			*len = elen - (block - ext[i].block);
+
+			return EOK;
+		}
+	}
+
+	/* Hole up to the next extent */
+	*bno = 0;
+	*len = ((i + 1 < leaf->entries) ? min(end, ext[i + 1].block) : end) - block;
+
+	return EOK;
+}
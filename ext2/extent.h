@@ -0,0 +1,31 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Extent tree (read-only)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _EXTENT_H_
+#define _EXTENT_H_
+
+#include <stdint.h>
+
+#include "ext2.h"
+
+
+/* Checks if object blocks are mapped by an extent tree */
+extern int ext2_extent_mapped(ext2_obj_t *obj);
+
+
+/* Maps logical block to the physical run reaching the end of its extent, holes and uninitialized extents are mapped to 0 (requires object mapping state to be locked) */
+extern int _ext2_extent_map(ext2_t *fs, ext2_obj_t *obj, uint32_t block, uint32_t *bno, uint32_t *len);
+
+
+#endif
@@ -19,14 +19,16 @@
 #include <time.h>
 #include <sys/minmax.h>
 #include <sys/stat.h>
+#include <sys/threads.h>
 
 #include "block.h"
+#include "extent.h"
 #include "file.h"
 
 
 ssize_t _ext2_file_read(ext2_t *fs, ext2_obj_t *obj, off_t offs, char *buff, size_t len)
 {
-	uint32_t block = offs / fs->blocksz;
+	uint32_t n, block = offs / fs->blocksz;
 	size_t l = 0;
 	void *data;
 	int err;
@@ -46,11 +48,13 @@ ssize_t _ext2_file_read(ext2_t *fs, ext2_obj_t *obj, off_t offs, char *buff, siz
 	}
 
 	if (offs % fs->blocksz || len < fs->blocksz) {
-		if ((data = malloc(fs->blocksz)) == NULL)
+		if ((data = ext2_pool_get(fs)) == NULL)
 			return -ENOMEM;
 
-		if ((err = ext2_block_init(fs, obj, block, data)) < 0) {
-			free(data);
+		ext2_block_readahead(fs, obj, block, 1);
+
+		if ((err = ext2_block_init(fs, obj, block, data, 1)) < 0) {
+			ext2_pool_put(fs, data);
 			return err;
 		}
 
@@ -58,29 +62,37 @@ ssize_t _ext2_file_read(ext2_t *fs, ext2_obj_t *obj, off_t offs, char *buff, siz
 			l = len;
 
 		memcpy(buff, data + offs % fs->blocksz, l);
-		free(data);
+		ext2_pool_put(fs, data);
 		block++;
 	}
 
-	for (; block < (offs + len) / fs->blocksz; block++, l += fs->blocksz) {
-		if ((err = ext2_block_init(fs, obj, block, buff + l)) < 0)
+	if (block < (offs + len) / fs->blocksz) {
+		n = (offs + len) / fs->blocksz - block;
+		ext2_block_readahead(fs, obj, block, n);
+
+		if ((err = ext2_block_init(fs, obj, block, buff + l, n)) < 0)
 			return err;
+
+		block += n;
+		l += n * fs->blocksz;
 	}
 
 	if (len > l) {
-		if ((data = malloc(fs->blocksz)) == NULL)
+		if ((data = ext2_pool_get(fs)) == NULL)
 			return -ENOMEM;
 
-		if ((err = ext2_block_init(fs, obj, block, data)) < 0) {
-			free(data);
+		ext2_block_readahead(fs, obj, block, 1);
+
+		if ((err = ext2_block_init(fs, obj, block, data, 1)) < 0) {
+			ext2_pool_put(fs, data);
 			return err;
 		}
 
 		memcpy(buff + l, data, len - l);
-		free(data);
+		ext2_pool_put(fs, data);
 	}
 
-	obj->inode->atime = time(NULL);
+	ext2_obj_atime(fs, obj);
 
 	return len;
 }
@@ -92,14 +104,24 @@ ssize_t _ext2_file_write(ext2_t *fs, ext2_obj_t *obj, off_t offs, const char *bu
 		return 0;
 	}
 
+	/* Extent mapped files are read-only */
+	if (ext2_extent_mapped(obj)) {
+		return -EROFS;
+	}
+
 	/* Link can only be written to during creation. */
 	if (S_ISLNK(obj->inode->mode) && ((offs != 0) || (obj->inode->size != 0))) {
 		return -EINVAL;
 	}
 
+	/* Drop cached directory block */
+	obj->dir.cached = 0;
+
+	time_t now;
 	int err;
 	if (S_ISLNK(obj->inode->mode) && (len <= MAX_SYMLINK_LEN_IN_INODE)) {
 		memcpy((void *)(obj->inode->block), (const void *)buff, len);
+		obj->flags |= OFLAG_DIRTY;
 	}
 	else {
 		uint32_t block = offs / fs->blocksz;
@@ -107,14 +129,14 @@ ssize_t _ext2_file_write(ext2_t *fs, ext2_obj_t *obj, off_t offs, const char *bu
 		size_t written = 0;
 
 		if ((offsInBlock != 0) || (len < fs->blocksz)) {
-			void *data = malloc(fs->blocksz);
+			void *data = ext2_pool_get(fs);
 			if (data == NULL) {
 				return -ENOMEM;
 			}
 
-			err = ext2_block_init(fs, obj, block, data);
+			err = ext2_block_init(fs, obj, block, data, 1);
 			if (err < 0) {
-				free(data);
+				ext2_pool_put(fs, data);
 				return err;
 			}
 
@@ -123,11 +145,11 @@ ssize_t _ext2_file_write(ext2_t *fs, ext2_obj_t *obj, off_t offs, const char *bu
 
 			err = ext2_block_syncone(fs, obj, block, data);
 			if (err < 0) {
-				free(data);
+				ext2_pool_put(fs, data);
 				return err;
 			}
 
-			free(data);
+			ext2_pool_put(fs, data);
 			block++;
 		}
 
@@ -143,14 +165,14 @@ ssize_t _ext2_file_write(ext2_t *fs, ext2_obj_t *obj, off_t offs, const char *bu
 		}
 
 		if (len > written) {
-			void *data = malloc(fs->blocksz);
+			void *data = ext2_pool_get(fs);
 			if (data == NULL) {
 				return -ENOMEM;
 			}
 
-			err = ext2_block_init(fs, obj, block, data);
+			err = ext2_block_init(fs, obj, block, data, 1);
 			if (err < 0) {
-				free(data);
+				ext2_pool_put(fs, data);
 				return err;
 			}
 
@@ -158,27 +180,34 @@ ssize_t _ext2_file_write(ext2_t *fs, ext2_obj_t *obj, off_t offs, const char *bu
 
 			err = ext2_block_syncone(fs, obj, block, data);
 			if (err < 0) {
-				free(data);
+				ext2_pool_put(fs, data);
 				return err;
 			}
 
-			free(data);
+			ext2_pool_put(fs, data);
 		}
 	}
 
 	if ((offs + len) > obj->inode->size) {
 		obj->inode->size = offs + len;
+		obj->flags |= OFLAG_DIRTY;
 	}
 
-	obj->inode->mtime = obj->inode->ctime = time(NULL);
-	obj->flags |= OFLAG_DIRTY;
+	now = time(NULL);
+	if ((obj->inode->mtime != (uint32_t)now) || (obj->inode->ctime != (uint32_t)now)) {
+		obj->inode->mtime = obj->inode->ctime = now;
+		_ext2_obj_times(fs, obj);
+	}
 
-	err = _ext2_obj_sync(fs, obj);
-	if (err < 0) {
-		return err;
+	/* Object with delayed blocks is synchronized once they get allocated, timestamps only update is kept in memory on lazytime mount */
+	if ((obj->da.n == 0) && ext2_obj_modified(obj)) {
+		err = _ext2_obj_sync(fs, obj);
+		if (err < 0) {
+			return err;
+		}
 	}
 
-	err = ext2_sb_sync(fs);
+	err = ext2_commit(fs);
 	if (err < 0) {
 		return err;
 	}
@@ -187,44 +216,66 @@ ssize_t _ext2_file_write(ext2_t *fs, ext2_obj_t *obj, off_t offs, const char *bu
 }
 
 
-int _ext2_file_truncate(ext2_t *fs, ext2_obj_t *obj, size_t size)
+int _ext2_file_seek(ext2_t *fs, ext2_obj_t *obj, off_t offs, int hole, off_t *res)
 {
-	uint32_t *bno, block, lbno = 0, n = 0;
-	uint32_t start = (size + fs->blocksz - 1) / fs->blocksz;
-	uint32_t end = (obj->inode->size + fs->blocksz - 1) / fs->blocksz;
-	int err;
+	uint32_t block, end, len;
+	int ret;
 
-	/* FIXME: truncation for files with unallocated blocks might fail */
+	if ((offs < 0) || (offs >= obj->inode->size))
+		return -ENXIO;
 
-	if (obj->inode->size > size) {
-		for (block = start; block < end; block++) {
-			if ((err = ext2_block_get(fs, obj, block, &bno)) < 0)
-				return err;
+	/* Object data isn't stored in blocks */
+	if (EXT2_ISDEV(obj->inode->mode) || (S_ISLNK(obj->inode->mode) && (obj->inode->size <= MAX_SYMLINK_LEN_IN_INODE))) {
+		*res = (hole) ? obj->inode->size : offs;
+		return EOK;
+	}
 
-			/* count consecutive blocks to destroy them with one call */
-			if (!lbno || (*bno == lbno + 1)) {
-				n++;
-			}
-			else {
-				if ((err = ext2_block_destroy(fs, lbno + 1 - n, n)) < 0)
-					return err;
+	end = (obj->inode->size + fs->blocksz - 1) / fs->blocksz;
 
-				n = 1;
-			}
+	for (block = offs / fs->blocksz; block < end; block += len) {
+		if ((ret = ext2_block_data(fs, obj, block, end - block, &len)) < 0)
+			return ret;
 
-			lbno = *bno;
+		if (ret != hole) {
+			*res = max(offs, (off_t)block * fs->blocksz);
+			return EOK;
 		}
+	}
 
-		if ((n > 0) && (err = ext2_block_destroy(fs, lbno + 1 - n, n)) < 0)
-			return err;
+	/* End of file is an implicit hole */
+	if (!hole)
+		return -ENXIO;
+
+	*res = obj->inode->size;
+
+	return EOK;
+}
+
+
+int _ext2_file_truncate(ext2_t *fs, ext2_obj_t *obj, size_t size)
+{
+	uint32_t start = (size + fs->blocksz - 1) / fs->blocksz;
+	int err;
+
+	/* Extent mapped files are read-only */
+	if (ext2_extent_mapped(obj))
+		return -EROFS;
+
+	if ((err = ext2_block_unreserve(fs, obj)) < 0)
+		return err;
+
+	/* Drop cached directory block */
+	obj->dir.cached = 0;
+
+	if (obj->inode->size > size) {
+		/* Drop truncated blocks waiting for allocation */
+		ext2_block_undelay(fs, obj, start);
 
-		if ((err = ext2_iblock_destroy(fs, obj, start, end - start)) < 0)
+		if ((err = ext2_block_truncate(fs, obj, start)) < 0)
 			return err;
 	}
 
 	obj->inode->size = size;
-	/* FIXME: blocks counting is broken, move it to iblock_destroy */
-	obj->inode->blocks -= (end - start) * fs->blocksz / fs->sectorsz;
 	obj->inode->mtime = obj->inode->ctime = time(NULL);
 	obj->flags |= OFLAG_DIRTY;
 
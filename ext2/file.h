@@ -23,7 +23,7 @@
 #include "ext2.h"
 
 
-/* Reads a file (requires object to be locked) */
+/* Reads a file (requires object to be locked, at least for reading) */
 extern ssize_t _ext2_file_read(ext2_t *fs, ext2_obj_t *obj, off_t offs, char *buff, size_t len);
 
 
@@ -31,6 +31,10 @@ extern ssize_t _ext2_file_read(ext2_t *fs, ext2_obj_t *obj, off_t offs, char *bu
 extern ssize_t _ext2_file_write(ext2_t *fs, ext2_obj_t *obj, off_t offs, const char *buff, size_t len);
 
 
+/* Finds the first data (or hole) offset at or after offs, -ENXIO if there's no data past offs (requires object to be locked, at least for reading) */
+extern int _ext2_file_seek(ext2_t *fs, ext2_obj_t *obj, off_t offs, int hole, off_t *res);
+
+
 /* Truncates a file (requires object to be locked) */
 extern int _ext2_file_truncate(ext2_t *fs, ext2_obj_t *obj, size_t size);
 
@@ -17,75 +17,80 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <sys/threads.h>
+
 #include "block.h"
 #include "gdt.h"
 
 
-int ext2_gdt_syncone(ext2_t *fs, uint32_t group)
+/* Writes GDT block to the device (requires metadata to be locked) */
+static int _ext2_gdt_write(ext2_t *fs, uint32_t block)
 {
-	uint32_t blocks = (sizeof(ext2_gd_t) - 1) / fs->blocksz + 1;
-	uint32_t bno = fs->sb->fstBlock + group * sizeof(ext2_gd_t) / fs->blocksz + 1;
+	uint32_t gdtsz = fs->groups * sizeof(ext2_gd_t);
+	uint32_t bno = fs->sb->fstBlock + block + 1;
 	void *buff;
 	int err;
 
-	if ((buff = malloc(blocks * fs->blocksz)) == NULL)
+	if ((block + 1) * fs->blocksz <= gdtsz)
+		return ext2_block_write(fs, bno, (char *)fs->gdt + block * fs->blocksz, 1);
+
+	/* Last GDT block is partially used */
+	if ((buff = ext2_pool_get(fs)) == NULL)
 		return -ENOMEM;
 
-	if ((err = ext2_block_read(fs, bno, buff, blocks)) < 0) {
-		free(buff);
+	if ((err = ext2_block_read(fs, bno, buff, 1)) < 0) {
+		ext2_pool_put(fs, buff);
 		return err;
 	}
 
-	memcpy(buff + group * sizeof(ext2_gd_t) % fs->blocksz, fs->gdt + group, sizeof(ext2_gd_t));
+	memcpy(buff, (char *)fs->gdt + block * fs->blocksz, gdtsz - block * fs->blocksz);
 
-	if ((err = ext2_block_write(fs, bno, buff, blocks)) < 0) {
-		free(buff);
+	if ((err = ext2_block_write(fs, bno, buff, 1)) < 0) {
+		ext2_pool_put(fs, buff);
 		return err;
 	}
 
-	free(buff);
+	ext2_pool_put(fs, buff);
 
 	return EOK;
 }
 
 
-int ext2_gdt_sync(ext2_t *fs)
+void ext2_gdt_dirty(ext2_t *fs, uint32_t group)
 {
-	uint32_t gdtsz = fs->groups * sizeof(ext2_gd_t);
-	uint32_t blocks = gdtsz / fs->blocksz;
-	uint32_t bno = fs->sb->fstBlock + 1;
-	void *buff;
-	int err;
-
-	if ((err = ext2_block_write(fs, bno, fs->gdt, blocks)) < 0)
-		return err;
+	mutexLock(fs->mdlock);
+	fs->gdtdirty[group * sizeof(ext2_gd_t) / fs->blocksz] = 1;
+	mutexUnlock(fs->mdlock);
+}
 
-	if (gdtsz % fs->blocksz) {
-		if ((buff = malloc(fs->blocksz)) == NULL)
-			return -ENOMEM;
 
-		if ((err = ext2_block_read(fs, bno + blocks, buff, 1)) < 0) {
-			free(buff);
-			return err;
-		}
+int ext2_gdt_sync(ext2_t *fs)
+{
+	uint32_t i, blocks = (fs->groups * sizeof(ext2_gd_t) - 1) / fs->blocksz + 1;
+	int err, ret = EOK;
 
-		memcpy(buff, (char *)fs->gdt + blocks * fs->blocksz, gdtsz % fs->blocksz);
+	mutexLock(fs->mdlock);
 
-		if ((err = ext2_block_write(fs, bno + blocks, buff, 1)) < 0) {
-			free(buff);
-			return err;
-		}
+	for (i = 0; i < blocks; i++) {
+		if (!fs->gdtdirty[i])
+			continue;
 
-		free(buff);
+		if ((err = _ext2_gdt_write(fs, i)) < 0)
+			ret = err;
+		else
+			fs->gdtdirty[i] = 0;
 	}
 
-	return EOK;
+	mutexUnlock(fs->mdlock);
+
+	return ret;
 }
 
 
 void ext2_gdt_destroy(ext2_t *fs)
 {
 	ext2_gdt_sync(fs);
+	free(fs->gdtdirty);
 	free(fs->gdt);
 }
 
@@ -123,6 +128,11 @@ int ext2_gdt_init(ext2_t *fs)
 		free(buff);
 	}
 
+	if ((fs->gdtdirty = (uint8_t *)calloc((gdtsz - 1) / fs->blocksz + 1, sizeof(uint8_t))) == NULL) {
+		free(fs->gdt);
+		return -ENOMEM;
+	}
+
 	fs->groups = groups;
 
 	return EOK;
@@ -33,8 +33,8 @@ struct _ext2_gd_t {
 } __attribute__ ((packed));
 
 
-/* Synchronizes one group descriptor */
-extern int ext2_gdt_syncone(ext2_t *fs, uint32_t group);
+/* Marks group descriptor as modified */
+extern void ext2_gdt_dirty(ext2_t *fs, uint32_t group);
 
 
 /* Synchronizes GDT */
@@ -0,0 +1,895 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Hashed directory index (HTree)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dir.h"
+#include "file.h"
+#include "htree.h"
+
+
+#define HTREE_LEVELS 3 /* Max index levels (root included) */
+#define HTREE_INFO   24 /* Root info offset (after "." and ".." entries) */
+
+
+/* Root info */
+typedef struct {
+	uint32_t reserved; /* Reserved (zero) */
+	uint8_t version;   /* Hash version */
+	uint8_t len;       /* Info length */
+	uint8_t levels;    /* Number of index levels below the root */
+	uint8_t flags;     /* Unused flags */
+} ext2_dx_info_t;
+
+
+/* Index entry (first entry in the block holds limit and count instead of hash) */
+typedef struct {
+	uint32_t hash;  /* Lowest hash in the block */
+	uint32_t block; /* Logical block number */
+} ext2_dx_entry_t;
+
+
+typedef struct {
+	uint16_t limit; /* Max number of entries */
+	uint16_t count; /* Number of entries */
+	uint32_t block; /* Logical block number */
+} ext2_dx_countlimit_t;
+
+
+/* Index lookup path */
+typedef struct {
+	char *data[HTREE_LEVELS];               /* Index blocks data */
+	ext2_dx_entry_t *entries[HTREE_LEVELS]; /* Index blocks entries */
+	uint32_t block[HTREE_LEVELS];           /* Index blocks numbers */
+	uint32_t at[HTREE_LEVELS];              /* Followed entries */
+	uint32_t hash;                          /* Searched hash */
+	uint8_t version;                        /* Hash version */
+	uint8_t levels;                         /* Number of index levels below the root */
+} ext2_htree_path_t;
+
+
+/* Hashed directory entry */
+typedef struct {
+	uint32_t hash; /* Entry hash */
+	uint32_t offs; /* Entry offset */
+} ext2_htree_map_t;
+
+
+static inline ext2_dx_countlimit_t *ext2_htree_cl(ext2_dx_entry_t *entries)
+{
+	return (ext2_dx_countlimit_t *)entries;
+}
+
+
+static inline uint16_t ext2_htree_reclen(uint8_t len)
+{
+	return (sizeof(ext2_dirent_t) + len + 3) & ~3;
+}
+
+
+static inline uint32_t ext2_htree_rol(uint32_t x, int s)
+{
+	return (x << s) | (x >> (32 - s));
+}
+
+
+static inline uint32_t ext2_htree_char(char c, int sign)
+{
+	return (sign) ? (uint32_t)(int)(signed char)c : (uint32_t)(unsigned char)c;
+}
+
+
+/* Legacy hash */
+static uint32_t ext2_htree_legacy(const char *name, size_t len, int sign)
+{
+	uint32_t hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash = hash1 + (hash0 ^ (ext2_htree_char(name[i], sign) * 7152373));
+		if (hash & 0x80000000)
+			hash -= 0x7fffffff;
+		hash1 = hash0;
+		hash0 = hash;
+	}
+
+	return hash0 << 1;
+}
+
+
+/* Half MD4 transform (three rounds of 8 steps) */
+static void ext2_htree_md4(uint32_t buf[4], const uint32_t in[8])
+{
+	static const uint8_t idx[2][8] = { { 1, 3, 5, 7, 0, 2, 4, 6 }, { 3, 7, 2, 6, 1, 5, 0, 4 } };
+	static const uint8_t shift[3][4] = { { 3, 7, 11, 19 }, { 3, 5, 9, 13 }, { 3, 9, 11, 15 } };
+	uint32_t x[4] = { buf[0], buf[1], buf[2], buf[3] }, a, b, c, f;
+	int i, k;
+
+	for (i = 0; i < 24; i++) {
+		k = (4 - (i & 3)) & 3;
+		a = x[(k + 1) & 3];
+		b = x[(k + 2) & 3];
+		c = x[(k + 3) & 3];
+
+		if (i < 8)
+			f = (c ^ (a & (b ^ c))) + in[i];
+		else if (i < 16)
+			f = ((a & b) + ((a ^ b) & c)) + in[idx[0][i - 8]] + 0x5a827999;
+		else
+			f = (a ^ b ^ c) + in[idx[1][i - 16]] + 0x6ed9eba1;
+
+		x[k] = ext2_htree_rol(x[k] + f, shift[i / 8][i & 3]);
+	}
+
+	for (i = 0; i < 4; i++)
+		buf[i] += x[i];
+}
+
+
+/* TEA transform */
+static void ext2_htree_tea(uint32_t buf[4], const uint32_t in[4])
+{
+	uint32_t sum = 0, b0 = buf[0], b1 = buf[1];
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		sum += 0x9e3779b9;
+		b0 += ((b1 << 4) + in[0]) ^ (b1 + sum) ^ ((b1 >> 5) + in[1]);
+		b1 += ((b0 << 4) + in[2]) ^ (b0 + sum) ^ ((b0 >> 5) + in[3]);
+	}
+
+	buf[0] += b0;
+	buf[1] += b1;
+}
+
+
+/* Converts name into hash function input */
+static void ext2_htree_str2buf(const char *name, size_t len, uint32_t *buf, int n, int sign)
+{
+	uint32_t pad, val;
+	size_t i;
+
+	pad = (uint32_t)len | ((uint32_t)len << 8);
+	pad |= pad << 16;
+	val = pad;
+
+	if (len > n * 4)
+		len = n * 4;
+
+	for (i = 0; i < len; i++) {
+		val = ext2_htree_char(name[i], sign) + (val << 8);
+		if ((i % 4) == 3) {
+			*buf++ = val;
+			val = pad;
+			n--;
+		}
+	}
+
+	if (--n >= 0)
+		*buf++ = val;
+
+	while (--n >= 0)
+		*buf++ = pad;
+}
+
+
+/* Calculates name hash */
+static uint32_t ext2_htree_hash(ext2_t *fs, uint8_t version, const char *name, size_t len)
+{
+	uint32_t buf[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 }, in[8], hash = 0;
+	size_t i;
+	int sign;
+
+	if (fs->sb->hashSeed[0] || fs->sb->hashSeed[1] || fs->sb->hashSeed[2] || fs->sb->hashSeed[3])
+		memcpy(buf, fs->sb->hashSeed, sizeof(buf));
+
+	if ((version <= HASH_SIGNED_TEA) && (fs->sb->flags & MISC_UNSIGNED_HASH))
+		version += HASH_UNSIGNED_LEGACY;
+	sign = (version < HASH_UNSIGNED_LEGACY);
+
+	switch (version) {
+		case HASH_SIGNED_LEGACY:
+		case HASH_UNSIGNED_LEGACY:
+			hash = ext2_htree_legacy(name, len, sign);
+			break;
+
+		case HASH_SIGNED_MD4:
+		case HASH_UNSIGNED_MD4:
+			for (i = 0; i < len; i += 32) {
+				ext2_htree_str2buf(name + i, len - i, in, 8, sign);
+				ext2_htree_md4(buf, in);
+			}
+			hash = buf[1];
+			break;
+
+		case HASH_SIGNED_TEA:
+		case HASH_UNSIGNED_TEA:
+			for (i = 0; i < len; i += 16) {
+				ext2_htree_str2buf(name + i, len - i, in, 4, sign);
+				ext2_htree_tea(buf, in);
+			}
+			hash = buf[0];
+			break;
+	}
+
+	/* Lowest bit marks hash collision, highest hash value marks end of directory */
+	hash &= ~1;
+	if (hash == 0xfffffffe)
+		hash = 0xfffffffc;
+
+	return hash;
+}
+
+
+static int ext2_htree_cmp(const void *m1, const void *m2)
+{
+	const ext2_htree_map_t *map1 = (const ext2_htree_map_t *)m1;
+	const ext2_htree_map_t *map2 = (const ext2_htree_map_t *)m2;
+
+	if (map1->hash > map2->hash)
+		return 1;
+	else if (map1->hash < map2->hash)
+		return -1;
+
+	return (map1->offs > map2->offs) - (map1->offs < map2->offs);
+}
+
+
+/* Reads directory block */
+static int _ext2_htree_read(ext2_t *fs, ext2_obj_t *dir, uint32_t block, char *buff)
+{
+	ssize_t ret;
+
+	if ((ret = _ext2_file_read(fs, dir, (off_t)block * fs->blocksz, buff, fs->blocksz)) != fs->blocksz)
+		return (ret < 0) ? (int)ret : -EINVAL;
+
+	return EOK;
+}
+
+
+/* Writes directory block */
+static int _ext2_htree_write(ext2_t *fs, ext2_obj_t *dir, uint32_t block, const char *buff)
+{
+	ssize_t ret;
+
+	if ((ret = _ext2_file_write(fs, dir, (off_t)block * fs->blocksz, buff, fs->blocksz)) != fs->blocksz)
+		return (ret < 0) ? (int)ret : -EINVAL;
+
+	return EOK;
+}
+
+
+/* Drops inconsistent index, the directory is handled as a linear one from now on */
+static int _ext2_htree_drop(ext2_obj_t *dir)
+{
+	dir->inode->flags &= ~IFLAG_INDEX;
+	dir->flags |= OFLAG_DIRTY;
+
+	return -EAGAIN;
+}
+
+
+/* Releases lookup path buffers */
+static void ext2_htree_release(ext2_t *fs, char **bufs, uint32_t n)
+{
+	while (n--)
+		ext2_pool_put(fs, bufs[n]);
+}
+
+
+/* Gets lookup path buffers (and n extra blocks) from the pool */
+static int ext2_htree_alloc(ext2_t *fs, ext2_htree_path_t *path, char **bufs, uint32_t n)
+{
+	uint32_t i;
+
+	for (i = 0; i < HTREE_LEVELS + n; i++) {
+		if ((bufs[i] = (char *)ext2_pool_get(fs)) == NULL) {
+			ext2_htree_release(fs, bufs, i);
+			return -ENOMEM;
+		}
+	}
+
+	for (i = 0; i < HTREE_LEVELS; i++)
+		path->data[i] = bufs[i];
+
+	return EOK;
+}
+
+
+/* Reads index node pointed by the path at the given level */
+static int _ext2_htree_node(ext2_t *fs, ext2_obj_t *dir, ext2_htree_path_t *path, int level)
+{
+	ext2_dirent_t *entry;
+	ext2_dx_countlimit_t *cl;
+	int err;
+
+	path->block[level + 1] = path->entries[level][path->at[level]].block;
+	if (!path->block[level + 1] || (path->block[level + 1] >= dir->inode->size / fs->blocksz))
+		return _ext2_htree_drop(dir);
+
+	if ((err = _ext2_htree_read(fs, dir, path->block[level + 1], path->data[level + 1])) < 0)
+		return err;
+
+	entry = (ext2_dirent_t *)path->data[level + 1];
+	path->entries[level + 1] = (ext2_dx_entry_t *)(path->data[level + 1] + sizeof(ext2_dirent_t));
+	path->at[level + 1] = 0;
+	cl = ext2_htree_cl(path->entries[level + 1]);
+
+	if (entry->ino || (entry->size != fs->blocksz) || (cl->limit != (fs->blocksz - sizeof(ext2_dirent_t)) / sizeof(ext2_dx_entry_t)) || !cl->count || (cl->count > cl->limit))
+		return _ext2_htree_drop(dir);
+
+	return EOK;
+}
+
+
+/* Walks the index down to the leaf block, which may hold the name */
+static int _ext2_htree_probe(ext2_t *fs, ext2_obj_t *dir, const char *name, size_t len, ext2_htree_path_t *path)
+{
+	ext2_dx_countlimit_t *cl;
+	ext2_dx_info_t *info;
+	uint32_t l, r, m, block;
+	int i, err;
+
+	if ((err = _ext2_htree_read(fs, dir, 0, path->data[0])) < 0)
+		return err;
+
+	info = (ext2_dx_info_t *)(path->data[0] + HTREE_INFO);
+	path->entries[0] = (ext2_dx_entry_t *)(path->data[0] + HTREE_INFO + info->len);
+	path->block[0] = 0;
+	path->version = info->version;
+	path->levels = info->levels;
+	cl = ext2_htree_cl(path->entries[0]);
+
+	if (info->reserved || (info->version > HASH_SIGNED_TEA) || (info->len != sizeof(ext2_dx_info_t)) || (info->levels >= HTREE_LEVELS) ||
+		(cl->limit != (fs->blocksz - HTREE_INFO - info->len) / sizeof(ext2_dx_entry_t)) || !cl->count || (cl->count > cl->limit))
+		return _ext2_htree_drop(dir);
+
+	path->hash = ext2_htree_hash(fs, info->version, name, len);
+
+	for (i = 0;; i++) {
+		cl = ext2_htree_cl(path->entries[i]);
+
+		/* Find the last entry with hash not greater than the searched one */
+		for (l = 1, r = cl->count; l < r;) {
+			m = (l + r) / 2;
+			if (path->entries[i][m].hash > path->hash)
+				r = m;
+			else
+				l = m + 1;
+		}
+		path->at[i] = l - 1;
+
+		if (i == path->levels)
+			break;
+
+		if ((err = _ext2_htree_node(fs, dir, path, i)) < 0)
+			return err;
+	}
+
+	block = path->entries[i][path->at[i]].block;
+	if (!block || (block >= dir->inode->size / fs->blocksz))
+		return _ext2_htree_drop(dir);
+
+	return EOK;
+}
+
+
+/* Moves path to the next leaf block, returns 1 if it may also hold the searched hash */
+static int _ext2_htree_next(ext2_t *fs, ext2_obj_t *dir, ext2_htree_path_t *path)
+{
+	uint32_t block;
+	int i = path->levels, err;
+
+	while (path->at[i] + 1 >= ext2_htree_cl(path->entries[i])->count) {
+		if (i-- == 0)
+			return 0;
+	}
+
+	/* Next block continues the hash only on collision */
+	if ((path->entries[i][path->at[i] + 1].hash & ~1) != path->hash)
+		return 0;
+
+	for (path->at[i]++; i < path->levels; i++) {
+		if ((err = _ext2_htree_node(fs, dir, path, i)) < 0)
+			return err;
+	}
+
+	block = path->entries[i][path->at[i]].block;
+	if (!block || (block >= dir->inode->size / fs->blocksz))
+		return _ext2_htree_drop(dir);
+
+	return 1;
+}
+
+
+/* Searches leaf block for the name */
+static int ext2_htree_scan(ext2_t *fs, char *buff, const char *name, size_t len, uint32_t *offs)
+{
+	ext2_dirent_t *entry;
+
+	for (*offs = 0; *offs < fs->blocksz; *offs += entry->size) {
+		entry = (ext2_dirent_t *)(buff + *offs);
+
+		if (!entry->size)
+			break;
+
+		if (entry->ino && ((size_t)entry->len == len) && !strncmp(entry->name, name, len))
+			return EOK;
+	}
+
+	return -ENOENT;
+}
+
+
+/* Inserts entry into leaf block */
+static int ext2_htree_insert(ext2_t *fs, char *buff, const char *name, size_t len, uint8_t type, uint32_t ino)
+{
+	ext2_dirent_t *entry, *tmp;
+	uint32_t offs, used;
+
+	for (offs = 0; offs < fs->blocksz; offs += entry->size) {
+		entry = (ext2_dirent_t *)(buff + offs);
+
+		if (!entry->size)
+			break;
+
+		used = (entry->ino) ? ext2_htree_reclen(entry->len) : 0;
+		if (entry->size < used + ext2_htree_reclen(len))
+			continue;
+
+		/* Split used entry */
+		if (used) {
+			tmp = (ext2_dirent_t *)((char *)entry + used);
+			tmp->size = entry->size - used;
+			entry->size = used;
+			entry = tmp;
+		}
+
+		entry->ino = ino;
+		entry->len = len;
+		entry->type = type;
+		memcpy(entry->name, name, len);
+
+		return EOK;
+	}
+
+	return -ENOSPC;
+}
+
+
+/* Packs hashed entries into block */
+static void ext2_htree_pack(ext2_t *fs, const char *src, const ext2_htree_map_t *map, uint32_t n, char *dst)
+{
+	ext2_dirent_t *entry = NULL;
+	uint32_t i, offs = 0;
+
+	for (i = 0; i < n; i++, offs += entry->size) {
+		entry = (ext2_dirent_t *)(dst + offs);
+		memcpy(entry, src + map[i].offs, ext2_htree_reclen(((const ext2_dirent_t *)(src + map[i].offs))->len));
+		entry->size = ext2_htree_reclen(entry->len);
+	}
+
+	if (entry == NULL) {
+		entry = (ext2_dirent_t *)dst;
+		memset(entry, 0, sizeof(ext2_dirent_t));
+	}
+	entry->size += fs->blocksz - offs;
+}
+
+
+/* Inserts index entry */
+static void ext2_htree_link(ext2_dx_entry_t *entries, uint32_t at, uint32_t hash, uint32_t block)
+{
+	ext2_dx_countlimit_t *cl = ext2_htree_cl(entries);
+
+	memmove(entries + at + 1, entries + at, (cl->count - at) * sizeof(ext2_dx_entry_t));
+	entries[at].hash = hash;
+	entries[at].block = block;
+	cl->count++;
+}
+
+
+/* Appends index entry */
+static void ext2_htree_append(ext2_dx_entry_t *entries, uint32_t hash, uint32_t block)
+{
+	ext2_dx_countlimit_t *cl = ext2_htree_cl(entries);
+
+	if (cl->count)
+		entries[cl->count].hash = hash;
+	entries[cl->count++].block = block;
+}
+
+
+/* Makes room for a new entry in the index block at the given level */
+static int _ext2_htree_grow(ext2_t *fs, ext2_obj_t *dir, ext2_htree_path_t *path, int level, char *buff)
+{
+	ext2_dx_countlimit_t *cl = ext2_htree_cl(path->entries[level]);
+	ext2_dirent_t *entry = (ext2_dirent_t *)buff;
+	ext2_dx_entry_t *entries = (ext2_dx_entry_t *)(buff + sizeof(ext2_dirent_t));
+	uint32_t block, m;
+	int err;
+
+	if (cl->count < cl->limit)
+		return EOK;
+
+	memset(buff, 0, fs->blocksz);
+	entry->size = fs->blocksz;
+
+	/* Root is full => move its entries to a new node below it (index depth is limited to two levels) */
+	if (!level) {
+		if (path->levels)
+			return -ENOSPC;
+
+		block = dir->inode->size / fs->blocksz;
+		memcpy(entries, path->entries[0], cl->count * sizeof(ext2_dx_entry_t));
+		ext2_htree_cl(entries)->limit = (fs->blocksz - sizeof(ext2_dirent_t)) / sizeof(ext2_dx_entry_t);
+
+		if ((err = _ext2_htree_write(fs, dir, block, buff)) < 0)
+			return err;
+
+		cl->count = 1;
+		path->entries[0][0].block = block;
+		((ext2_dx_info_t *)(path->data[0] + HTREE_INFO))->levels = 1;
+
+		if ((err = _ext2_htree_write(fs, dir, 0, path->data[0])) < 0)
+			return err;
+
+		memcpy(path->data[1], buff, fs->blocksz);
+		path->entries[1] = (ext2_dx_entry_t *)(path->data[1] + sizeof(ext2_dirent_t));
+		path->block[1] = block;
+		path->at[1] = path->at[0];
+		path->at[0] = 0;
+		path->levels = 1;
+
+		return EOK;
+	}
+
+	/* Node is full => split it and link the upper half to the parent */
+	if ((err = _ext2_htree_grow(fs, dir, path, level - 1, buff)) < 0)
+		return err;
+
+	memset(buff, 0, fs->blocksz);
+	entry->size = fs->blocksz;
+
+	block = dir->inode->size / fs->blocksz;
+	m = cl->count / 2;
+	memcpy(entries, path->entries[level] + m, (cl->count - m) * sizeof(ext2_dx_entry_t));
+	ext2_htree_cl(entries)->limit = cl->limit;
+	ext2_htree_cl(entries)->count = cl->count - m;
+	ext2_htree_link(path->entries[level - 1], path->at[level - 1] + 1, path->entries[level][m].hash, block);
+	cl->count = m;
+
+	if ((err = _ext2_htree_write(fs, dir, block, buff)) < 0)
+		return err;
+
+	if ((err = _ext2_htree_write(fs, dir, path->block[level], path->data[level])) < 0)
+		return err;
+
+	if ((err = _ext2_htree_write(fs, dir, path->block[level - 1], path->data[level - 1])) < 0)
+		return err;
+
+	/* Followed entry has been moved to the new node */
+	if (path->at[level] >= m) {
+		memcpy(path->data[level], buff, fs->blocksz);
+		path->block[level] = block;
+		path->at[level] -= m;
+		path->at[level - 1]++;
+	}
+
+	return EOK;
+}
+
+
+/* Splits full leaf block in half by hash, returns the new block lowest hash */
+static int ext2_htree_split(ext2_t *fs, uint8_t version, char *leaf, char *buff, char *tmp, uint32_t *hash)
+{
+	ext2_htree_map_t *map;
+	ext2_dirent_t *entry;
+	uint32_t offs, size, n = 0, m;
+
+	/* Leaf entries map fits in a block */
+	if ((map = (ext2_htree_map_t *)ext2_pool_get(fs)) == NULL)
+		return -ENOMEM;
+
+	for (offs = 0, size = 0; offs < fs->blocksz; offs += entry->size) {
+		entry = (ext2_dirent_t *)(leaf + offs);
+
+		if (!entry->size)
+			break;
+
+		if (entry->ino) {
+			map[n].hash = ext2_htree_hash(fs, version, entry->name, entry->len);
+			map[n++].offs = offs;
+			size += ext2_htree_reclen(entry->len);
+		}
+	}
+
+	if (n < 2) {
+		ext2_pool_put(fs, map);
+		return -ENOSPC;
+	}
+
+	qsort(map, n, sizeof(ext2_htree_map_t), ext2_htree_cmp);
+
+	/* Move the upper half (by size) to the new block */
+	for (m = 0, offs = 0; (m < n - 1) && (offs < size / 2); m++)
+		offs += ext2_htree_reclen(((ext2_dirent_t *)(leaf + map[m].offs))->len);
+	if (!m)
+		m = 1;
+
+	*hash = map[m].hash | (map[m - 1].hash == map[m].hash);
+
+	ext2_htree_pack(fs, leaf, map + m, n - m, buff);
+	ext2_htree_pack(fs, leaf, map, m, tmp);
+	memcpy(leaf, tmp, fs->blocksz);
+	ext2_pool_put(fs, map);
+
+	return EOK;
+}
+
+
+int ext2_htree_indexed(ext2_t *fs, ext2_obj_t *dir)
+{
+	return (fs->sb->featureCompat & COMPAT_DIR_INDEX) && (dir->inode->flags & IFLAG_INDEX);
+}
+
+
+int ext2_htree_indexable(ext2_t *fs, ext2_obj_t *dir)
+{
+	return (fs->sb->featureCompat & COMPAT_DIR_INDEX) && !(dir->inode->flags & IFLAG_INDEX) &&
+		(fs->sb->hashAlgo <= HASH_SIGNED_TEA) && (dir->inode->size >= HTREE_THRESHOLD * fs->blocksz);
+}
+
+
+int _ext2_htree_find(ext2_t *fs, ext2_obj_t *dir, const char *name, size_t len, char *buff, uint32_t *offs)
+{
+	ext2_htree_path_t path;
+	char *bufs[HTREE_LEVELS];
+	uint32_t block;
+	int err;
+
+	if ((err = ext2_htree_alloc(fs, &path, bufs, 0)) < 0)
+		return err;
+
+	if ((err = _ext2_htree_probe(fs, dir, name, len, &path)) == EOK) {
+		do {
+			block = path.entries[path.levels][path.at[path.levels]].block;
+
+			if ((err = _ext2_htree_read(fs, dir, block, buff)) < 0)
+				break;
+
+			if (ext2_htree_scan(fs, buff, name, len, offs) == EOK) {
+				err = block * fs->blocksz;
+				break;
+			}
+		} while ((err = _ext2_htree_next(fs, dir, &path)) > 0);
+
+		if (!err)
+			err = -ENOENT;
+	}
+
+	ext2_htree_release(fs, bufs, HTREE_LEVELS);
+
+	return err;
+}
+
+
+int _ext2_htree_add(ext2_t *fs, ext2_obj_t *dir, const char *name, size_t len, uint8_t type, uint32_t ino)
+{
+	ext2_htree_path_t path;
+	char *bufs[HTREE_LEVELS + 3], *leaf, *buff, *tmp;
+	uint32_t block, hash;
+	int err;
+
+	if ((err = ext2_htree_alloc(fs, &path, bufs, 3)) < 0)
+		return err;
+
+	leaf = bufs[HTREE_LEVELS];
+	buff = bufs[HTREE_LEVELS + 1];
+	tmp = bufs[HTREE_LEVELS + 2];
+
+	do {
+		if ((err = _ext2_htree_probe(fs, dir, name, len, &path)) < 0)
+			break;
+
+		block = path.entries[path.levels][path.at[path.levels]].block;
+
+		if ((err = _ext2_htree_read(fs, dir, block, leaf)) < 0)
+			break;
+
+		if (ext2_htree_insert(fs, leaf, name, len, type, ino) == EOK) {
+			err = _ext2_htree_write(fs, dir, block, leaf);
+			break;
+		}
+
+		/* Leaf is full => make room in the index and split it */
+		if ((err = _ext2_htree_grow(fs, dir, &path, path.levels, buff)) < 0)
+			break;
+
+		if ((err = ext2_htree_split(fs, path.version, leaf, buff, tmp, &hash)) < 0)
+			break;
+
+		err = ext2_htree_insert(fs, ((path.hash >= (hash & ~1)) ? buff : leaf), name, len, type, ino);
+		if (err < 0)
+			break;
+
+		ext2_htree_link(path.entries[path.levels], path.at[path.levels] + 1, hash, dir->inode->size / fs->blocksz);
+
+		if ((err = _ext2_htree_write(fs, dir, dir->inode->size / fs->blocksz, buff)) < 0)
+			break;
+
+		if ((err = _ext2_htree_write(fs, dir, block, leaf)) < 0)
+			break;
+
+		err = _ext2_htree_write(fs, dir, path.block[path.levels], path.data[path.levels]);
+	} while (0);
+
+	ext2_htree_release(fs, bufs, HTREE_LEVELS + 3);
+
+	return err;
+}
+
+
+int _ext2_htree_build(ext2_t *fs, ext2_obj_t *dir)
+{
+	uint32_t i, j, k, offs, n = 0, nleaves = 0, nnodes = 0, nblocks = dir->inode->size / fs->blocksz, pino = 0;
+	uint32_t rlimit = (fs->blocksz - HTREE_INFO - sizeof(ext2_dx_info_t)) / sizeof(ext2_dx_entry_t);
+	uint32_t nlimit = (fs->blocksz - sizeof(ext2_dirent_t)) / sizeof(ext2_dx_entry_t);
+	uint8_t version = fs->sb->hashAlgo;
+	ext2_dx_entry_t *entries;
+	ext2_htree_map_t *map;
+	ext2_dirent_t *entry;
+	ext2_dx_info_t *info;
+	uint32_t *leaves;
+	char *data, *out;
+	ssize_t ret;
+	int err = EOK;
+
+	if ((data = (char *)malloc(dir->inode->size)) == NULL)
+		return -ENOMEM;
+
+	if ((ret = _ext2_file_read(fs, dir, 0, data, dir->inode->size)) != dir->inode->size) {
+		free(data);
+		return (ret < 0) ? (int)ret : -EINVAL;
+	}
+
+	if ((map = (ext2_htree_map_t *)malloc(dir->inode->size / ext2_htree_reclen(1) * sizeof(ext2_htree_map_t))) == NULL) {
+		free(data);
+		return -ENOMEM;
+	}
+
+	/* Hash all entries except "." and ".." */
+	for (offs = 0; offs < dir->inode->size; offs += entry->size) {
+		entry = (ext2_dirent_t *)(data + offs);
+
+		if (!entry->size) {
+			offs = (offs / fs->blocksz + 1) * fs->blocksz;
+			continue;
+		}
+
+		if (!entry->ino)
+			continue;
+
+		if ((entry->len == 1) && !strncmp(entry->name, ".", 1))
+			continue;
+
+		if ((entry->len == 2) && !strncmp(entry->name, "..", 2)) {
+			pino = entry->ino;
+			continue;
+		}
+
+		map[n].hash = ext2_htree_hash(fs, version, entry->name, entry->len);
+		map[n++].offs = offs;
+	}
+
+	qsort(map, n, sizeof(ext2_htree_map_t), ext2_htree_cmp);
+
+	/* Distribute entries into leaves filled up to 3/4, so inserts don't split them right away */
+	if ((leaves = (uint32_t *)malloc((n + 1) * sizeof(uint32_t))) == NULL) {
+		free(map);
+		free(data);
+		return -ENOMEM;
+	}
+
+	leaves[nleaves++] = 0;
+	for (i = 0, offs = 0; i < n; i++) {
+		j = ext2_htree_reclen(((ext2_dirent_t *)(data + map[i].offs))->len);
+		if (offs && (offs + j > fs->blocksz * 3 / 4)) {
+			leaves[nleaves++] = i;
+			offs = 0;
+		}
+		offs += j;
+	}
+	leaves[nleaves] = n;
+
+	if (nleaves > rlimit)
+		nnodes = (nleaves + nlimit - 1) / nlimit;
+
+	do {
+		if (!pino || (nnodes > rlimit)) {
+			err = -ENOSPC;
+			break;
+		}
+
+		if ((out = (char *)calloc(1 + nnodes + nleaves, fs->blocksz)) == NULL) {
+			err = -ENOMEM;
+			break;
+		}
+
+		/* Root block */
+		entry = (ext2_dirent_t *)out;
+		entry->ino = dir->id;
+		entry->size = 12;
+		entry->len = 1;
+		entry->type = DIRENT_DIR;
+		memcpy(entry->name, ".", 1);
+
+		entry = (ext2_dirent_t *)(out + 12);
+		entry->ino = pino;
+		entry->size = fs->blocksz - 12;
+		entry->len = 2;
+		entry->type = DIRENT_DIR;
+		memcpy(entry->name, "..", 2);
+
+		info = (ext2_dx_info_t *)(out + HTREE_INFO);
+		info->version = version;
+		info->len = sizeof(ext2_dx_info_t);
+		info->levels = (nnodes) ? 1 : 0;
+
+		entries = (ext2_dx_entry_t *)(out + HTREE_INFO + sizeof(ext2_dx_info_t));
+		ext2_htree_cl(entries)->limit = rlimit;
+
+		/* Index nodes */
+		for (k = 0; k < nnodes; k++) {
+			i = leaves[k * nlimit];
+			ext2_htree_append(entries, (k) ? map[i].hash | (map[i - 1].hash == map[i].hash) : 0, 1 + k);
+
+			entry = (ext2_dirent_t *)(out + (1 + k) * fs->blocksz);
+			entry->size = fs->blocksz;
+			ext2_htree_cl((ext2_dx_entry_t *)(entry + 1))->limit = nlimit;
+		}
+
+		/* Leaves */
+		for (j = 0; j < nleaves; j++) {
+			if (nnodes)
+				entries = (ext2_dx_entry_t *)(out + (1 + j / nlimit) * fs->blocksz + sizeof(ext2_dirent_t));
+
+			i = leaves[j];
+			ext2_htree_append(entries, (j) ? map[i].hash | (map[i - 1].hash == map[i].hash) : 0, 1 + nnodes + j);
+			ext2_htree_pack(fs, data, map + leaves[j], leaves[j + 1] - leaves[j], out + (1 + nnodes + j) * fs->blocksz);
+		}
+
+		if ((ret = _ext2_file_write(fs, dir, 0, out, (1 + nnodes + nleaves) * fs->blocksz)) != (1 + nnodes + nleaves) * fs->blocksz) {
+			err = (ret < 0) ? (int)ret : -EINVAL;
+		}
+		else if (1 + nnodes + nleaves < nblocks) {
+			err = _ext2_file_truncate(fs, dir, (1 + nnodes + nleaves) * fs->blocksz);
+		}
+		free(out);
+
+		if (err < 0)
+			break;
+
+		dir->inode->flags |= IFLAG_INDEX;
+		dir->flags |= OFLAG_DIRTY;
+	} while (0);
+
+	free(leaves);
+	free(map);
+	free(data);
+
+	return err;
+}
@@ -0,0 +1,48 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Hashed directory index (HTree)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _HTREE_H_
+#define _HTREE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ext2.h"
+
+
+/* Linear directory size (in blocks) above which the index is built */
+#define HTREE_THRESHOLD 1
+
+
+/* Checks if directory is indexed */
+extern int ext2_htree_indexed(ext2_t *fs, ext2_obj_t *dir);
+
+
+/* Checks if directory should be indexed before it grows */
+extern int ext2_htree_indexable(ext2_t *fs, ext2_obj_t *dir);
+
+
+/* Finds directory entry, returns entry block offset or -EAGAIN if directory isn't indexed anymore (requires object to be locked) */
+extern int _ext2_htree_find(ext2_t *fs, ext2_obj_t *dir, const char *name, size_t len, char *buff, uint32_t *offs);
+
+
+/* Adds directory entry, returns -EAGAIN if directory isn't indexed anymore (requires object to be locked) */
+extern int _ext2_htree_add(ext2_t *fs, ext2_obj_t *dir, const char *name, size_t len, uint8_t type, uint32_t ino);
+
+
+/* Converts linear directory into an indexed one (requires object to be locked) */
+extern int _ext2_htree_build(ext2_t *fs, ext2_obj_t *dir);
+
+
+#endif
@@ -19,123 +19,113 @@
 #include <string.h>
 
 #include <sys/stat.h>
+#include <sys/threads.h>
 
 #include "block.h"
+#include "bmp.h"
 #include "inode.h"
 
 
-int ext2_inode_sync(ext2_t *fs, uint32_t ino, ext2_inode_t *inode)
+uint32_t ext2_inode_bno(ext2_t *fs, uint32_t ino)
 {
 	uint32_t group = (ino - 1) / fs->sb->groupInodes;
 	uint32_t inodes = fs->blocksz / fs->sb->inodesz;
-	uint32_t bno = fs->gdt[group].inodeTbl + ((ino - 1) % fs->sb->groupInodes) / inodes;
+
+	return fs->gdt[group].inodeTbl + ((ino - 1) % fs->sb->groupInodes) / inodes;
+}
+
+
+int ext2_inode_sync(ext2_t *fs, uint32_t ino, ext2_inode_t *inode)
+{
+	uint32_t inodes = fs->blocksz / fs->sb->inodesz;
+	uint32_t bno = ext2_inode_bno(fs, ino);
 	char *buff;
 	int err;
 
 	if (((fs->root != NULL) && (ino < (uint32_t)fs->root->id)) || (ino > fs->sb->inodes))
 		return -EINVAL;
 
-	if ((buff = (char *)malloc(fs->blocksz)) == NULL)
+	if ((buff = (char *)ext2_pool_get(fs)) == NULL)
 		return -ENOMEM;
 
-	if ((err = ext2_block_read(fs, bno, buff, 1)) < 0) {
-		free(buff);
-		return err;
-	}
-
-	memcpy(buff + ((ino - 1) % inodes) * fs->sb->inodesz, inode, fs->sb->inodesz);
+	/* Inode table block is shared with other inodes */
+	mutexLock(fs->ilock);
 
-	if ((err = ext2_block_write(fs, bno, buff, 1)) < 0) {
-		free(buff);
-		return err;
+	if ((err = ext2_block_read(fs, bno, buff, 1)) == EOK) {
+		memcpy(buff + ((ino - 1) % inodes) * fs->sb->inodesz, inode, fs->sb->inodesz);
+		err = ext2_block_write(fs, bno, buff, 1);
 	}
 
-	free(buff);
+	mutexUnlock(fs->ilock);
+	ext2_pool_put(fs, buff);
 
-	return EOK;
+	return err;
 }
 
 
-ext2_inode_t *ext2_inode_init(ext2_t *fs, uint32_t ino)
+int ext2_inode_syncblk(ext2_t *fs, uint32_t bno, const void *img, const uint8_t *slots)
 {
-	uint32_t group = (ino - 1) / fs->sb->groupInodes;
-	uint32_t inodes = fs->blocksz / fs->sb->inodesz;
-	uint32_t bno = fs->gdt[group].inodeTbl + ((ino - 1) % fs->sb->groupInodes) / inodes;
-	ext2_inode_t *inode;
+	uint32_t i, inodes = fs->blocksz / fs->sb->inodesz;
 	char *buff;
+	int err;
 
-	if (((fs->root != NULL) && (ino < (uint32_t)fs->root->id)) || (ino > fs->sb->inodes))
-		return NULL;
-
-	if ((buff = (char *)malloc(fs->blocksz)) == NULL)
-		return NULL;
+	if ((buff = (char *)ext2_pool_get(fs)) == NULL)
+		return -ENOMEM;
 
-	if (ext2_block_read(fs, bno, buff, 1) < 0) {
-		free(buff);
-		return NULL;
-	}
+	mutexLock(fs->ilock);
 
-	if ((inode = (ext2_inode_t *)malloc(fs->sb->inodesz)) == NULL) {
-		free(buff);
-		return NULL;
+	/* Inodes not in the image may have been written back in the meantime */
+	if ((err = ext2_block_read(fs, bno, buff, 1)) == EOK) {
+		for (i = 0; i < inodes; i++) {
+			if (slots[i])
+				memcpy(buff + i * fs->sb->inodesz, (const char *)img + i * fs->sb->inodesz, fs->sb->inodesz);
+		}
+		err = ext2_block_write(fs, bno, buff, 1);
 	}
 
-	memcpy(inode, buff + ((ino - 1) % inodes) * fs->sb->inodesz, fs->sb->inodesz);
-	free(buff);
+	mutexUnlock(fs->ilock);
+	ext2_pool_put(fs, buff);
 
-	return inode;
+	return err;
 }
 
 
-int ext2_inode_destroy(ext2_t *fs, uint32_t ino, uint16_t mode)
+int ext2_inode_init(ext2_t *fs, uint32_t ino, ext2_inode_t *inode)
 {
-	uint32_t group = (ino - 1) / fs->sb->groupInodes;
-	void *bmp;
+	uint32_t inodes = fs->blocksz / fs->sb->inodesz;
+	uint32_t bno = ext2_inode_bno(fs, ino);
+	char *buff;
 	int err;
 
 	if (((fs->root != NULL) && (ino < (uint32_t)fs->root->id)) || (ino > fs->sb->inodes))
 		return -EINVAL;
 
-	if ((bmp = malloc(fs->blocksz)) == NULL)
+	if ((buff = (char *)ext2_pool_get(fs)) == NULL)
 		return -ENOMEM;
 
-	if ((err = ext2_block_read(fs, fs->gdt[group].inodeBmp, bmp, 1)) < 0) {
-		free(bmp);
+	if ((err = ext2_block_read(fs, bno, buff, 1)) < 0) {
+		ext2_pool_put(fs, buff);
 		return err;
 	}
 
-	ext2_togglebit(bmp, (ino - 1) % fs->sb->groupInodes + 1);
+	memcpy(inode, buff + ((ino - 1) % inodes) * fs->sb->inodesz, fs->sb->inodesz);
+	ext2_pool_put(fs, buff);
 
-	if ((err = ext2_block_write(fs, fs->gdt[group].inodeBmp, bmp, 1)) < 0) {
-		free(bmp);
-		return err;
-	}
+	return EOK;
+}
 
-	if (S_ISDIR(mode))
-		fs->gdt[group].dirs--;
-	fs->gdt[group].freeInodes++;
 
-	if ((err = ext2_gdt_syncone(fs, group)) < 0) {
-		ext2_togglebit(bmp, (ino - 1) % fs->sb->groupInodes + 1);
+int ext2_inode_destroy(ext2_t *fs, uint32_t ino, uint16_t mode)
+{
+	int err;
 
-		if (!ext2_block_write(fs, fs->gdt[group].inodeBmp, bmp, 1)) {
-			if (S_ISDIR(mode))
-				fs->gdt[group].dirs++;
-			fs->gdt[group].freeInodes--;
-		}
-		else {
-			fs->sb->freeInodes++;
-			ext2_sb_sync(fs);
-		}
+	if (((fs->root != NULL) && (ino < (uint32_t)fs->root->id)) || (ino > fs->sb->inodes))
+		return -EINVAL;
 
-		free(bmp);
+	if ((err = ext2_bmp_ifree(fs, ino, mode)) < 0)
 		return err;
-	}
 
-	free(bmp);
-	fs->sb->freeInodes++;
-
-	return ext2_sb_sync(fs);
+	return ext2_commit(fs);
 }
 
 
@@ -211,7 +201,6 @@ static uint32_t ext2_inode_dirgroup(ext2_t *fs, uint32_t pino)
 uint32_t ext2_inode_create(ext2_t *fs, uint32_t pino, uint16_t mode)
 {
 	uint32_t group, ino;
-	void *bmp;
 
 	if (S_ISDIR(mode))
 		group = ext2_inode_dirgroup(fs, pino);
@@ -221,52 +210,11 @@ uint32_t ext2_inode_create(ext2_t *fs, uint32_t pino, uint16_t mode)
 	if (group == fs->groups)
 		return 0;
 
-	if ((bmp = malloc(fs->blocksz)) == NULL)
-		return 0;
-
-	if (ext2_block_read(fs, fs->gdt[group].inodeBmp, bmp, 1) < 0) {
-		free(bmp);
-		return 0;
-	}
-
-	if (!(ino = ext2_findzerobit(bmp, fs->sb->groupInodes, 0))) {
-		free(bmp);
+	if (ext2_bmp_ialloc(fs, group, mode, &ino) < 0)
 		return 0;
-	}
-
-	ext2_togglebit(bmp, ino);
-
-	if (ext2_block_write(fs, fs->gdt[group].inodeBmp, bmp, 1) < 0) {
-		free(bmp);
-		return 0;
-	}
-
-	if (S_ISDIR(mode))
-		fs->gdt[group].dirs++;
-	fs->gdt[group].freeInodes--;
-
-	if (ext2_gdt_syncone(fs, group) < 0) {
-		ext2_togglebit(bmp, ino);
-
-		if (!ext2_block_write(fs, fs->gdt[group].inodeBmp, bmp, 1)) {
-			if (S_ISDIR(mode))
-				fs->gdt[group].dirs--;
-			fs->gdt[group].freeInodes++;
-		}
-		else {
-			fs->sb->freeInodes--;
-			ext2_sb_sync(fs);
-		}
-
-		free(bmp);
-		return 0;
-	}
-
-	free(bmp);
-	fs->sb->freeInodes--;
 
-	if (ext2_sb_sync(fs) < 0)
+	if (ext2_commit(fs) < 0)
 		return 0;
 
-	return group * fs->sb->groupInodes + ino;
+	return ino;
 }
@@ -116,12 +116,20 @@ typedef struct {
 } __attribute__ ((packed)) ext2_inode_t;
 
 
+/* Returns inode table block holding the inode */
+extern uint32_t ext2_inode_bno(ext2_t *fs, uint32_t ino);
+
+
 /* Synchronizes inode */
 extern int ext2_inode_sync(ext2_t *fs, uint32_t ino, ext2_inode_t *inode);
 
 
-/* Initializes inode */
-extern ext2_inode_t *ext2_inode_init(ext2_t *fs, uint32_t ino);
+/* Synchronizes inodes sharing an inode table block at once (slots select inodes copied from the block image) */
+extern int ext2_inode_syncblk(ext2_t *fs, uint32_t bno, const void *img, const uint8_t *slots);
+
+
+/* Reads inode into the buffer */
+extern int ext2_inode_init(ext2_t *fs, uint32_t ino, ext2_inode_t *inode);
 
 
 /* Destroys inode */
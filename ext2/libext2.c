@@ -66,11 +66,11 @@ static int libext2_create(void *info, oid_t *dir, const char *name, oid_t *oid,
 	size_t namelen = strlen(name);
 
 	if (ext2_lookup(fs, dir->id, name, namelen, oid, &devOther) > 0) {
-		if ((obj = ext2_obj_get(fs, oid->id)) == NULL) {
-			return -EINVAL;
+		if ((ret = ext2_obj_get(fs, oid->id, &obj)) < 0) {
+			return ret;
 		}
 
-		mutexLock(obj->lock);
+		ext2_obj_lock(obj);
 
 		if (EXT2_ISDEV(obj->inode->mode) && !EXT2_IS_MOUNTPOINT(obj)) {
 			/* This can happen if we have a device file stored in filesystem
@@ -83,12 +83,12 @@ static int libext2_create(void *info, oid_t *dir, const char *name, oid_t *oid,
 				oid->id = obj->id;
 				ret = _ext2_obj_sync(fs, obj);
 
-				mutexUnlock(obj->lock);
+				ext2_obj_unlock(obj);
 				ext2_obj_put(fs, obj);
 				return ret;
 			}
 			else {
-				mutexUnlock(obj->lock);
+				ext2_obj_unlock(obj);
 				ext2_obj_put(fs, obj);
 
 				if (ext2_unlink(fs, dir->id, name, namelen) < 0) {
@@ -97,7 +97,7 @@ static int libext2_create(void *info, oid_t *dir, const char *name, oid_t *oid,
 			}
 		}
 		else {
-			mutexUnlock(obj->lock);
+			ext2_obj_unlock(obj);
 			ext2_obj_put(fs, obj);
 			return -EEXIST;
 		}
@@ -114,7 +114,7 @@ static int libext2_create(void *info, oid_t *dir, const char *name, oid_t *oid,
 		retWrite = ext2_write(fs, oid->id, 0, target, targetlen);
 		if (retWrite < 0) {
 			ret = retWrite;
-			ext2_destroy(fs, oid->id);
+			(void)ext2_unlink(fs, dir->id, name, namelen);
 			oid->id = 0;
 		}
 	}
@@ -201,12 +201,61 @@ static int libext2_readdir(void *info, oid_t *oid, off_t offs, struct dirent *de
 }
 
 
+static int libext2_devctl(void *info, oid_t *oid, const void *i, void *o)
+{
+	const libext2_devctl_in_t *in = (const libext2_devctl_in_t *)i;
+	libext2_devctl_out_t *out = (libext2_devctl_out_t *)o;
+	ext2_t *fs = (ext2_t *)info;
+	ext2_objs_stat_t stat;
+	uint64_t minlen, trimmed, n;
+	uint32_t len;
+	int err;
+
+	switch (in->command) {
+		case LIBEXT2_DEVCTL_OBJSTAT:
+			ext2_objs_stat(fs, &stat);
+			out->objstat.size = stat.size;
+			out->objstat.count = stat.count;
+			out->objstat.hits = stat.hits;
+			out->objstat.misses = stat.misses;
+			out->objstat.evictions = stat.evictions;
+			return EOK;
+
+		case LIBEXT2_DEVCTL_SEEKDATA:
+		case LIBEXT2_DEVCTL_SEEKHOLE:
+			return ext2_seek(fs, oid->id, in->seek.offs, in->command == LIBEXT2_DEVCTL_SEEKHOLE, &out->seek.offs);
+
+		case LIBEXT2_DEVCTL_FSTRIM:
+			minlen = (in->trim.minlen + fs->blocksz - 1) / fs->blocksz;
+			err = ext2_trim(fs, (minlen > UINT32_MAX) ? UINT32_MAX : (uint32_t)minlen, &trimmed);
+			out->trim.trimmed = trimmed * fs->blocksz;
+			return err;
+
+		case LIBEXT2_DEVCTL_PREALLOC:
+			n = (in->prealloc.len + fs->blocksz - 1) / fs->blocksz;
+			if ((err = ext2_reserve(fs, oid->id, (n > UINT32_MAX) ? UINT32_MAX : (uint32_t)n, &len)) < 0)
+				return err;
+			out->prealloc.len = (uint64_t)len * fs->blocksz;
+			return EOK;
+
+		default:
+			return -EINVAL;
+	}
+}
+
+
 static int libext2_statfs(void *info, void *buf, size_t len)
 {
 	return ext2_statfs((ext2_t *)info, buf, len);
 }
 
 
+static int libext2_sync(void *info, oid_t *oid)
+{
+	return ext2_sync((ext2_t *)info);
+}
+
+
 int libext2_handler(void *fdata, msg_t *msg)
 {
 	switch (msg->type) {
@@ -247,7 +296,13 @@ int libext2_handler(void *fdata, msg_t *msg)
 			break;
 
 		case mtDevCtl:
-			msg->o.err = -EINVAL;
+			/* Packed directory listing returns entries in the message data buffer */
+			if (((libext2_devctl_in_t *)msg->i.raw)->command == LIBEXT2_DEVCTL_READDIR) {
+				msg->o.err = ext2_readdir(fdata, msg->oid.id, ((libext2_devctl_in_t *)msg->i.raw)->readdir.offs, msg->o.data, msg->o.size);
+			}
+			else {
+				msg->o.err = libext2_devctl(fdata, &msg->oid, msg->i.raw, msg->o.raw);
+			}
 			break;
 
 		case mtGetAttr:
@@ -281,6 +336,10 @@ int libext2_handler(void *fdata, msg_t *msg)
 			msg->o.err = libext2_statfs(fdata, msg->o.data, msg->o.size);
 			break;
 
+		case mtSync:
+			msg->o.err = libext2_sync(fdata, &msg->oid);
+			break;
+
 		default:
 			break;
 	}
@@ -289,60 +348,301 @@ int libext2_handler(void *fdata, msg_t *msg)
 }
 
 
-int libext2_unmount(void *fdata)
+/* Parses numeric mount option value */
+static int libext2_optnum(const char *val, uint32_t *res)
 {
-	ext2_t *fs = (ext2_t *)fdata;
+	char *end;
 
-	ext2_objs_destroy(fs);
-	ext2_gdt_destroy(fs);
-	ext2_sb_destroy(fs);
-	free(fs);
+	if ((val == NULL) || (*val == '\0'))
+		return -EINVAL;
+
+	*res = strtoul(val, &end, 0);
+	if (*end != '\0')
+		return -EINVAL;
 
 	return EOK;
 }
 
 
-int libext2_mount(oid_t *oid, unsigned int sectorsz, dev_read read, dev_write write, void **fdata)
+/* Parses mount options */
+static int libext2_opts(ext2_t *fs, const char *data)
+{
+	char *opts, *opt, *val, *tmp;
+	int err = EOK;
+
+	/* Default options */
+	fs->objsz = MAX_OBJECTS;
+	fs->cachesz = CACHE_SIZE;
+	fs->dcachesz = DCACHE_SIZE;
+	fs->dasz = DELALLOC_SIZE;
+	fs->pasz = PREALLOC_SIZE;
+	fs->rasz = READAHEAD_SIZE;
+	fs->commit = COMMIT_INTERVAL;
+	fs->sync = 0;
+	fs->discard = 0;
+	fs->atime = ATIME_RELATIVE;
+	fs->lazytime = 0;
+
+	if (data == NULL)
+		return EOK;
+
+	if ((opts = strdup(data)) == NULL)
+		return -ENOMEM;
+
+	for (opt = strtok_r(opts, ",", &tmp); opt != NULL; opt = strtok_r(NULL, ",", &tmp)) {
+		if ((val = strchr(opt, '=')) != NULL)
+			*val++ = '\0';
+
+		/* Unknown options are ignored */
+		if (!strcmp(opt, "objects"))
+			err = libext2_optnum(val, &fs->objsz);
+		else if (!strcmp(opt, "cache"))
+			err = libext2_optnum(val, &fs->cachesz);
+		else if (!strcmp(opt, "dcache"))
+			err = libext2_optnum(val, &fs->dcachesz);
+		else if (!strcmp(opt, "delalloc"))
+			err = libext2_optnum(val, &fs->dasz);
+		else if (!strcmp(opt, "prealloc"))
+			err = libext2_optnum(val, &fs->pasz);
+		else if (!strcmp(opt, "readahead"))
+			err = libext2_optnum(val, &fs->rasz);
+		else if (!strcmp(opt, "commit"))
+			err = libext2_optnum(val, &fs->commit);
+		else if (!strcmp(opt, "sync"))
+			fs->sync = 1;
+		else if (!strcmp(opt, "discard"))
+			fs->discard = 1;
+		else if (!strcmp(opt, "strictatime"))
+			fs->atime = ATIME_STRICT;
+		else if (!strcmp(opt, "relatime"))
+			fs->atime = ATIME_RELATIVE;
+		else if (!strcmp(opt, "noatime"))
+			fs->atime = ATIME_NONE;
+		else if (!strcmp(opt, "lazytime"))
+			fs->lazytime = 1;
+
+		if (err < 0)
+			break;
+	}
+
+	free(opts);
+
+	/* Synchronous mount writes data right away */
+	if (fs->sync)
+		fs->dasz = 0;
+
+	return err;
+}
+
+
+/* Periodically writes back modified filesystem data */
+static void libext2_flusher(void *arg)
+{
+	ext2_t *fs = (ext2_t *)arg;
+
+	mutexLock(fs->flusher.lock);
+
+	while (!fs->flusher.stop) {
+		condWait(fs->flusher.cond, fs->flusher.lock, (time_t)fs->commit * 1000000);
+
+		if (fs->flusher.stop)
+			break;
+
+		mutexUnlock(fs->flusher.lock);
+		ext2_flush(fs);
+		mutexLock(fs->flusher.lock);
+	}
+
+	mutexUnlock(fs->flusher.lock);
+
+	endthread();
+}
+
+
+/* Stops write-back thread */
+static void libext2_flusherstop(ext2_t *fs)
+{
+	if (fs->flusher.stack == NULL)
+		return;
+
+	mutexLock(fs->flusher.lock);
+	fs->flusher.stop = 1;
+	condSignal(fs->flusher.cond);
+	mutexUnlock(fs->flusher.lock);
+
+	threadJoin(fs->flusher.tid, 0);
+
+	resourceDestroy(fs->flusher.cond);
+	resourceDestroy(fs->flusher.lock);
+	free(fs->flusher.stack);
+	fs->flusher.stack = NULL;
+}
+
+
+/* Starts write-back thread */
+static int libext2_flusherstart(ext2_t *fs)
 {
-	ext2_t *fs;
 	int err;
 
-	if ((*fdata = fs = (ext2_t *)malloc(sizeof(ext2_t))) == NULL)
+	fs->flusher.stack = NULL;
+	fs->flusher.stop = 0;
+
+	/* Periodic write-back disabled */
+	if (!fs->commit || fs->sync)
+		return EOK;
+
+	if ((err = mutexCreate(&fs->flusher.lock)) < 0)
+		return err;
+
+	if ((err = condCreate(&fs->flusher.cond)) < 0) {
+		resourceDestroy(fs->flusher.lock);
+		return err;
+	}
+
+	if ((fs->flusher.stack = malloc(FLUSHER_STACKSZ)) == NULL) {
+		resourceDestroy(fs->flusher.cond);
+		resourceDestroy(fs->flusher.lock);
 		return -ENOMEM;
+	}
 
-	fs->sectorsz = sectorsz;
-	fs->strg = NULL;
-	fs->legacy.devId = oid->id;
-	fs->legacy.read = read;
-	fs->legacy.write = write;
-	fs->port = oid->port;
+	if ((err = beginthreadex(libext2_flusher, 4, fs->flusher.stack, FLUSHER_STACKSZ, fs, &fs->flusher.tid)) < 0) {
+		free(fs->flusher.stack);
+		fs->flusher.stack = NULL;
+		resourceDestroy(fs->flusher.cond);
+		resourceDestroy(fs->flusher.lock);
+		return err;
+	}
+
+	return EOK;
+}
+
+
+/* Releases filesystem resources */
+static void _libext2_unmount(ext2_t *fs)
+{
+	libext2_flusherstop(fs);
+	ext2_objs_destroy(fs);
+	ext2_dcache_destroy(fs);
+	ext2_bmp_destroy(fs);
+	ext2_gdt_destroy(fs);
+	ext2_cache_destroy(fs);
+	ext2_pool_destroy(fs);
+	ext2_sb_destroy(fs);
+	free(fs);
+}
+
+
+/* Initializes filesystem (common part of legacy and libstorage mount) */
+static int _libext2_mount(ext2_t *fs, const char *data)
+{
+	int err;
+
+	if ((err = libext2_opts(fs, data)) < 0) {
+		free(fs);
+		return err;
+	}
 
 	if ((err = ext2_sb_init(fs)) < 0) {
 		free(fs);
 		return err;
 	}
 
+	if ((err = ext2_pool_init(fs)) < 0) {
+		ext2_sb_destroy(fs);
+		free(fs);
+		return err;
+	}
+
+	if ((err = ext2_cache_init(fs)) < 0) {
+		ext2_pool_destroy(fs);
+		ext2_sb_destroy(fs);
+		free(fs);
+		return err;
+	}
+
 	if ((err = ext2_gdt_init(fs)) < 0) {
+		ext2_cache_destroy(fs);
+		ext2_pool_destroy(fs);
 		ext2_sb_destroy(fs);
 		free(fs);
 		return err;
 	}
 
-	if ((err = ext2_objs_init(fs)) < 0) {
+	if ((err = ext2_bmp_init(fs)) < 0) {
 		ext2_gdt_destroy(fs);
+		ext2_cache_destroy(fs);
+		ext2_pool_destroy(fs);
 		ext2_sb_destroy(fs);
 		free(fs);
 		return err;
 	}
 
-	if ((fs->root = ext2_obj_get(fs, ROOT_INO)) == NULL) {
-		ext2_objs_destroy(fs);
+	if ((err = ext2_dcache_init(fs)) < 0) {
+		ext2_bmp_destroy(fs);
 		ext2_gdt_destroy(fs);
+		ext2_cache_destroy(fs);
+		ext2_pool_destroy(fs);
 		ext2_sb_destroy(fs);
 		free(fs);
-		return -ENOENT;
+		return err;
 	}
 
+	if ((err = ext2_objs_init(fs)) < 0) {
+		ext2_dcache_destroy(fs);
+		ext2_bmp_destroy(fs);
+		ext2_gdt_destroy(fs);
+		ext2_cache_destroy(fs);
+		ext2_pool_destroy(fs);
+		ext2_sb_destroy(fs);
+		free(fs);
+		return err;
+	}
+
+	fs->flusher.stack = NULL;
+
+	if ((err = ext2_obj_get(fs, ROOT_INO, &fs->root)) < 0) {
+		_libext2_unmount(fs);
+		return err;
+	}
+
+	if ((err = libext2_flusherstart(fs)) < 0) {
+		_libext2_unmount(fs);
+		return err;
+	}
+
+	return EOK;
+}
+
+
+int libext2_unmount(void *fdata)
+{
+	_libext2_unmount((ext2_t *)fdata);
+
+	return EOK;
+}
+
+
+int libext2_mount(oid_t *oid, unsigned int sectorsz, dev_read read, dev_write write, void **fdata)
+{
+	ext2_t *fs;
+	int err;
+
+	if ((fs = (ext2_t *)malloc(sizeof(ext2_t))) == NULL)
+		return -ENOMEM;
+
+	fs->sectorsz = sectorsz;
+	fs->strg = NULL;
+	fs->legacy.devId = oid->id;
+	fs->legacy.read = read;
+	fs->legacy.write = write;
+	fs->port = oid->port;
+
+	/* Legacy mount takes no options, it keeps writing data and metadata synchronously */
+	if ((err = _libext2_mount(fs, "sync")) < 0)
+		return err;
+
+	*fdata = fs;
+
 	return ROOT_INO;
 }
 
@@ -356,7 +656,7 @@ const static storage_fsops_t fsOps = {
 	.getattr = libext2_getattr,
 	.getattrall = libext2_getattrAll,
 	.truncate = libext2_truncate,
-	.devctl = NULL,
+	.devctl = libext2_devctl,
 	.create = libext2_create,
 	.destroy = libext2_destroy,
 	.lookup = libext2_lookup,
@@ -364,17 +664,13 @@ const static storage_fsops_t fsOps = {
 	.unlink = libext2_unlink,
 	.readdir = libext2_readdir,
 	.statfs = libext2_statfs,
-	.sync = NULL
+	.sync = libext2_sync
 };
 
 
 int libext2_storage_umount(storage_fs_t *strg_fs)
 {
-	ext2_t *fs = (ext2_t *)strg_fs->info;
-	ext2_objs_destroy(fs);
-	ext2_gdt_destroy(fs);
-	ext2_sb_destroy(fs);
-	free(fs);
+	_libext2_unmount((ext2_t *)strg_fs->info);
 
 	return EOK;
 }
@@ -406,36 +702,14 @@ int libext2_storage_mount(storage_t *strg, storage_fs_t *fs, const char *data, u
 	info->legacy.read = NULL;
 	info->legacy.write = NULL;
 	info->port = root->port;
-	root->id = ROOT_INO;
-
-	fs->info = info;
-	fs->ops = &fsOps;
 
-	if ((err = ext2_sb_init(info)) < 0) {
-		free(info);
+	if ((err = _libext2_mount(info, data)) < 0) {
 		return err;
 	}
 
-	if ((err = ext2_gdt_init(info)) < 0) {
-		ext2_sb_destroy(info);
-		free(info);
-		return err;
-	}
-
-	if ((err = ext2_objs_init(info)) < 0) {
-		ext2_gdt_destroy(info);
-		ext2_sb_destroy(info);
-		free(info);
-		return err;
-	}
-
-	if ((info->root = ext2_obj_get(info, ROOT_INO)) == NULL) {
-		ext2_objs_destroy(info);
-		ext2_gdt_destroy(info);
-		ext2_sb_destroy(info);
-		free(info);
-		return -ENOENT;
-	}
+	root->id = ROOT_INO;
+	fs->info = info;
+	fs->ops = &fsOps;
 
 	return EOK;
 }
@@ -16,6 +16,7 @@
 #ifndef _LIBEXT2_H_
 #define _LIBEXT2_H_
 
+#include <dirent.h>
 #include <stdint.h>
 
 #include <sys/msg.h>
@@ -31,7 +32,75 @@
 #define LIBEXT2_MOUNT   libext2_mount
 
 
-/* Processes filesystem messages */
+/*
+ * Readdir (mtReaddir) always returns a single entry. Packed listing is requested explicitly with LIBEXT2_DEVCTL_READDIR
+ * devctl message (in.readdir.offs is the directory offset to list from, entries are returned in msg->o.data buffer):
+ * - buffer is filled with as many entries as fit, it has to fit at least the first one (-EINVAL otherwise)
+ * - each entry is a struct dirent with NUL terminated d_name, the next one starts LIBEXT2_DIRENT_SIZE(d_namlen) bytes
+ *   after it (entries are 8 bytes aligned)
+ * - entry d_reclen is the directory offset advance past it (spans the unused directory entries preceding it)
+ * - msg->o.err is the sum of the returned entries d_reclen (entries are walked until it's reached), the listing resumes
+ *   at in.readdir.offs + msg->o.err, -ENOENT is returned once there are no more entries
+ * The devctl is handled by libext2_handler() only (storage devctl callback has no output data buffer).
+ */
+#define LIBEXT2_DIRENT_SIZE(namlen) ((sizeof(struct dirent) + (namlen) + 1 + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1))
+
+
+/* Devctl commands */
+enum {
+	LIBEXT2_DEVCTL_OBJSTAT = 1,  /* Get objects cache statistics */
+	LIBEXT2_DEVCTL_SEEKDATA = 2, /* Find the first data offset at or after the given one (like lseek() SEEK_DATA) */
+	LIBEXT2_DEVCTL_SEEKHOLE = 3, /* Find the first hole offset at or after the given one (like lseek() SEEK_HOLE) */
+	LIBEXT2_DEVCTL_FSTRIM = 4,   /* Discard all free extents of at least the given length (like fstrim) */
+	LIBEXT2_DEVCTL_PREALLOC = 5, /* Reserve contiguous blocks for the following writes past the end of file (like fallocate() with FALLOC_FL_KEEP_SIZE), kept until the file is closed */
+	LIBEXT2_DEVCTL_READDIR = 6,  /* List directory entries packed into msg->o.data buffer (see LIBEXT2_DIRENT_SIZE()) */
+};
+
+
+/* Devctl request (passed in msg->i.raw) */
+typedef struct {
+	int command; /* Devctl command */
+	union {
+		struct {
+			off_t offs; /* Offset to search from */
+		} seek;
+		struct {
+			uint64_t minlen; /* Min free extent length to discard (bytes) */
+		} trim;
+		struct {
+			uint64_t len; /* Length to reserve (bytes) */
+		} prealloc;
+		struct {
+			off_t offs; /* Directory offset to list from */
+		} readdir;
+	};
+} libext2_devctl_in_t;
+
+
+/* Devctl response (returned in msg->o.raw) */
+typedef struct {
+	union {
+		struct {
+			uint32_t size;      /* Max number of objects */
+			uint32_t count;     /* Number of objects (in use and cached) */
+			uint64_t hits;      /* Objects found in use or cached */
+			uint64_t misses;    /* Objects read from the device */
+			uint64_t evictions; /* Cached objects evicted */
+		} objstat;
+		struct {
+			off_t offs; /* Found offset */
+		} seek;
+		struct {
+			uint64_t trimmed; /* Number of discarded bytes */
+		} trim;
+		struct {
+			uint64_t len; /* Reserved length (bytes), limited by the longest free extent */
+		} prealloc;
+	};
+} libext2_devctl_out_t;
+
+
+/* Processes filesystem messages (may be called by multiple threads at once) */
 extern int libext2_handler(void *fdata, msg_t *msg);
 
 
@@ -39,7 +108,7 @@ extern int libext2_handler(void *fdata, msg_t *msg);
 extern int libext2_unmount(void *fdata);
 
 
-/* Mounts filesystem */
+/* Mounts filesystem with synchronous writes (same as "sync" libstorage mount option) */
 extern int libext2_mount(oid_t *dev, unsigned int sectorsz, ssize_t (*read)(id_t, off_t, char *, size_t), ssize_t (*write)(id_t, off_t, const char *, size_t), void **fdata);
 
 /* Unmount filesystem callback for libstorage */
@@ -25,34 +25,206 @@
 #include <sys/threads.h>
 
 #include "block.h"
+#include "extent.h"
 #include "file.h"
 #include "obj.h"
 
 
-/* Releases object resources and removes it from objects in use */
+/* Returns objects stripe the object ID belongs to, IDs are hashed as inode numbers are correlated (e.g. first inodes of groups) */
+static inline ext2_stripe_t *ext2_obj_stripe(ext2_t *fs, id_t id)
+{
+	return fs->objs->stripes + ((((uint32_t)id * 2654435761U) >> 16) & (OBJ_STRIPES - 1));
+}
+
+
+/* Checks if object was borrowed from the shared objects pool */
+static inline int ext2_obj_shared(ext2_t *fs, ext2_obj_t *obj)
+{
+	return (obj >= fs->objs->shared) && (obj < fs->objs->shared + fs->objs->nshared);
+}
+
+
+/* Adds unreferenced object to its eviction queue (requires stripe to be locked) */
+static void _ext2_obj_enqueue(ext2_stripe_t *stripe, ext2_obj_t *obj)
+{
+	if (obj->flags & OFLAG_HOT) {
+		LIST_ADD(&stripe->hot, obj);
+	}
+	else {
+		LIST_ADD(&stripe->in, obj);
+		obj->stamp = stripe->seq++;
+		stripe->nin++;
+	}
+}
+
+
+/* Removes referenced object from its eviction queue (requires stripe to be locked) */
+static void _ext2_obj_dequeue(ext2_stripe_t *stripe, ext2_obj_t *obj)
+{
+	if (obj->flags & OFLAG_HOT) {
+		LIST_REMOVE(&stripe->hot, obj);
+	}
+	else {
+		LIST_REMOVE(&stripe->in, obj);
+		stripe->nin--;
+	}
+}
+
+
+/* Remembers ID of object evicted from the FIFO, the oldest ID is dropped if there's no room (requires stripe to be locked) */
+static void _ext2_stripe_addghost(ext2_stripe_t *stripe, uint32_t id)
+{
+	if (stripe->nghosts == stripe->maxghosts) {
+		stripe->ghosts[stripe->ghost] = id;
+		stripe->ghost = (stripe->ghost + 1) % stripe->maxghosts;
+	}
+	else {
+		stripe->ghosts[(stripe->ghost + stripe->nghosts++) % stripe->maxghosts] = id;
+	}
+}
+
+
+/* Checks if object was recently evicted from the FIFO and forgets its ID (requires stripe to be locked) */
+static int _ext2_stripe_ghost(ext2_stripe_t *stripe, uint32_t id)
+{
+	uint32_t i, pos;
+
+	for (i = 0; i < stripe->nghosts; i++) {
+		pos = (stripe->ghost + i) % stripe->maxghosts;
+
+		if (stripe->ghosts[pos] == id) {
+			stripe->ghosts[pos] = 0;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+/* Writes back object data, delayed blocks and modified indirect blocks (requires object to be locked) */
+static int _ext2_obj_flush(ext2_t *fs, ext2_obj_t *obj)
+{
+	uint32_t i;
+	int err;
+
+	if (obj->da.n && ((err = ext2_block_flush(fs, obj)) < 0))
+		return err;
+
+	free(obj->da.data);
+	obj->da.data = NULL;
+
+	if (!EXT2_ISDEV(obj->inode->mode) && !EXT2_IS_MOUNTPOINT(obj)) {
+		for (i = 0; i < 3; i++) {
+			if ((obj->ind[i].data == NULL) || !obj->ind[i].dirty)
+				continue;
+
+			if ((err = ext2_block_write(fs, obj->ind[i].bno, obj->ind[i].data, 1)) < 0)
+				return err;
+
+			obj->ind[i].dirty = 0;
+		}
+	}
+
+	return EOK;
+}
+
+
+/* Writes back object data and inode (requires object to be locked) */
+static int _ext2_obj_writeback(ext2_t *fs, ext2_obj_t *obj)
+{
+	int err;
+
+	if ((err = _ext2_obj_flush(fs, obj)) < 0)
+		return err;
+
+	if (obj->flags & (OFLAG_DIRTY | OFLAG_TIMES)) {
+		if ((err = ext2_inode_sync(fs, (uint32_t)obj->id, obj->inode)) < 0)
+			return err;
+
+		obj->flags &= ~(OFLAG_DIRTY | OFLAG_TIMES);
+	}
+
+	return EOK;
+}
+
+
+/* Writes back object data and inode */
+static int ext2_obj_writeback(ext2_t *fs, ext2_obj_t *obj)
+{
+	int ret;
+
+	ext2_obj_lock(obj);
+
+	ret = _ext2_obj_writeback(fs, obj);
+
+	ext2_obj_unlock(obj);
+
+	return ret;
+}
+
+
+/* Releases object resources and removes it from objects in use (requires stripe to be locked) */
 static int _ext2_obj_remove(ext2_t *fs, ext2_obj_t *obj)
 {
+	ext2_stripe_t *stripe = ext2_obj_stripe(fs, obj->id);
 	int err;
 
+	if ((err = ext2_block_unreserve(fs, obj)) < 0)
+		return err;
+
+	ext2_block_undelay(fs, obj, 0);
+
+	resourceDestroy(obj->rlock);
+	resourceDestroy(obj->cond);
 	if ((err = resourceDestroy(obj->lock)) < 0)
 		return err;
 
-	free(obj->inode);
+	free(obj->ext.data);
+	free(obj->dir.data);
+	free(obj->da.data);
 	free(obj->ind[0].data);
 	free(obj->ind[1].data);
 	free(obj->ind[2].data);
 
-	lib_rbRemove(&fs->objs->used, &obj->node);
-	fs->objs->count--;
+	lib_rbRemove(&stripe->used, &obj->node);
+	stripe->count--;
 
 	return EOK;
 }
 
 
-/* Destroys object */
+/* Returns removed object to the stripe or shared objects pool (requires stripe to be locked) */
+static void _ext2_obj_free(ext2_t *fs, ext2_stripe_t *stripe, ext2_obj_t *obj)
+{
+	ext2_objs_t *objs = fs->objs;
+
+	if (ext2_obj_shared(fs, obj)) {
+		mutexLock(objs->slock);
+		obj->next = objs->sfree;
+		objs->sfree = obj;
+		mutexUnlock(objs->slock);
+	}
+	else {
+		obj->next = stripe->free;
+		stripe->free = obj;
+	}
+}
+
+
+/* Destroys object (requires stripe to be locked) */
 static int _ext2_obj_destroy(ext2_t *fs, ext2_obj_t *obj, bool ignoreSync)
 {
-	int err = ext2_inode_destroy(fs, (uint32_t)obj->id, obj->inode->mode);
+	int err;
+
+	/* Deleted inode may still wait for write-back */
+	obj->inode->dtime = time(NULL);
+	err = ext2_inode_sync(fs, (uint32_t)obj->id, obj->inode);
+	if ((err < 0) && (!ignoreSync)) {
+		return err;
+	}
+
+	err = ext2_inode_destroy(fs, (uint32_t)obj->id, obj->inode->mode);
 	if ((err < 0) && (!ignoreSync)) {
 		return err;
 	}
@@ -62,167 +234,254 @@ static int _ext2_obj_destroy(ext2_t *fs, ext2_obj_t *obj, bool ignoreSync)
 		return err;
 	}
 
-	free(obj);
+	_ext2_obj_free(fs, ext2_obj_stripe(fs, obj->id), obj);
 
 	return EOK;
 }
 
 
-/* Removes object from LRU cache */
-static int _ext2_obj_removelru(ext2_t *fs)
+/* Evicts unreferenced object, objects referenced once go first so a scan doesn't push out the hot ones (requires stripe to be locked) */
+static int _ext2_obj_evict(ext2_t *fs, ext2_stripe_t *stripe)
 {
 	ext2_obj_t *obj;
 	int err;
 
-	if ((obj = fs->objs->lru) == NULL)
-		return -ENOENT;
+	if ((stripe->in != NULL) && ((stripe->nin > stripe->size / 4) || (stripe->hot == NULL)))
+		obj = stripe->in;
+	else if ((obj = stripe->hot) == NULL)
+		return -ENFILE;
 
-	if ((err = ext2_obj_sync(fs, obj)) < 0)
+	if ((err = ext2_obj_writeback(fs, obj)) < 0)
 		return err;
 
 	if ((err = _ext2_obj_remove(fs, obj)) < 0)
 		return err;
 
-	LIST_REMOVE(&fs->objs->lru, obj);
-	free(obj);
+	/* Object referenced again soon after eviction is hot */
+	if (!(obj->flags & OFLAG_HOT))
+		_ext2_stripe_addghost(stripe, (uint32_t)obj->id);
+
+	_ext2_obj_dequeue(stripe, obj);
+	_ext2_obj_free(fs, stripe, obj);
+	stripe->evictions++;
 
 	return EOK;
 }
 
 
-/* Creates new object */
-static int _ext2_obj_create(ext2_t *fs, uint32_t pino, ext2_inode_t *inode, uint16_t mode, ext2_obj_t **res)
+/* Takes free object from the stripe pool, cached objects are evicted before borrowing shared ones (requires stripe to be locked) */
+static int _ext2_obj_alloc(ext2_t *fs, ext2_stripe_t *stripe, ext2_obj_t **res)
 {
+	ext2_objs_t *objs = fs->objs;
+	ext2_obj_t *obj;
+
+	if ((stripe->free != NULL) || (_ext2_obj_evict(fs, stripe) == EOK)) {
+		obj = stripe->free;
+		stripe->free = obj->next;
+	}
+	else {
+		mutexLock(objs->slock);
+		if ((obj = objs->sfree) != NULL)
+			objs->sfree = obj->next;
+		mutexUnlock(objs->slock);
+
+		if (obj == NULL)
+			return -ENFILE;
+	}
+
+	*res = obj;
+
+	return EOK;
+}
+
+
+/* Creates new object for the inode, its inode is taken from the pool and has to be initialized (requires stripe to be locked) */
+static int _ext2_obj_create(ext2_t *fs, ext2_stripe_t *stripe, uint32_t ino, ext2_obj_t **res)
+{
+	ext2_inode_t *inode;
 	ext2_obj_t *obj;
-	uint32_t ino;
 	int err;
 
-	if (inode == NULL) {
-		if (!(ino = ext2_inode_create(fs, pino, mode)))
-			return -ENOSPC;
+	if ((err = _ext2_obj_alloc(fs, stripe, &obj)) < 0)
+		return err;
 
-		if ((inode = (ext2_inode_t *)malloc(fs->sb->inodesz)) == NULL) {
-			ext2_inode_destroy(fs, ino, mode);
-			return -ENOMEM;
-		}
+	/* Object inode is assigned once the pool is initialized */
+	inode = obj->inode;
+	memset(obj, 0, sizeof(ext2_obj_t));
+	obj->inode = inode;
 
-		memset(inode, 0, fs->sb->inodesz);
-		inode->ctime = inode->mtime = inode->atime = time(NULL);
-		inode->mode = mode;
+	if ((err = mutexCreate(&obj->lock)) < 0) {
+		_ext2_obj_free(fs, stripe, obj);
+		return err;
 	}
-	else {
-		ino = pino;
+
+	if ((err = condCreate(&obj->cond)) < 0) {
+		resourceDestroy(obj->lock);
+		_ext2_obj_free(fs, stripe, obj);
+		return err;
 	}
 
-	do {
-		if ((fs->objs->count >= MAX_OBJECTS) && ((err = _ext2_obj_removelru(fs)) < 0))
-			break;
+	if ((err = mutexCreate(&obj->rlock)) < 0) {
+		resourceDestroy(obj->cond);
+		resourceDestroy(obj->lock);
+		_ext2_obj_free(fs, stripe, obj);
+		return err;
+	}
 
-		if ((*res = obj = (ext2_obj_t *)malloc(sizeof(ext2_obj_t))) == NULL) {
-			err = -ENOMEM;
-			break;
-		}
+	obj->id = ino;
+	obj->refs = 1;
+	obj->prev = NULL;
+	obj->next = NULL;
 
-		memset(obj, 0, sizeof(ext2_obj_t));
+	lib_rbInsert(&stripe->used, &obj->node);
+	stripe->count++;
+	*res = obj;
 
-		if ((err = mutexCreate(&obj->lock)) < 0) {
-			free(obj);
-			*res = NULL;
-			break;
-		}
+	return EOK;
+}
 
-		obj->id = ino;
-		obj->refs = 1;
-		obj->flags = OFLAG_DIRTY;
-		obj->inode = inode;
-		obj->prev = NULL;
-		obj->next = NULL;
 
-		lib_rbInsert(&fs->objs->used, &obj->node);
-		fs->objs->count++;
+void ext2_obj_rdlock(ext2_obj_t *obj)
+{
+	mutexLock(obj->lock);
 
-		return EOK;
-	} while (0);
+	/* Waiting writers go first, so readers can't starve them */
+	while (obj->writer || obj->waiting)
+		condWait(obj->cond, obj->lock, 0);
+	obj->readers++;
 
-	free(inode);
-	ext2_inode_destroy(fs, ino, mode);
+	mutexUnlock(obj->lock);
+}
 
-	return err;
+
+void ext2_obj_lock(ext2_obj_t *obj)
+{
+	mutexLock(obj->lock);
+
+	obj->waiting++;
+	while (obj->writer || obj->readers)
+		condWait(obj->cond, obj->lock, 0);
+	obj->waiting--;
+	obj->writer = 1;
+
+	mutexUnlock(obj->lock);
 }
 
 
-ext2_obj_t *ext2_obj_get(ext2_t *fs, id_t id)
+void ext2_obj_unlock(ext2_obj_t *obj)
 {
+	mutexLock(obj->lock);
+
+	if (obj->writer)
+		obj->writer = 0;
+	else
+		obj->readers--;
+
+	if (!obj->readers)
+		condBroadcast(obj->cond);
+
+	mutexUnlock(obj->lock);
+}
+
+
+int ext2_obj_get(ext2_t *fs, id_t id, ext2_obj_t **res)
+{
+	ext2_stripe_t *stripe = ext2_obj_stripe(fs, id);
 	ext2_obj_t *obj, tmp;
-	ext2_inode_t *inode;
+	int err = EOK;
 
-	mutexLock(fs->objs->lock);
+	mutexLock(stripe->lock);
 	do {
 		tmp.id = id;
-		obj = lib_treeof(ext2_obj_t, node, lib_rbFind(&fs->objs->used, &tmp.node));
+		obj = lib_treeof(ext2_obj_t, node, lib_rbFind(&stripe->used, &tmp.node));
 		if (obj != NULL) {
 			obj->refs++;
 			if ((obj->refs == 1) && !EXT2_IS_MOUNTPOINT(obj)) {
-				LIST_REMOVE(&fs->objs->lru, obj);
+				_ext2_obj_dequeue(stripe, obj);
+
+				/* References closer than a quarter of the stripe FIFO insertions are correlated (e.g. lookup followed by open), further ones make the object hot */
+				if (stripe->seq - obj->stamp > stripe->size / 4) {
+					obj->flags |= OFLAG_HOT;
+				}
 			}
+			stripe->hits++;
 			break;
 		}
 
-		if ((inode = ext2_inode_init(fs, (uint32_t)id)) == NULL) {
+		if ((err = _ext2_obj_create(fs, stripe, (uint32_t)id, &obj)) < 0)
 			break;
-		}
 
-		if (_ext2_obj_create(fs, (uint32_t)id, inode, inode->mode, &obj) < 0) {
+		if ((err = ext2_inode_init(fs, (uint32_t)id, obj->inode)) < 0) {
+			_ext2_obj_remove(fs, obj);
+			_ext2_obj_free(fs, stripe, obj);
 			break;
 		}
+
+		if (_ext2_stripe_ghost(stripe, (uint32_t)id)) {
+			obj->flags |= OFLAG_HOT;
+		}
+		stripe->misses++;
 	} while (0);
 
-	mutexUnlock(fs->objs->lock);
+	mutexUnlock(stripe->lock);
+
+	if (err == EOK)
+		*res = obj;
+
+	return err;
+}
+
+
+/* Checks if deleted object has data blocks to free (fast symlinks and devices keep none) */
+static inline int ext2_obj_hasblocks(ext2_obj_t *obj)
+{
+	if (!obj->inode->blocks || EXT2_ISDEV(obj->inode->mode) || EXT2_IS_MOUNTPOINT(obj) || ext2_extent_mapped(obj))
+		return 0;
 
-	return obj;
+	return !S_ISLNK(obj->inode->mode) || (obj->inode->size > MAX_SYMLINK_LEN_IN_INODE);
 }
 
 
 void ext2_obj_put(ext2_t *fs, ext2_obj_t *obj)
 {
-	mutexLock(fs->objs->lock);
+	ext2_stripe_t *stripe = ext2_obj_stripe(fs, obj->id);
+
+	mutexLock(stripe->lock);
+
+	/* Last reference to deleted object => free its blocks first, without holding the stripe lock */
+	if ((obj->refs == 1) && !obj->inode->links && ext2_obj_hasblocks(obj)) {
+		mutexUnlock(stripe->lock);
+		(void)ext2_obj_truncate(fs, obj, 0);
+		mutexLock(stripe->lock);
+	}
 
 	obj->refs--;
 	if ((obj->refs == 0) && !EXT2_IS_MOUNTPOINT(obj)) {
 		if (!obj->inode->links) {
 			_ext2_obj_destroy(fs, obj, false);
 		}
+		/* Shared object is returned right away, so other stripes can borrow it */
+		else if (!ext2_obj_shared(fs, obj) || (ext2_obj_writeback(fs, obj) < 0) || (_ext2_obj_remove(fs, obj) < 0)) {
+			/* Last reference dropped => release preallocated blocks */
+			ext2_block_unreserve(fs, obj);
+			_ext2_obj_enqueue(stripe, obj);
+		}
 		else {
-			LIST_ADD(&fs->objs->lru, obj);
+			_ext2_obj_free(fs, stripe, obj);
 		}
 	}
 
-	mutexUnlock(fs->objs->lock);
+	mutexUnlock(stripe->lock);
 }
 
 
 int _ext2_obj_sync(ext2_t *fs, ext2_obj_t *obj)
 {
-	int err;
+	/* Modified inodes are written back together with other inodes sharing their table blocks */
+	if (!fs->sync)
+		return _ext2_obj_flush(fs, obj);
 
-	if (EXT2_IS_DIRTY(obj)) {
-		if ((err = ext2_inode_sync(fs, (uint32_t)obj->id, obj->inode)) < 0)
-			return err;
-
-		obj->flags &= ~OFLAG_DIRTY;
-	}
-	if (!EXT2_ISDEV(obj->inode->mode) && !EXT2_IS_MOUNTPOINT(obj)) {
-		if ((obj->ind[0].data != NULL) && (err = ext2_block_write(fs, obj->ind[0].bno, obj->ind[0].data, 1)) < 0)
-			return err;
-
-		if ((obj->ind[1].data != NULL) && (err = ext2_block_write(fs, obj->ind[1].bno, obj->ind[1].data, 1)) < 0)
-			return err;
-
-		if ((obj->ind[2].data != NULL) && (err = ext2_block_write(fs, obj->ind[2].bno, obj->ind[2].data, 1)) < 0)
-			return err;
-	}
-
-	return EOK;
+	return _ext2_obj_writeback(fs, obj);
 }
 
 
@@ -230,11 +489,11 @@ int ext2_obj_sync(ext2_t *fs, ext2_obj_t *obj)
 {
 	int ret;
 
-	mutexLock(obj->lock);
+	ext2_obj_lock(obj);
 
 	ret = _ext2_obj_sync(fs, obj);
 
-	mutexUnlock(obj->lock);
+	ext2_obj_unlock(obj);
 
 	return ret;
 }
@@ -244,7 +503,7 @@ int ext2_obj_truncate(ext2_t *fs, ext2_obj_t *obj, size_t size)
 {
 	int err;
 
-	mutexLock(obj->lock);
+	ext2_obj_lock(obj);
 
 	do {
 		if ((err = _ext2_file_truncate(fs, obj, size)) < 0)
@@ -254,7 +513,7 @@ int ext2_obj_truncate(ext2_t *fs, ext2_obj_t *obj, size_t size)
 			break;
 	} while (0);
 
-	mutexUnlock(obj->lock);
+	ext2_obj_unlock(obj);
 
 	return err;
 }
@@ -262,46 +521,295 @@ int ext2_obj_truncate(ext2_t *fs, ext2_obj_t *obj, size_t size)
 
 int ext2_obj_destroy(ext2_t *fs, ext2_obj_t *obj)
 {
+	ext2_stripe_t *stripe = ext2_obj_stripe(fs, obj->id);
 	int ret;
 
-	mutexLock(fs->objs->lock);
+	mutexLock(stripe->lock);
 
 	ret = _ext2_obj_destroy(fs, obj, false);
 
-	mutexUnlock(fs->objs->lock);
+	mutexUnlock(stripe->lock);
 
 	return ret;
 }
 
 
-int ext2_obj_create(ext2_t *fs, uint32_t pino, ext2_inode_t *inode, uint16_t mode, ext2_obj_t **res)
+int ext2_obj_create(ext2_t *fs, uint32_t pino, uint16_t mode, ext2_obj_t **res)
 {
-	int ret;
+	ext2_stripe_t *stripe;
+	uint32_t ino;
+	int err;
+
+	if (!(ino = ext2_inode_create(fs, pino, mode)))
+		return -ENOSPC;
+
+	stripe = ext2_obj_stripe(fs, ino);
+	mutexLock(stripe->lock);
+
+	if ((err = _ext2_obj_create(fs, stripe, ino, res)) == EOK) {
+		/* New inode has to be written back */
+		(*res)->flags = OFLAG_DIRTY;
+		memset((*res)->inode, 0, fs->sb->inodesz);
+		(*res)->inode->ctime = (*res)->inode->mtime = (*res)->inode->atime = time(NULL);
+		(*res)->inode->mode = mode;
+	}
+
+	mutexUnlock(stripe->lock);
+
+	if (err < 0)
+		ext2_inode_destroy(fs, ino, mode);
+
+	return err;
+}
+
+
+void _ext2_obj_times(ext2_t *fs, ext2_obj_t *obj)
+{
+	if (!fs->lazytime) {
+		obj->flags |= OFLAG_DIRTY;
+	}
+	else if (!(obj->flags & (OFLAG_DIRTY | OFLAG_TIMES))) {
+		obj->flags |= OFLAG_TIMES;
+		obj->ttime = time(NULL);
+	}
+}
+
+
+void ext2_obj_atime(ext2_t *fs, ext2_obj_t *obj)
+{
+	ext2_inode_t *inode = obj->inode;
+	time_t now;
+
+	if ((fs->atime == ATIME_NONE) || (inode->flags & IFLAG_NOATIME))
+		return;
+
+	now = time(NULL);
+
+	mutexLock(obj->rlock);
+
+	if ((inode->atime != (uint32_t)now) &&
+		((fs->atime == ATIME_STRICT) || (inode->atime <= inode->mtime) || (inode->atime <= inode->ctime) || ((uint32_t)now - inode->atime >= 24 * 60 * 60))) {
+		inode->atime = now;
+		_ext2_obj_times(fs, obj);
+	}
+
+	mutexUnlock(obj->rlock);
+}
+
+
+/* References modified objects of the stripe, so they can be synchronized without holding stripe lock */
+static uint32_t ext2_stripe_modified(ext2_stripe_t *stripe, ext2_obj_t **objs, uint32_t size, int lazy)
+{
+	time_t now = time(NULL);
+	ext2_obj_t *obj;
+	rbnode_t *node;
+	uint32_t n = 0;
+
+	mutexLock(stripe->lock);
+
+	for (node = lib_rbMinimum(stripe->used.root); (node != NULL) && (n < size); node = lib_rbNext(node)) {
+		obj = lib_treeof(ext2_obj_t, node, node);
+
+		/* Timestamps only updates are written back on periodic write-back once they expire */
+		if (!ext2_obj_modified(obj) && (!(obj->flags & OFLAG_TIMES) || (lazy && (now - obj->ttime < LAZYTIME_EXPIRE))))
+			continue;
+
+		obj->refs++;
+		if ((obj->refs == 1) && !EXT2_IS_MOUNTPOINT(obj))
+			_ext2_obj_dequeue(stripe, obj);
+		objs[n++] = obj;
+	}
+
+	mutexUnlock(stripe->lock);
+
+	return n;
+}
+
+
+static int ext2_obj_idcmp(const void *obj1, const void *obj2)
+{
+	id_t id1 = (*(ext2_obj_t *const *)obj1)->id;
+	id_t id2 = (*(ext2_obj_t *const *)obj2)->id;
+
+	return (id1 > id2) - (id1 < id2);
+}
+
+
+/* Synchronizes objects sharing an inode table block, the block is written back once */
+static int ext2_objs_syncblk(ext2_t *fs, uint32_t bno, ext2_obj_t **objs, uint32_t n)
+{
+	uint32_t i, slot, inodes = fs->blocksz / fs->sb->inodesz;
+	uint8_t *slots = fs->objs->slots;
+	int err, ret = EOK;
+	void *img;
+
+	if ((img = ext2_pool_get(fs)) == NULL)
+		return -ENOMEM;
+
+	memset(slots, 0, inodes);
+
+	/* Take inodes snapshots, objects are locked one at a time */
+	for (i = 0; i < n; i++) {
+		ext2_obj_lock(objs[i]);
+
+		if ((err = _ext2_obj_flush(fs, objs[i])) < 0) {
+			ret = err;
+		}
+		else if (objs[i]->flags & (OFLAG_DIRTY | OFLAG_TIMES)) {
+			slot = ((uint32_t)objs[i]->id - 1) % inodes;
+			memcpy((char *)img + slot * fs->sb->inodesz, objs[i]->inode, fs->sb->inodesz);
+			objs[i]->flags &= ~(OFLAG_DIRTY | OFLAG_TIMES);
+			slots[slot] = 1;
+		}
+
+		ext2_obj_unlock(objs[i]);
+	}
+
+	if ((err = ext2_inode_syncblk(fs, bno, img, slots)) < 0) {
+		/* Inodes need to be written back again */
+		for (i = 0; i < n; i++) {
+			if (!slots[((uint32_t)objs[i]->id - 1) % inodes])
+				continue;
+
+			ext2_obj_lock(objs[i]);
+			objs[i]->flags |= OFLAG_DIRTY;
+			ext2_obj_unlock(objs[i]);
+		}
+		ret = err;
+	}
+
+	ext2_pool_put(fs, img);
+
+	return ret;
+}
+
 
-	mutexLock(fs->objs->lock);
+int ext2_objs_sync(ext2_t *fs, int lazy)
+{
+	ext2_objs_t *objs = fs->objs;
+	uint32_t i, j, bno, n = 0;
+	int err, ret = EOK;
+
+	mutexLock(objs->lock);
+
+	for (i = 0; i < OBJ_STRIPES; i++)
+		n += ext2_stripe_modified(objs->stripes + i, objs->dirty + n, objs->size - n, lazy);
+
+	/* Synchronous mount => inodes are written back on each update */
+	if (fs->sync) {
+		for (i = 0; i < n; i++) {
+			if ((err = ext2_obj_sync(fs, objs->dirty[i])) < 0)
+				ret = err;
+		}
+	}
+	else {
+		/* Group objects by inode table blocks */
+		qsort(objs->dirty, n, sizeof(ext2_obj_t *), ext2_obj_idcmp);
+
+		for (i = 0; i < n; i = j) {
+			bno = ext2_inode_bno(fs, (uint32_t)objs->dirty[i]->id);
+			for (j = i + 1; (j < n) && (ext2_inode_bno(fs, (uint32_t)objs->dirty[j]->id) == bno); j++);
+
+			if ((err = ext2_objs_syncblk(fs, bno, objs->dirty + i, j - i)) < 0)
+				ret = err;
+		}
+	}
 
-	ret = _ext2_obj_create(fs, pino, inode, mode, res);
+	for (i = 0; i < n; i++)
+		ext2_obj_put(fs, objs->dirty[i]);
 
-	mutexUnlock(fs->objs->lock);
+	mutexUnlock(objs->lock);
 
 	return ret;
 }
 
 
+void ext2_objs_stat(ext2_t *fs, ext2_objs_stat_t *stat)
+{
+	ext2_stripe_t *stripe;
+	uint32_t i;
+
+	memset(stat, 0, sizeof(ext2_objs_stat_t));
+	stat->size = fs->objs->size;
+
+	for (i = 0; i < OBJ_STRIPES; i++) {
+		stripe = fs->objs->stripes + i;
+		mutexLock(stripe->lock);
+
+		stat->count += stripe->count;
+		stat->hits += stripe->hits;
+		stat->misses += stripe->misses;
+		stat->evictions += stripe->evictions;
+
+		mutexUnlock(stripe->lock);
+	}
+}
+
+
+/* Releases stripe resources */
+static void ext2_stripe_destroy(ext2_stripe_t *stripe)
+{
+	resourceDestroy(stripe->lock);
+	free(stripe->ghosts);
+	free(stripe->inodes);
+	free(stripe->pool);
+}
+
+
 void ext2_objs_destroy(ext2_t *fs)
 {
+	ext2_stripe_t *stripe;
 	rbnode_t *node, *next;
+	ext2_obj_t *obj;
+	uint32_t i;
+
+	/* Write back objects before releasing any of them (inodes are validated against the root object) */
+	ext2_objs_sync(fs, 0);
+
+	for (i = 0; i < OBJ_STRIPES; i++) {
+		stripe = fs->objs->stripes + i;
+		mutexLock(stripe->lock);
 
-	mutexLock(fs->objs->lock);
+		for (node = lib_rbMinimum(stripe->used.root); node; node = next) {
+			next = lib_rbNext(node);
+			obj = lib_treeof(ext2_obj_t, node, node);
 
-	for (node = lib_rbMinimum(fs->objs->used.root); node; node = next) {
-		next = lib_rbNext(node);
-		_ext2_obj_destroy(fs, lib_treeof(ext2_obj_t, node, node), true);
+			if (!obj->inode->links) {
+				if (ext2_obj_hasblocks(obj))
+					(void)_ext2_file_truncate(fs, obj, 0);
+				_ext2_obj_destroy(fs, obj, true);
+			}
+			else {
+				ext2_obj_writeback(fs, obj);
+			}
+		}
+
+		mutexUnlock(stripe->lock);
 	}
 
-	mutexUnlock(fs->objs->lock);
+	for (i = 0; i < OBJ_STRIPES; i++) {
+		stripe = fs->objs->stripes + i;
+		mutexLock(stripe->lock);
+
+		for (node = lib_rbMinimum(stripe->used.root); node; node = next) {
+			next = lib_rbNext(node);
+			obj = lib_treeof(ext2_obj_t, node, node);
 
+			_ext2_obj_remove(fs, obj);
+		}
+
+		mutexUnlock(stripe->lock);
+		ext2_stripe_destroy(stripe);
+	}
+	fs->root = NULL;
+
+	resourceDestroy(fs->objs->slock);
+	free(fs->objs->sinodes);
+	free(fs->objs->shared);
 	resourceDestroy(fs->objs->lock);
+	resourceDestroy(fs->ilock);
+	free(fs->objs->slots);
+	free(fs->objs->dirty);
 	free(fs->objs);
 }
 
@@ -320,22 +828,136 @@ static int ext2_obj_cmp(rbnode_t *node1, rbnode_t *node2)
 }
 
 
+/* Assigns inodes to pool objects and returns the pool free objects list */
+static ext2_obj_t *ext2_objs_pool(ext2_t *fs, ext2_obj_t *pool, char *inodes, uint32_t size)
+{
+	ext2_obj_t *head = NULL;
+	uint32_t i;
+
+	for (i = size; i-- > 0;) {
+		pool[i].inode = (ext2_inode_t *)(inodes + i * fs->sb->inodesz);
+		pool[i].next = head;
+		head = pool + i;
+	}
+
+	return head;
+}
+
+
+/* Initializes objects stripe, its objects and inodes pools are allocated up front */
+static int ext2_stripe_init(ext2_t *fs, ext2_stripe_t *stripe, uint32_t size)
+{
+	int err;
+
+	memset(stripe, 0, sizeof(ext2_stripe_t));
+	stripe->size = size;
+	stripe->maxghosts = size / 2;
+	stripe->pool = (ext2_obj_t *)malloc(size * sizeof(ext2_obj_t));
+	stripe->inodes = (char *)malloc(size * fs->sb->inodesz);
+	stripe->ghosts = (uint32_t *)malloc(stripe->maxghosts * sizeof(uint32_t));
+
+	if ((stripe->pool == NULL) || (stripe->inodes == NULL) || (stripe->ghosts == NULL)) {
+		free(stripe->ghosts);
+		free(stripe->inodes);
+		free(stripe->pool);
+		return -ENOMEM;
+	}
+
+	if ((err = mutexCreate(&stripe->lock)) < 0) {
+		free(stripe->ghosts);
+		free(stripe->inodes);
+		free(stripe->pool);
+		return err;
+	}
+
+	stripe->free = ext2_objs_pool(fs, stripe->pool, stripe->inodes, size);
+	lib_rbInit(&stripe->used, ext2_obj_cmp, NULL);
+
+	return EOK;
+}
+
+
 int ext2_objs_init(ext2_t *fs)
 {
 	ext2_objs_t *objs;
+	uint32_t i, size, nshared;
 	int err;
 
+	/* Objects not shared by stripes are split evenly between them */
+	nshared = fs->objsz / OBJ_SHARED_RATIO;
+	if (nshared < OBJ_STRIPE_MIN)
+		nshared = OBJ_STRIPE_MIN;
+
+	size = (fs->objsz > nshared) ? (fs->objsz - nshared + OBJ_STRIPES - 1) / OBJ_STRIPES : 0;
+	if (size < OBJ_STRIPE_MIN)
+		size = OBJ_STRIPE_MIN;
+
 	if ((objs = (ext2_objs_t *)malloc(sizeof(ext2_objs_t))) == NULL)
 		return -ENOMEM;
 
+	objs->size = size * OBJ_STRIPES + nshared;
+
+	if ((objs->dirty = (ext2_obj_t **)malloc(objs->size * sizeof(ext2_obj_t *))) == NULL) {
+		free(objs);
+		return -ENOMEM;
+	}
+
+	if ((objs->slots = (uint8_t *)malloc(fs->blocksz / fs->sb->inodesz)) == NULL) {
+		free(objs->dirty);
+		free(objs);
+		return -ENOMEM;
+	}
+
 	if ((err = mutexCreate(&objs->lock)) < 0) {
+		free(objs->slots);
+		free(objs->dirty);
+		free(objs);
+		return err;
+	}
+
+	if ((err = mutexCreate(&fs->ilock)) < 0) {
+		resourceDestroy(objs->lock);
+		free(objs->slots);
+		free(objs->dirty);
 		free(objs);
 		return err;
 	}
 
-	objs->count = 0;
-	objs->lru = NULL;
-	lib_rbInit(&objs->used, ext2_obj_cmp, NULL);
+	for (i = 0; i < OBJ_STRIPES; i++) {
+		if ((err = ext2_stripe_init(fs, objs->stripes + i, size)) < 0) {
+			while (i--)
+				ext2_stripe_destroy(objs->stripes + i);
+			resourceDestroy(fs->ilock);
+			resourceDestroy(objs->lock);
+			free(objs->slots);
+			free(objs->dirty);
+			free(objs);
+			return err;
+		}
+	}
+
+	objs->nshared = nshared;
+	objs->shared = (ext2_obj_t *)malloc(nshared * sizeof(ext2_obj_t));
+	objs->sinodes = (char *)malloc(nshared * fs->sb->inodesz);
+
+	if ((objs->shared == NULL) || (objs->sinodes == NULL))
+		err = -ENOMEM;
+	else
+		err = mutexCreate(&objs->slock);
+
+	if (err < 0) {
+		free(objs->sinodes);
+		free(objs->shared);
+		for (i = 0; i < OBJ_STRIPES; i++)
+			ext2_stripe_destroy(objs->stripes + i);
+		resourceDestroy(fs->ilock);
+		resourceDestroy(objs->lock);
+		free(objs->slots);
+		free(objs->dirty);
+		free(objs);
+		return err;
+	}
+	objs->sfree = ext2_objs_pool(fs, objs->shared, objs->sinodes, nshared);
 
 	fs->objs = objs;
 	fs->root = NULL;
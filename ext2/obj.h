@@ -29,8 +29,22 @@
 enum {
 	OFLAG_DIRTY = 0x01,
 	OFLAG_MOUNTPOINT = 0x02,
+	OFLAG_HOT = 0x04,        /* Object is kept in the frequently used objects queue */
+	OFLAG_TIMES = 0x08,      /* Only inode timestamps were updated since the last write-back (lazytime mount) */
 };
 
+/* Number of cached block runs per object */
+#define MAP_SIZE 32
+
+/* Number of objects stripes (power of 2), objects are spread over them by ID hash */
+#define OBJ_STRIPES 8
+
+/* Min number of objects per stripe */
+#define OBJ_STRIPE_MIN 4
+
+/* Part of objects shared by stripes (1 / OBJ_SHARED_RATIO), it's borrowed when all objects of a stripe are referenced */
+#define OBJ_SHARED_RATIO 8
+
 #define EXT2_IS_DIRTY(obj)      (((obj)->flags & OFLAG_DIRTY) != 0)
 #define EXT2_IS_MOUNTPOINT(obj) (((obj)->flags & OFLAG_MOUNTPOINT) != 0)
 
@@ -42,37 +56,144 @@ struct _ext2_obj_t {
 	struct {
 		uint32_t bno;
 		uint32_t *data;
+		uint8_t dirty;       /* Block data differs from the device */
 	} ind[3];                /* Indirect blocks */
+	struct {
+		uint32_t block;      /* First logical block */
+		uint32_t n;          /* Number of blocks */
+		uint32_t res;        /* Number of reserved free blocks */
+		void *data;          /* Blocks data */
+	} da;                    /* Delayed allocation blocks (not allocated yet) */
+	struct {
+		uint32_t block;      /* Logical block the window is reserved for */
+		uint32_t bno;        /* First reserved block */
+		uint32_t n;          /* Number of reserved blocks */
+		uint32_t size;       /* Next window size */
+	} pa;                    /* Preallocation window */
+	struct {
+		uint32_t next;       /* Logical block expected by sequential read */
+		uint32_t end;        /* First not prefetched logical block */
+		uint32_t size;       /* Current window size */
+	} ra;                    /* Read-ahead window */
+	struct {
+		uint32_t block;      /* First logical block */
+		uint32_t bno;        /* First physical block */
+		uint32_t len;        /* Number of blocks */
+	} map[MAP_SIZE];         /* Recently mapped block runs (most recently used first) */
+	uint32_t nmap;           /* Number of cached block runs */
+	struct {
+		uint32_t bno;        /* Cached leaf block (0 if none is cached) */
+		uint32_t start;      /* First logical block mapped by the leaf */
+		uint32_t end;        /* First logical block not mapped by the leaf */
+		void *data;          /* Leaf block data */
+	} ext;                   /* Extent tree leaf cache */
+	struct {
+		uint32_t block;      /* Cached logical block */
+		uint8_t cached;      /* Block data is valid */
+		char *data;          /* Block data */
+	} dir;                   /* Directory block cache (used by directory reads) */
 	oid_t dev;               /* Device */
 	uint32_t refs;           /* Reference counter */
+	uint32_t stamp;          /* Stripe FIFO insertions count when the object was last released */
+	time_t ttime;            /* Time of the first timestamps only update since the last write-back */
 	uint8_t flags;           /* Object flags */
 	ext2_inode_t *inode;     /* Underlying inode */
 	ext2_obj_t *prev, *next; /* Double linked list */
 
 	/* Synchronization */
-	handle_t lock;           /* Access mutex */
+	handle_t lock;           /* Reader/writer lock state mutex */
+	handle_t cond;           /* Reader/writer lock release condition */
+	uint32_t readers;        /* Number of readers holding the lock */
+	uint32_t waiting;        /* Number of writers waiting for the lock */
+	uint8_t writer;          /* Writer holds the lock */
+	handle_t rlock;          /* Mutex for state modified by readers (block mapping, read-ahead window, access time and times flag) */
 };
 
 
-struct _ext2_objs_t {
-	rbtree_t used;           /* RBTree of objects in use */
-	uint32_t count;          /* Number of objects in use */
-	ext2_obj_t *lru;         /* Least Recently Used objects cache */
+/* Checks if the object has been modified since the last synchronization */
+static inline int ext2_obj_modified(ext2_obj_t *obj)
+{
+	return EXT2_IS_DIRTY(obj) || obj->da.n || obj->ind[0].dirty || obj->ind[1].dirty || obj->ind[2].dirty;
+}
+
+
+typedef struct {
+	rbtree_t used;           /* RBTree of objects (in use and cached) */
+	uint32_t count;          /* Number of objects */
+	uint32_t size;           /* Max number of objects */
+	ext2_obj_t *pool;        /* Objects pool (allocated up front) */
+	char *inodes;            /* Objects inodes pool */
+	ext2_obj_t *free;        /* Free objects list */
+
+	/* Unreferenced objects are evicted according to 2Q policy */
+	ext2_obj_t *in;          /* Objects referenced once (FIFO, head is the oldest one) */
+	ext2_obj_t *hot;         /* Objects referenced again after leaving the FIFO (LRU, head is the least recently used one) */
+	uint32_t nin;            /* Number of objects in the FIFO */
+	uint32_t seq;            /* Number of FIFO insertions */
+	uint32_t *ghosts;        /* IDs of objects recently evicted from the FIFO (ring buffer, 0 marks a removed ID) */
+	uint32_t maxghosts;      /* Ghost IDs ring buffer size */
+	uint32_t nghosts;        /* Number of ghost IDs */
+	uint32_t ghost;          /* Oldest ghost ID index */
+
+	/* Statistics */
+	uint64_t hits;           /* Objects found in use or cached */
+	uint64_t misses;         /* Objects read from the device */
+	uint64_t evictions;      /* Cached objects evicted */
 
 	/* Synchronization */
 	handle_t lock;           /* Access mutex */
+} ext2_stripe_t;
+
+
+/* Objects cache statistics */
+typedef struct {
+	uint32_t size;           /* Max number of objects */
+	uint32_t count;          /* Number of objects (in use and cached) */
+	uint64_t hits;           /* Objects found in use or cached */
+	uint64_t misses;         /* Objects read from the device */
+	uint64_t evictions;      /* Cached objects evicted */
+} ext2_objs_stat_t;
+
+
+struct _ext2_objs_t {
+	ext2_stripe_t stripes[OBJ_STRIPES]; /* Objects stripes */
+	uint32_t size;                      /* Max number of objects */
+	ext2_obj_t **dirty;                 /* Modified objects (used during synchronization) */
+	uint8_t *slots;                     /* Written back inode table block slots (used during synchronization) */
+
+	/* Shared objects aren't cached, they are returned once unreferenced */
+	uint32_t nshared;                   /* Number of shared objects */
+	ext2_obj_t *shared;                 /* Shared objects pool (allocated up front) */
+	char *sinodes;                      /* Shared objects inodes pool */
+	ext2_obj_t *sfree;                  /* Free shared objects list */
+
+	/* Synchronization */
+	handle_t lock;                      /* Synchronization mutex */
+	handle_t slock;                     /* Free shared objects list mutex */
 };
 
 
-/* Retrives object */
-extern ext2_obj_t *ext2_obj_get(ext2_t *fs, id_t id);
+/* Retrives object, fails with -ENFILE if all objects are in use */
+extern int ext2_obj_get(ext2_t *fs, id_t id, ext2_obj_t **res);
 
 
 /* Releases object */
 extern void ext2_obj_put(ext2_t *fs, ext2_obj_t *obj);
 
 
-/* Synchronizes object (requires object to be locked) */
+/* Locks object for reading, the lock is shared with other readers */
+extern void ext2_obj_rdlock(ext2_obj_t *obj);
+
+
+/* Locks object for writing */
+extern void ext2_obj_lock(ext2_obj_t *obj);
+
+
+/* Unlocks object (locked for reading or writing) */
+extern void ext2_obj_unlock(ext2_obj_t *obj);
+
+
+/* Synchronizes object, its inode is written back later with other modified ones unless mounted synchronously (requires object to be locked) */
 extern int _ext2_obj_sync(ext2_t *fs, ext2_obj_t *obj);
 
 
@@ -89,7 +210,23 @@ extern int ext2_obj_destroy(ext2_t *fs, ext2_obj_t *obj);
 
 
 /* Creates new object */
-extern int ext2_obj_create(ext2_t *fs, uint32_t pino, ext2_inode_t *inode, uint16_t mode, ext2_obj_t **res);
+extern int ext2_obj_create(ext2_t *fs, uint32_t pino, uint16_t mode, ext2_obj_t **res);
+
+
+/* Marks object inode timestamps as updated (requires object to be locked, by readers together with rlock) */
+extern void _ext2_obj_times(ext2_t *fs, ext2_obj_t *obj);
+
+
+/* Updates object access time according to the mount access time mode (requires object to be locked, at least for reading) */
+extern void ext2_obj_atime(ext2_t *fs, ext2_obj_t *obj);
+
+
+/* Synchronizes modified filesystem objects, inodes sharing an inode table block are written back at once (lazy keeps unexpired timestamps only updates) */
+extern int ext2_objs_sync(ext2_t *fs, int lazy);
+
+
+/* Returns objects cache statistics */
+extern void ext2_objs_stat(ext2_t *fs, ext2_objs_stat_t *stat);
 
 
 /* Destroys filesystem objects */
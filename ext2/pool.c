@@ -0,0 +1,104 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Block buffers pool
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include <sys/threads.h>
+
+#include "pool.h"
+
+
+void *ext2_pool_get(ext2_t *fs)
+{
+	ext2_pool_t *pool = fs->pool;
+	void *buff;
+
+	mutexLock(pool->lock);
+
+	if ((buff = pool->free) != NULL) {
+		pool->free = *(void **)buff;
+		pool->nfree--;
+		mutexUnlock(pool->lock);
+		return buff;
+	}
+
+	pool->allocs++;
+	mutexUnlock(pool->lock);
+
+	return malloc(fs->blocksz);
+}
+
+
+void ext2_pool_put(ext2_t *fs, void *buff)
+{
+	ext2_pool_t *pool = fs->pool;
+
+	if (buff == NULL)
+		return;
+
+	mutexLock(pool->lock);
+
+	if (pool->nfree < POOL_SIZE) {
+		*(void **)buff = pool->free;
+		pool->free = buff;
+		pool->nfree++;
+		buff = NULL;
+	}
+
+	mutexUnlock(pool->lock);
+
+	free(buff);
+}
+
+
+void ext2_pool_destroy(ext2_t *fs)
+{
+	ext2_pool_t *pool = fs->pool;
+	void *buff;
+
+	if (pool == NULL)
+		return;
+
+	while ((buff = pool->free) != NULL) {
+		pool->free = *(void **)buff;
+		free(buff);
+	}
+
+	resourceDestroy(pool->lock);
+	free(pool);
+	fs->pool = NULL;
+}
+
+
+int ext2_pool_init(ext2_t *fs)
+{
+	ext2_pool_t *pool;
+	int err;
+
+	if ((pool = (ext2_pool_t *)malloc(sizeof(ext2_pool_t))) == NULL)
+		return -ENOMEM;
+
+	if ((err = mutexCreate(&pool->lock)) < 0) {
+		free(pool);
+		return err;
+	}
+
+	pool->free = NULL;
+	pool->nfree = 0;
+	pool->allocs = 0;
+	fs->pool = pool;
+
+	return EOK;
+}
@@ -0,0 +1,55 @@
+/*
+ * Phoenix-RTOS
+ *
+ * EXT2 filesystem
+ *
+ * Block buffers pool
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <stdint.h>
+
+#include "ext2.h"
+
+
+/* Max number of free buffers kept in the pool */
+#define POOL_SIZE 16
+
+
+struct _ext2_pool_t {
+	void *free;              /* Free buffers stack (linked through buffers data) */
+	uint32_t nfree;          /* Number of free buffers */
+
+	/* Statistics */
+	uint32_t allocs;         /* Number of buffers allocated from the heap */
+
+	/* Synchronization */
+	handle_t lock;           /* Access mutex */
+};
+
+
+/* Returns block size buffer (allocates new one only if the pool is empty) */
+extern void *ext2_pool_get(ext2_t *fs);
+
+
+/* Returns buffer to the pool */
+extern void ext2_pool_put(ext2_t *fs, void *buff);
+
+
+/* Destroys block buffers pool */
+extern void ext2_pool_destroy(ext2_t *fs);
+
+
+/* Initializes block buffers pool */
+extern int ext2_pool_init(ext2_t *fs);
+
+
+#endif
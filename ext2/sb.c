@@ -16,10 +16,13 @@
 #include <errno.h>
 #include <stdlib.h>
 
+#include <sys/threads.h>
+
 #include "sb.h"
 
 
-int ext2_sb_sync(ext2_t *fs)
+/* Writes superblock to the device */
+static int ext2_sb_write(ext2_t *fs)
 {
 	off_t offset = SB_OFFSET;
 	void *data = fs->sb;
@@ -42,9 +45,35 @@ int ext2_sb_sync(ext2_t *fs)
 }
 
 
+void ext2_sb_dirty(ext2_t *fs)
+{
+	mutexLock(fs->mdlock);
+	fs->sbdirty = 1;
+	mutexUnlock(fs->mdlock);
+}
+
+
+int ext2_sb_sync(ext2_t *fs)
+{
+	int err = EOK;
+
+	mutexLock(fs->mdlock);
+
+	if (fs->sbdirty) {
+		if ((err = ext2_sb_write(fs)) == EOK)
+			fs->sbdirty = 0;
+	}
+
+	mutexUnlock(fs->mdlock);
+
+	return err;
+}
+
+
 void ext2_sb_destroy(ext2_t *fs)
 {
 	ext2_sb_sync(fs);
+	resourceDestroy(fs->mdlock);
 	free(fs->sb);
 }
 
@@ -53,6 +82,7 @@ int ext2_sb_init(ext2_t *fs)
 {
 	off_t offset = SB_OFFSET;
 	size_t size = sizeof(ext2_sb_t);
+	int err;
 
 	if ((fs->sb = (ext2_sb_t *)malloc(sizeof(ext2_sb_t))) == NULL)
 		return -ENOMEM;
@@ -78,12 +108,30 @@ int ext2_sb_init(ext2_t *fs)
 		return -ENOENT;
 	}
 
-	//TODO: features check
+	/* Unsupported incompatible features (extent mapped files are supported for reading only) */
+	if ((fs->sb->revMajor != REV_ORIGINAL) && (fs->sb->featureIncompat & ~(INCOMPAT_FILETYPE | INCOMPAT_EXTENTS | INCOMPAT_FLEX_BG))) {
+		free(fs->sb);
+		return -EINVAL;
+	}
+
+	/* Unsupported read-only compatible features (e.g. metadata checksums) => no updates, access times included */
+	fs->rdonly = (fs->sb->revMajor != REV_ORIGINAL) && (fs->sb->featureRocompat &
+		~(ROCOMPAT_SPARSE_SUPER | ROCOMPAT_LARGE_FILE | ROCOMPAT_BTREE_DIR | ROCOMPAT_DIR_NLINK | ROCOMPAT_EXTRA_ISIZE));
+
+	if (fs->rdonly)
+		fs->atime = ATIME_NONE;
 
 	if (!fs->sb->inodesz)
 		fs->sb->inodesz = 128;
 
 	fs->blocksz = 1024 << fs->sb->logBlocksz;
 
+	if ((err = mutexCreate(&fs->mdlock)) < 0) {
+		free(fs->sb);
+		return err;
+	}
+	fs->sbdirty = 0;
+	fs->dares = 0;
+
 	return EOK;
 }
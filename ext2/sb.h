@@ -132,7 +132,7 @@ enum {
 	INCOMPAT_RECOVER       = 0x0004, /* Filesystem recovery */
 	INCOMPAT_JOURNAL_DEV   = 0x0008, /* Separate journal device */
 	INCOMPAT_META_BG       = 0x0010, /* Meta block groups */
-	INCOMPAT_EXTENTS       = 0x0020, /* Files use extents */
+	INCOMPAT_EXTENTS       = 0x0040, /* Files use extents */
 	INCOMPAT_64BIT         = 0x0080, /* Enable filesystem size of 2^64 blocks */
 	INCOMPAT_MMP           = 0x0100, /* Multiple mount protection */
 	INCOMPAT_FLEX_BG       = 0x0200, /* Flexible block groups */
@@ -267,6 +267,10 @@ struct _ext2_sb_t {
 } __attribute__ ((packed));
 
 
+/* Marks superblock as modified */
+extern void ext2_sb_dirty(ext2_t *fs);
+
+
 /* Synchronizes superblock */
 extern int ext2_sb_sync(ext2_t *fs);
 
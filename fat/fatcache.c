@@ -0,0 +1,138 @@
+/*
+ * Phoenix-RTOS
+ *
+ * FAT filesystem driver
+ *
+ * FAT table cache
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+
+#include "fatcache.h"
+
+#include <string.h>
+#include <sys/threads.h>
+
+#include "fatdev.h"
+
+#define FATCACHE_EMPTY     UINT32_MAX
+#define FATCACHE_READAHEAD 8 /* Max number of FAT sectors read at once on a cache miss */
+
+
+int fatcache_init(fat_info_t *info, size_t size)
+{
+	size_t secsz = info->bsbpb.BPB_BytesPerSec;
+	fat_sector_t fatSectors = (info->type == FAT32) ? info->bsbpb.fat32.BPB_FATSz32 : info->bsbpb.BPB_FATSz16;
+
+	/* Sector is cached in slot (sector % slots), so the whole FAT is held without conflicts once it fits */
+	info->fatCache.fatSectors = fatSectors;
+	info->fatCache.slots = min(size / secsz, fatSectors);
+	info->fatCache.data = NULL;
+	info->fatCache.sectors = NULL;
+	if (info->fatCache.slots == 0) {
+		return EOK;
+	}
+
+	info->fatCache.data = malloc(info->fatCache.slots * secsz);
+	info->fatCache.sectors = malloc(info->fatCache.slots * sizeof(fat_sector_t));
+	if ((info->fatCache.data == NULL) || (info->fatCache.sectors == NULL)) {
+		free(info->fatCache.data);
+		free(info->fatCache.sectors);
+		return -ENOMEM;
+	}
+
+	if (mutexCreate(&info->fatCache.lock) < 0) {
+		free(info->fatCache.data);
+		free(info->fatCache.sectors);
+		return -ENOMEM;
+	}
+
+	for (uint32_t i = 0; i < info->fatCache.slots; i++) {
+		info->fatCache.sectors[i] = FATCACHE_EMPTY;
+	}
+
+	return EOK;
+}
+
+
+void fatcache_free(fat_info_t *info)
+{
+	if (info->fatCache.slots == 0) {
+		return;
+	}
+
+	resourceDestroy(info->fatCache.lock);
+	free(info->fatCache.data);
+	free(info->fatCache.sectors);
+	info->fatCache.slots = 0;
+}
+
+
+/* Reads FAT sectors into consecutive slots starting with the missed one (requires cache to be locked) */
+static int _fatcache_fill(fat_info_t *info, fat_sector_t sector, uint32_t slot)
+{
+	size_t secsz = info->bsbpb.BPB_BytesPerSec;
+	uint32_t n = min(FATCACHE_READAHEAD, info->fatCache.slots - slot);
+
+	/* Sectors past the FAT end are read one by one */
+	if (sector < info->fatCache.fatSectors) {
+		n = min(n, info->fatCache.fatSectors - sector);
+	}
+	else {
+		n = 1;
+	}
+
+	/* Don't read again sectors that are already cached */
+	for (uint32_t i = 1; i < n; i++) {
+		if (info->fatCache.sectors[slot + i] == (sector + i)) {
+			n = i;
+			break;
+		}
+	}
+
+	int ret = fatdev_read(info, info->fatoffBytes + (off_t)sector * secsz, n * secsz, info->fatCache.data + slot * secsz);
+	for (uint32_t i = 0; i < n; i++) {
+		info->fatCache.sectors[slot + i] = (ret < 0) ? FATCACHE_EMPTY : (sector + i);
+	}
+
+	return ret;
+}
+
+
+int fatcache_read(fat_info_t *info, off_t off, size_t size, void *buff)
+{
+	if (info->fatCache.slots == 0) {
+		return fatdev_read(info, info->fatoffBytes + off, size, buff);
+	}
+
+	size_t secsz = info->bsbpb.BPB_BytesPerSec;
+	int ret = EOK;
+
+	mutexLock(info->fatCache.lock);
+	while (size > 0) {
+		fat_sector_t sector = off / secsz;
+		size_t insecoff = off % secsz;
+		size_t len = min(size, secsz - insecoff);
+		uint32_t slot = sector % info->fatCache.slots;
+
+		if (info->fatCache.sectors[slot] != sector) {
+			ret = _fatcache_fill(info, sector, slot);
+			if (ret < 0) {
+				break;
+			}
+		}
+
+		memcpy(buff, info->fatCache.data + slot * secsz + insecoff, len);
+		buff = (uint8_t *)buff + len;
+		off += len;
+		size -= len;
+	}
+
+	mutexUnlock(info->fatCache.lock);
+	return ret;
+}
@@ -0,0 +1,33 @@
+/*
+ * Phoenix-RTOS
+ *
+ * FAT filesystem driver
+ *
+ * FAT table cache header file
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+
+#ifndef _FATCACHE_H_
+#define _FATCACHE_H_
+
+#include "fatio.h"
+
+
+/* Allocates cache of up to size bytes for the first FAT (size 0 disables caching) */
+extern int fatcache_init(fat_info_t *info, size_t size);
+
+
+extern void fatcache_free(fat_info_t *info);
+
+
+/* Reads bytes of the first FAT starting at off (relative to FAT start), device is accessed only on a cache miss */
+extern int fatcache_read(fat_info_t *info, off_t off, size_t size, void *buff);
+
+
+#endif /* _FATCACHE_H_ */
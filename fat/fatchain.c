@@ -18,9 +18,11 @@
 
 #include <string.h>
 
+#include "fatcache.h"
 #include "fatdev.h"
 
-#define RSVD_ENTRIES 2
+#define RSVD_ENTRIES  2
+#define FAT_SCAN_SIZE (3 * 4096) /* FAT scan chunk size (bytes), it holds whole pairs of entries of each FAT type */
 
 int fatchain_getOne(fat_info_t *info, fat_cluster_t cluster, fat_cluster_t *next)
 {
@@ -42,7 +44,9 @@ int fatchain_getOne(fat_info_t *info, fat_cluster_t cluster, fat_cluster_t *next
 		byteOff = (cluster * 3) / 2;
 	}
 
-	ret = fatdev_read(info, info->fatoffBytes + byteOff, sizeof(readNext), &readNext);
+	/* FAT12 entry is held within 2 bytes */
+	readNext = 0;
+	ret = fatcache_read(info, byteOff, (info->type == FAT32) ? 4 : 2, &readNext);
 	if (ret < 0) {
 		return ret;
 	}
@@ -72,52 +76,149 @@ int fatchain_getOne(fat_info_t *info, fat_cluster_t cluster, fat_cluster_t *next
 }
 
 
-fat_cluster_t fatchain_scanFreeSpace(fat_info_t *info)
+/* Counts free clusters scanning the whole FAT in large chunks, marks them in free clusters bitmap if it's present */
+static int fatchain_scanFreeSpace(fat_info_t *info)
 {
-	fat_cluster_t freeClusters = 0;
-	if (info->type == FAT12) {
-		/* Not very efficient but for FAT12 it should be good enough (only 4085 clusters max) */
-		for (fat_cluster_t i = 0; i < info->dataClusters + RSVD_ENTRIES; i++) {
-			fat_cluster_t result;
-			if (fatchain_getOne(info, i, &result) < 0) {
-				return 0;
+	/* Two FAT entries take 3 bytes on FAT12, chunks hold whole entries pairs */
+	size_t pairSize = (info->type == FAT32) ? 8 : ((info->type == FAT16) ? 4 : 3);
+	fat_cluster_t end = info->dataClusters + RSVD_ENTRIES;
+	off_t fatEnd = ((end + 1) / 2) * pairSize;
+
+	uint8_t *buff = malloc(FAT_SCAN_SIZE);
+	if (buff == NULL) {
+		return -ENOMEM;
+	}
+
+	info->freeClusters = 0;
+	fat_cluster_t cluster = 0;
+	for (off_t off = 0; off < fatEnd; off += FAT_SCAN_SIZE) {
+		size_t toRead = min(FAT_SCAN_SIZE, fatEnd - off);
+		int ret = fatdev_read(info, info->fatoffBytes + off, toRead, buff);
+		if (ret < 0) {
+			free(buff);
+			return ret;
+		}
+
+		for (size_t i = 0; (i < (toRead / pairSize) * 2) && (cluster < end); i++, cluster++) {
+			uint32_t next;
+			if (info->type == FAT32) {
+				next = (buff[4 * i] | (buff[4 * i + 1] << 8) | (buff[4 * i + 2] << 16) | ((uint32_t)buff[4 * i + 3] << 24)) & 0xfffffff;
+			}
+			else if (info->type == FAT16) {
+				next = buff[2 * i] | (buff[2 * i + 1] << 8);
+			}
+			else { /* FAT12 */
+				next = buff[(3 * i) / 2] | (buff[(3 * i) / 2 + 1] << 8);
+				next = ((i % 2) == 1) ? (next >> 4) : (next & 0xfff);
 			}
 
-			freeClusters += (result == 0) ? 1 : 0;
+			/* The first two entries in FAT are reserved */
+			if ((next == 0) && (cluster >= RSVD_ENTRIES)) {
+				info->freeClusters++;
+				if (info->freeMap != NULL) {
+					info->freeMap[cluster / 32] |= 1U << (cluster % 32);
+				}
+			}
 		}
+	}
+
+	free(buff);
+	return EOK;
+}
 
-		return freeClusters;
+
+/* Reads free clusters count from FAT32 FSInfo sector, returns -ENOENT if it's not valid */
+static int fatchain_readFSInfo(fat_info_t *info)
+{
+	if ((info->type != FAT32) || (info->bsbpb.fat32.BPB_FSInfo == 0) || (info->bsbpb.fat32.BPB_FSInfo == 0xffff)) {
+		return -ENOENT;
 	}
 
-	uint32_t buff[16];
-	/* The first two entries in FAT are reserved, but they are always non-zero */
-	off_t byteOff = info->fatoffBytes;
-	off_t byteEnd = byteOff + (info->dataClusters + RSVD_ENTRIES) * ((info->type == FAT32) ? 4 : 2);
+	fat_fsinfo_t *fsinfo = malloc(sizeof(fat_fsinfo_t));
+	if (fsinfo == NULL) {
+		return -ENOMEM;
+	}
 
-	while (byteOff < byteEnd) {
-		size_t toRead = min(sizeof(buff), byteEnd - byteOff);
-		if (toRead != sizeof(buff)) {
-			memset(buff, 0xff, sizeof(buff));
+	int ret = fatdev_read(info, (off_t)info->bsbpb.fat32.BPB_FSInfo * info->bsbpb.BPB_BytesPerSec, sizeof(fat_fsinfo_t), fsinfo);
+	if (ret == EOK) {
+		/* Free count is only a hint, it's rejected if it can't be right */
+		if ((fsinfo->FSI_LeadSig != FAT_FSI_LEADSIG) || (fsinfo->FSI_StrucSig != FAT_FSI_STRUCSIG) ||
+			(fsinfo->FSI_TrailSig != FAT_FSI_TRAILSIG) || (fsinfo->FSI_Free_Count > info->dataClusters)) {
+			ret = -ENOENT;
+		}
+		else {
+			info->freeClusters = fsinfo->FSI_Free_Count;
+			if ((fsinfo->FSI_Nxt_Free >= RSVD_ENTRIES) && (fsinfo->FSI_Nxt_Free < info->dataClusters + RSVD_ENTRIES)) {
+				info->nextFree = fsinfo->FSI_Nxt_Free;
+			}
 		}
+	}
+
+	free(fsinfo);
+	return ret;
+}
 
-		if (fatdev_read(info, byteOff, toRead, buff) < 0) {
-			return 0;
+
+int fatchain_initFreeSpace(fat_info_t *info, bool freeMap)
+{
+	info->freeClusters = 0;
+	info->nextFree = RSVD_ENTRIES;
+	info->freeMap = NULL;
+
+	/* Bitmap requires the whole FAT to be scanned anyway */
+	if (!freeMap) {
+		int ret = fatchain_readFSInfo(info);
+		if (ret != -ENOENT) {
+			return ret;
 		}
+	}
+	else {
+		info->freeMap = calloc((info->dataClusters + RSVD_ENTRIES + 31) / 32, sizeof(uint32_t));
+		if (info->freeMap == NULL) {
+			return -ENOMEM;
+		}
+	}
 
-		for (int i = 0; i < (sizeof(buff) / sizeof(buff[0])); i++) {
-			if (buff[i] == 0) {
-				freeClusters += (info->type == FAT32) ? 1 : 2;
-			}
-			else if (info->type == FAT16) {
-				freeClusters += ((buff[i] & 0xffff) == 0) ? 1 : 0;
-				freeClusters += ((buff[i] >> 16) == 0) ? 1 : 0;
+	int ret = fatchain_scanFreeSpace(info);
+	if (ret < 0) {
+		free(info->freeMap);
+		info->freeMap = NULL;
+	}
+
+	return ret;
+}
+
+
+int fatchain_findFree(fat_info_t *info, fat_cluster_t cluster, fat_cluster_t *res)
+{
+	fat_cluster_t end = info->dataClusters + RSVD_ENTRIES;
+
+	if (info->freeMap == NULL) {
+		return -ENOSYS;
+	}
+
+	if ((cluster < RSVD_ENTRIES) || (cluster >= end)) {
+		cluster = RSVD_ENTRIES;
+	}
+
+	/* Skip full bitmap words, wrap around once (back to the starting word) */
+	for (fat_cluster_t i = 0; i <= end + 32; i += 32) {
+		uint32_t word = info->freeMap[cluster / 32] & (UINT32_MAX << (cluster % 32));
+		if (word != 0) {
+			fat_cluster_t found = (cluster & ~31U) + __builtin_ctz(word);
+			if (found < end) {
+				*res = found;
+				return EOK;
 			}
 		}
 
-		byteOff += toRead;
+		cluster = (cluster & ~31U) + 32;
+		if (cluster >= end) {
+			cluster = 0;
+		}
 	}
 
-	return freeClusters;
+	return -ENOSPC;
 }
 
 
@@ -219,3 +320,112 @@ int fatchain_parseNext(fat_info_t *info, fatchain_cache_t *c, fat_sector_t skip)
 
 	return EOK;
 }
+
+
+/* Checks if the area starting at the sector continues the last extent */
+static inline bool fatchain_mapContinues(fatchain_map_t *map, fat_sector_t start)
+{
+	return (map->n > 0) && (map->extents[map->n - 1].start + (map->length - map->extents[map->n - 1].offset) == start);
+}
+
+
+/* Appends contiguous area to the map, merges it into the last extent if possible */
+static int fatchain_mapAppend(fatchain_map_t *map, fat_sector_t start, fat_sector_t size)
+{
+	if (fatchain_mapContinues(map, start)) {
+		map->length += size;
+		return EOK;
+	}
+
+	if (map->n == map->size) {
+		uint32_t newSize = (map->size == 0) ? FAT_CHAIN_AREAS : map->size * 2;
+		void *extents = realloc(map->extents, newSize * sizeof(map->extents[0]));
+		if (extents == NULL) {
+			return -ENOMEM;
+		}
+
+		map->extents = extents;
+		map->size = newSize;
+	}
+
+	map->extents[map->n].offset = map->length;
+	map->extents[map->n].start = start;
+	map->n++;
+	map->length += size;
+	return EOK;
+}
+
+
+/* Parses FAT chain until it maps the whole extent holding the offset or reaches the end of chain */
+static int fatchain_mapExtend(fat_info_t *info, fatchain_map_t *map, fat_sector_t secoff)
+{
+	fat_sector_t clusSectors = info->bsbpb.BPB_SecPerClus;
+	int ret;
+
+	if ((map->length == 0) && (map->next == ROOT_DIR_CLUSTER)) {
+		/* Root directory cluster - special treatment needed */
+		if (info->type == FAT32) {
+			map->next = info->bsbpb.fat32.BPB_RootClus;
+		}
+		else {
+			/* On FAT12 or FAT16 root directory is always contiguous and fixed size */
+			map->next = FAT_EOF;
+			return fatchain_mapAppend(map, info->rootoff, info->dataoff - info->rootoff);
+		}
+	}
+
+	while (map->next != FAT_EOF) {
+		/* Chain longer than the drive may indicate FAT is corrupted (loop in chain) */
+		if ((map->next < RSVD_ENTRIES) || (map->next >= info->clusters) || (map->length >= info->clusters * clusSectors)) {
+			return -EINVAL;
+		}
+
+		fat_sector_t start = info->dataoff + (map->next - 2) * clusSectors;
+		if ((map->length > secoff) && !fatchain_mapContinues(map, start)) {
+			break;
+		}
+
+		ret = fatchain_mapAppend(map, start, clusSectors);
+		if (ret < 0) {
+			return ret;
+		}
+
+		ret = fatchain_getOne(info, map->next, &map->next);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	return EOK;
+}
+
+
+int fatchain_mapSector(fat_info_t *info, fatchain_map_t *map, fat_sector_t secoff, fat_sector_t *start, fat_sector_t *len)
+{
+	int ret = fatchain_mapExtend(info, map, secoff);
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (secoff >= map->length) {
+		*len = 0;
+		return EOK;
+	}
+
+	/* Binary search for the last extent beginning at or before the offset */
+	uint32_t lo = 0, hi = map->n - 1;
+	while (lo < hi) {
+		uint32_t mid = (lo + hi + 1) / 2;
+		if (map->extents[mid].offset <= secoff) {
+			lo = mid;
+		}
+		else {
+			hi = mid - 1;
+		}
+	}
+
+	fat_sector_t end = (lo + 1 < map->n) ? map->extents[lo + 1].offset : map->length;
+	*start = map->extents[lo].start + (secoff - map->extents[lo].offset);
+	*len = end - secoff;
+	return EOK;
+}
@@ -29,7 +29,29 @@ static inline void fatchain_initCache(fatchain_cache_t *c, uint32_t cluster)
 }
 
 
-extern fat_cluster_t fatchain_scanFreeSpace(fat_info_t *info);
+static inline void fatchain_initMap(fatchain_map_t *map, uint32_t cluster)
+{
+	map->next = cluster;
+	map->length = 0;
+	map->n = 0;
+	map->size = 0;
+	map->extents = NULL;
+}
+
+
+static inline void fatchain_freeMap(fatchain_map_t *map)
+{
+	free(map->extents);
+	map->extents = NULL;
+}
+
+
+/* Computes free clusters count (from FAT32 FSInfo sector if it's valid, otherwise by scanning FAT), optionally builds free clusters bitmap */
+extern int fatchain_initFreeSpace(fat_info_t *info, bool freeMap);
+
+
+/* Finds the first free cluster at or after the given one (wraps around), requires free clusters bitmap */
+extern int fatchain_findFree(fat_info_t *info, fat_cluster_t cluster, fat_cluster_t *res);
 
 
 extern int fatchain_getOne(fat_info_t *info, fat_cluster_t cluster, fat_cluster_t *next);
@@ -38,4 +60,8 @@ extern int fatchain_getOne(fat_info_t *info, fat_cluster_t cluster, fat_cluster_
 extern int fatchain_parseNext(fat_info_t *info, fatchain_cache_t *c, fat_sector_t skip);
 
 
+/* Maps offset in FAT chain to a run of len contiguous sectors starting at start (len == 0 past the end of chain) */
+extern int fatchain_mapSector(fat_info_t *info, fatchain_map_t *map, fat_sector_t secoff, fat_sector_t *start, fat_sector_t *len);
+
+
 #endif /* _FATCHAIN_H_ */
@@ -624,6 +624,39 @@ ssize_t fatio_read(fat_info_t *info, fatchain_cache_t *c, off_t offset, size_t s
 }
 
 
+ssize_t fatio_readMapped(fat_info_t *info, fatchain_map_t *map, off_t offset, size_t size, void *buff)
+{
+	size_t totalRead = 0;
+
+	while (totalRead < size) {
+		fat_sector_t secoff = (offset + totalRead) / info->bsbpb.BPB_BytesPerSec;
+		unsigned int insecoff = (offset + totalRead) % info->bsbpb.BPB_BytesPerSec;
+		fat_sector_t start, len;
+
+		if (fatchain_mapSector(info, map, secoff, &start, &len) < 0) {
+			return -ENOENT;
+		}
+
+		if (len == 0) {
+			/* End of chain, cannot read more */
+			break;
+		}
+
+		size_t chunk_offs = (size_t)start * info->bsbpb.BPB_BytesPerSec + insecoff;
+		size_t chunk_size = (size_t)len * info->bsbpb.BPB_BytesPerSec - insecoff;
+		size_t read_size = min(chunk_size, size - totalRead);
+		int ret = fatdev_read(info, chunk_offs, read_size, buff + totalRead);
+		if (ret < 0) {
+			return ret;
+		}
+
+		totalRead += read_size;
+	}
+
+	return totalRead;
+}
+
+
 void fat_printFilesystemInfo(fat_info_t *info, bool printFat)
 {
 	unsigned int i, next;
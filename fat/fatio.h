@@ -30,7 +30,8 @@
 
 #define FATFS_DEBUG 0
 
-#define FAT_CHAIN_AREAS  8 /* Number of contiguous areas that can be cached at once */
+#define FAT_CHAIN_AREAS  8   /* Number of contiguous areas that can be cached at once */
+#define FAT_CACHE_SIZE   128 /* Default FAT cache size (KiB), holds the whole FAT of FAT12/16 volumes */
 #define FAT_ROOT_ID      UINT64_MAX
 #define ROOT_DIR_CLUSTER 0
 #define NO_LFN_BIT       (1U << 31)
@@ -57,6 +58,21 @@ typedef struct {
 } fatchain_cache_t;
 
 
+/* Random access reads map offsets through the cluster runs of the whole FAT chain.
+ * The chain is parsed lazily, only as far as it's accessed.
+ */
+typedef struct {
+	fat_cluster_t next;  /* First cluster not parsed yet (FAT_EOF once the whole chain is parsed) */
+	fat_sector_t length; /* Number of sectors mapped */
+	uint32_t n;          /* Number of extents */
+	uint32_t size;       /* Extents array capacity */
+	struct {
+		fat_sector_t offset; /* Offset in FAT chain where this extent begins */
+		fat_sector_t start;  /* Start sector of this extent (it spans up to the next extent offset) */
+	} *extents; /* Contiguous areas making up the chain, sorted by offset */
+} fatchain_map_t;
+
+
 typedef struct _fat_info_t {
 	storage_t *strg;
 	unsigned int port;
@@ -71,8 +87,20 @@ typedef struct _fat_info_t {
 	fat_cluster_t dataClusters; /* Total clusters in data space */
 	fat_cluster_t clusters;     /* Total clusters on drive */
 
+	fat_cluster_t freeClusters; /* Number of free clusters (computed at mount) */
+	fat_cluster_t nextFree;     /* Cluster to start looking for free clusters at */
+	uint32_t *freeMap;          /* Free clusters bitmap (NULL if not enabled) */
+
 	rbtree_t openObjs; /* Tree of open objects */
 	handle_t objLock;  /* Lock for object add/remove/lookup operations */
+
+	struct {
+		handle_t lock;           /* Lock for cache access */
+		uint8_t *data;           /* Cached FAT sectors */
+		fat_sector_t *sectors;   /* FAT sector held in each slot */
+		uint32_t slots;          /* Number of cached sectors, 0 if caching is disabled */
+		fat_sector_t fatSectors; /* Size of FAT (in sectors) */
+	} fatCache;
 } fat_info_t;
 
 
@@ -152,6 +180,9 @@ extern int fatio_dirScan(fat_info_t *info, fatchain_cache_t *c, uint32_t offset,
 extern ssize_t fatio_read(fat_info_t *info, fatchain_cache_t *c, off_t offset, size_t size, void *buff);
 
 
+extern ssize_t fatio_readMapped(fat_info_t *info, fatchain_map_t *map, off_t offset, size_t size, void *buff);
+
+
 /* Lookup path from root to end (d is output only) */
 extern int fatio_lookupPath(fat_info_t *info, const char *path, fat_dirent_t *d, fat_fileID_t *id);
 
@@ -73,14 +73,21 @@ typedef struct _fat_bsbpb_t {
 
 typedef struct _fat_fsinfo_t {
 	uint32_t FSI_LeadSig;
-	uint32_t FSI_Reserved1[480];
+	uint8_t FSI_Reserved1[480];
 	uint32_t FSI_StrucSig;
 	uint32_t FSI_Free_Count;
 	uint32_t FSI_Nxt_Free;
 	uint8_t FSI_Reserved2[12];
+	uint32_t FSI_TrailSig;
 } __attribute__((packed)) fat_fsinfo_t;
 
 
+#define FAT_FSI_LEADSIG  0x41615252
+#define FAT_FSI_STRUCSIG 0x61417272
+#define FAT_FSI_TRAILSIG 0xaa550000
+#define FAT_FSI_UNKNOWN  0xffffffff
+
+
 typedef struct {
 	uint32_t BS_VolID;
 	uint32_t BPB_TotSecL;
@@ -27,6 +27,7 @@
 #include <phoenix/attribute.h>
 
 #include "fatio.h"
+#include "fatcache.h"
 #include "fatchain.h"
 #include "fatdev.h"
 
@@ -45,7 +46,8 @@ typedef struct {
 	size_t refcount;
 	uint32_t size;
 	handle_t lock;
-	fatchain_cache_t chain;
+	fatchain_cache_t chain; /* Used by directory scans */
+	fatchain_map_t map;     /* Used by reads */
 	bool isDir;
 } fat_obj_t;
 
@@ -302,6 +304,7 @@ static int libfat_open(void *infoVoid, oid_t *oid)
 	}
 
 	fatchain_initCache(&obj->chain, fat_getCluster(&d, info->type));
+	fatchain_initMap(&obj->map, fat_getCluster(&d, info->type));
 	obj->isDir = fat_isDirectory(&d);
 	obj->id.raw = oid->id;
 	obj->refcount = 1;
@@ -338,6 +341,7 @@ static int libfat_close(void *infoVoid, oid_t *oid)
 	lib_rbRemove(&info->openObjs, &obj->node);
 	mutexUnlock(obj->lock);
 	resourceDestroy(obj->lock);
+	fatchain_freeMap(&obj->map);
 	free(obj);
 	mutexUnlock(info->objLock);
 	return EOK;
@@ -366,7 +370,7 @@ ssize_t libfat_read(void *infoVoid, oid_t *oid, off_t offs, void *data, size_t l
 	}
 	else {
 		len = min(obj->size - offs, len);
-		ret = fatio_read(info, &obj->chain, offs, len, data);
+		ret = fatio_readMapped(info, &obj->map, offs, len, data);
 	}
 
 	mutexUnlock(obj->lock);
@@ -463,7 +467,7 @@ static int libfat_statfs(void *infoVoid, void *buf, size_t len)
 		return -EINVAL;
 	}
 
-	fat_cluster_t freeClusters = fatchain_scanFreeSpace(info);
+	fat_cluster_t freeClusters = info->freeClusters;
 	size_t clusterSize = info->bsbpb.BPB_SecPerClus * info->bsbpb.BPB_BytesPerSec;
 	st->f_bsize = st->f_frsize = clusterSize;
 	st->f_blocks = info->dataClusters;
@@ -512,17 +516,65 @@ int libfat_umount(storage_fs_t *strg_fs)
 		fat_obj_t *obj = lib_treeof(fat_obj_t, node, node);
 		handle_t lockTmp = obj->lock;
 		resourceDestroy(lockTmp);
+		fatchain_freeMap(&obj->map);
 		free(obj);
 		node = next;
 	}
 
 	mutexUnlock(info->objLock);
 	resourceDestroy(info->objLock);
+	fatcache_free(info);
+	free(info->freeMap);
 	free(info);
 	return EOK;
 }
 
 
+/* Parses mount options (fatcache=<KiB>, freemap), unknown options are ignored */
+static int libfat_parseOpts(const char *data, uint32_t *cacheSize, bool *freeMap)
+{
+	*cacheSize = FAT_CACHE_SIZE;
+	*freeMap = false;
+	if (data == NULL) {
+		return EOK;
+	}
+
+	char *opts = strdup(data);
+	if (opts == NULL) {
+		return -ENOMEM;
+	}
+
+	int ret = EOK;
+	char *tmp;
+	for (char *opt = strtok_r(opts, ",", &tmp); opt != NULL; opt = strtok_r(NULL, ",", &tmp)) {
+		char *val = strchr(opt, '=');
+		if (val != NULL) {
+			*val++ = '\0';
+		}
+
+		if (strcmp(opt, "fatcache") == 0) {
+			char *end;
+			if ((val == NULL) || (*val == '\0')) {
+				ret = -EINVAL;
+				break;
+			}
+
+			*cacheSize = strtoul(val, &end, 0);
+			if (*end != '\0') {
+				ret = -EINVAL;
+				break;
+			}
+		}
+		else if (strcmp(opt, "freemap") == 0) {
+			*freeMap = true;
+		}
+	}
+
+	free(opts);
+	return ret;
+}
+
+
 int libfat_mount(storage_t *strg, storage_fs_t *fs, const char *data, unsigned long mode, oid_t *root)
 {
 	if (sizeof(id_t) < sizeof(fat_fileID_t)) {
@@ -530,6 +582,8 @@ int libfat_mount(storage_t *strg, storage_fs_t *fs, const char *data, unsigned l
 		return -EOPNOTSUPP;
 	}
 
+	uint32_t cacheSize;
+	bool freeMap;
 	int err;
 	if (strg == NULL ||
 		strg->dev == NULL ||
@@ -539,6 +593,11 @@ int libfat_mount(storage_t *strg, storage_fs_t *fs, const char *data, unsigned l
 		return -ENOSYS;
 	}
 
+	err = libfat_parseOpts(data, &cacheSize, &freeMap);
+	if (err < 0) {
+		return err;
+	}
+
 	fat_info_t *info = malloc(sizeof(fat_info_t));
 	if (info == NULL) {
 		return -ENOMEM;
@@ -560,6 +619,22 @@ int libfat_mount(storage_t *strg, storage_fs_t *fs, const char *data, unsigned l
 		return err;
 	}
 
+	err = fatcache_init(info, (size_t)cacheSize * 1024);
+	if (err < 0) {
+		resourceDestroy(info->objLock);
+		free(info);
+		return err;
+	}
+
+	/* Free space is counted once, the filesystem is read-only */
+	err = fatchain_initFreeSpace(info, freeMap);
+	if (err < 0) {
+		fatcache_free(info);
+		resourceDestroy(info->objLock);
+		free(info);
+		return err;
+	}
+
 	lib_rbInit(&info->openObjs, libfat_objCmp, NULL);
 
 	fs->info = info;